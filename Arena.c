@@ -0,0 +1,139 @@
+#include "Arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_ALIGN 8
+#define ARENA_FIRST_BLOCK 1024       // bytes in the first block, doubled for each new one
+#define ARENA_MAX_BLOCK (1 << 20)
+#define ARENA_CLASSES 64             // pieces up to 64*ARENA_ALIGN bytes are recycled
+
+/**
+ * A chunk of memory obtained from malloc.
+ * Blocks are chained so the whole arena can be freed by walking them.
+ */
+typedef struct Block {
+    struct Block* next;
+    size_t cap;
+} Block;
+
+/**
+ * Arena structure.
+ * Pieces are bumped out of the current block (cur..end), released ones are kept
+ * in intrusive freelists, one per size class (the first word points to the next free one).
+ */
+struct _Arena {
+    size_t blockSize;
+    Block* blocks;
+    char* cur;
+    char* end;
+    void* freeLists[ARENA_CLASSES];
+};
+
+/** A HELPER FUNCTION
+ * Rounds n up to a multiple of ARENA_ALIGN.
+ */
+static size_t alignUp(size_t n) {
+    return (n + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+/** A HELPER FUNCTION
+ * Allocates a new Block with cap usable bytes and pushes it on the chain of the arena.
+ * @return A pointer to the usable memory of the block, or NULL if malloc failed.
+ */
+static char* newBlock(Arena* arena, size_t cap) {
+    Block* block = (Block*)malloc(sizeof(Block) + cap);
+    if (block == NULL) {
+        return NULL;
+    }
+    block->cap = cap;
+    block->next = arena->blocks;
+    arena->blocks = block;
+    return (char*)(block + 1);
+}
+
+/** A HELPER FUNCTION
+ * Frees every Block of the arena and puts it back in its initial empty state.
+ */
+static void Arena_init(Arena* arena) {
+    Block* block = arena->blocks;
+    while (block != NULL) {
+        Block* next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->blockSize = ARENA_FIRST_BLOCK;
+    arena->blocks = NULL;
+    arena->cur = NULL;
+    arena->end = NULL;
+    memset(arena->freeLists, 0, sizeof(arena->freeLists));
+}
+
+Arena* Arena_alloc() {
+    Arena* arena = (Arena*)malloc(sizeof(Arena));
+    if (arena == NULL) {
+        return NULL;
+    }
+    arena->blocks = NULL;
+    Arena_init(arena);
+    return arena;
+}
+
+void Arena_free(Arena* arena) {
+    if (arena == NULL) return;
+    Arena_init(arena);
+    free(arena);
+}
+
+void Arena_reset(Arena* arena) {
+    Arena_init(arena);
+}
+
+size_t Arena_pieceSize(size_t size) {
+    return alignUp(size < sizeof(void*) ? sizeof(void*) : size);
+}
+
+void* Arena_new(Arena* arena, size_t size) {
+    size_t need = Arena_pieceSize(size);
+    size_t cls = need / ARENA_ALIGN - 1;
+    if (cls < ARENA_CLASSES && arena->freeLists[cls] != NULL) {
+        void* ptr = arena->freeLists[cls];
+        arena->freeLists[cls] = *(void**)ptr;
+        return ptr;
+    }
+    if ((size_t)(arena->end - arena->cur) < need) {
+        // a piece that would waste most of a block gets a block of its own,
+        // the current block keeps serving the small ones
+        if (need > arena->blockSize / 4) {
+            return newBlock(arena, need);
+        }
+        char* block = newBlock(arena, arena->blockSize);
+        if (block == NULL) {
+            return NULL;
+        }
+        arena->cur = block;
+        arena->end = block + arena->blockSize;
+        if (arena->blockSize < ARENA_MAX_BLOCK) {
+            arena->blockSize *= 2;
+        }
+    }
+    void* ptr = arena->cur;
+    arena->cur += need;
+    return ptr;
+}
+
+void Arena_release(Arena* arena, void* ptr, size_t size) {
+    size_t cls = Arena_pieceSize(size) / ARENA_ALIGN - 1;
+    if (cls < ARENA_CLASSES) {
+        *(void**)ptr = arena->freeLists[cls];
+        arena->freeLists[cls] = ptr;
+    }
+    // larger pieces stay in their block until the arena is reset
+}
+
+size_t Arena_bytes(const Arena* arena) {
+    size_t bytes = 0;
+    for (const Block* block = arena->blocks; block != NULL; block = block->next) {
+        bytes += sizeof(Block) + block->cap;
+    }
+    return bytes;
+}
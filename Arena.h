@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stddef.h>
+
+/********************************************************************************
+ *
+ * An Arena allocator.
+ *
+ * The arena bump-allocates pieces of memory out of larger blocks. Released
+ * pieces of up to a few hundred bytes are kept on per-size freelists and
+ * reused by the next allocations of the same size.
+ *
+ * All the memory of an arena is returned at once by Arena_reset or Arena_free,
+ * in time proportional to the number of blocks and not to the number of
+ * allocations.
+ *
+ ********************************************************************************/
+
+struct _Arena;
+typedef struct _Arena Arena;
+
+/*
+ * Allocates a new empty Arena.
+ * It's the user responsibility to free it with Arena_free.
+ */
+Arena* Arena_alloc();
+
+/*
+ * Frees the Arena and everything allocated from it.
+ * If arena==NULL does nothing (same as free).
+ */
+void Arena_free(Arena* arena);
+
+/*
+ * Frees everything allocated from the Arena,
+ * leaving it empty and ready for reuse.
+ */
+void Arena_reset(Arena* arena);
+
+/*
+ * Returns an uninitialized, pointer aligned piece of size bytes,
+ * or NULL if the allocation failed.
+ */
+void* Arena_new(Arena* arena, size_t size);
+
+/*
+ * Returns the number of bytes a piece of size bytes takes in an Arena.
+ * Consecutive pieces can be carved out of a single Arena_new of the sum of their
+ * Arena_pieceSize, and then released one by one.
+ */
+size_t Arena_pieceSize(size_t size);
+
+/*
+ * Gives a piece back to the Arena. size must be the one it was allocated with.
+ */
+void Arena_release(Arena* arena, void* ptr, size_t size);
+
+/*
+ * Returns the number of bytes the Arena holds: its blocks, used or not.
+ */
+size_t Arena_bytes(const Arena* arena);
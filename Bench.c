@@ -0,0 +1,1093 @@
+#define _POSIX_C_SOURCE 200809L
+#include "StrList.h"
+#include "ThreadPool.h"
+#include "StrKernels.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/********************************************************************************
+ *
+ * A benchmark of the StrList library.
+ *
+ * Every function of StrList.h is timed on synthetic workloads of each of the
+ * requested sizes, and one CSV row is written per (operation, workload, size):
+ *
+ *     operation,workload,flags,threads,size,calls,items,seconds,ns_per_call,ns_per_item
+ *
+ * calls is the number of timed calls, items the number of elements they cover
+ * (an insertLast of a whole workload covers size items, a count size items,
+ * an insertAt batch POSITIONAL_BATCH items), so ns_per_item can be compared
+ * across sizes. Building and freeing the lists a call works on is not timed.
+ *
+ * The concurrent operations run -t threads on one STRLIST_CONCURRENT list;
+ * running the benchmark with -t 1, 2, 4... shows how they scale.
+ * removeAll removes REMOVE_ALL_BATCH random words of the workload in one call,
+ * removeEach the same words with one StrList_remove each, and removeIf the words
+ * starting with a vowel.
+ * countPrefix, removePrefix and listPrefix use the first half of a random word as
+ * the prefix, listPrefix asks for LIST_PREFIX_COUNT completions. countPrefix and
+ * listPrefix run on a STRLIST_PREFIX_INDEX list, countPrefixScan on one without
+ * the prefix index. removePrefix runs in the -f mode: add STRLIST_PREFIX_INDEX (64)
+ * to it to remove through the index (compare it with removeIf), and compare the
+ * insert operations with and without it for what keeping the index costs.
+ * count and isEqual are timed serially at every size, and again as countParallel
+ * and isEqualParallel with the parallel scans of StrList_setParallelScan on -t
+ * threads. Run countParallel with -f 0: with a hash index a count is a single lookup.
+ *
+ * strcmp and kernelCompare compare every pair of neighbour words of the workload,
+ * memcmp and kernelEqual every word with an equal copy of it (the strings StrList
+ * compares for equality have the same length and hash), with the libc functions
+ * and with the kernels of StrKernels.h. -k scalar, portable, sse2 or avx2 picks the kernels
+ * (the best one the processor has by default), so running the benchmark with each
+ * of them shows what the vector kernels gain, best on the long and prefix workloads.
+ *
+ * usage: StrListBench [-s sizes] [-w workloads] [-f flags] [-t threads]
+ *                     [-k kernels] [-m seconds] [-o report.csv]
+ *
+ ********************************************************************************/
+
+#define DEFAULT_SIZES "1000,10000,100000,1000000"
+#define DEFAULT_MIN_TIME 0.2        // seconds each operation is repeated for, at least one call
+#define MAX_CALLS 100000
+#define SETUP_TIME_FACTOR 10        // an operation stops after this many times minTime, setup included
+#define POSITIONAL_BATCH 1000       // positions used by one call of insertAt, printAt, removeAt
+#define INSERT_MANY_BATCH 1000      // words inserted by one call of insertMany
+#define CONCURRENT_BATCH 1000       // calls made by each thread in one call of the concurrent operations
+#define REMOVE_ALL_BATCH 64         // words removed by one call of removeAll and removeEach
+#define PREFIX_MAX 64               // buffer of the prefixes used by countPrefix, removePrefix, listPrefix
+#define LIST_PREFIX_COUNT 10        // completions listed by one call of listPrefix
+#define MAX_SIZES 16
+
+/**
+ * The words of a workload, all stored in one block.
+ */
+typedef struct Workload
+{
+    const char *name;
+    char **words;
+    size_t *lens; // the lengths of the words
+    char **twins; // an equal copy of each word, elsewhere in memory
+    char *storage;
+    char *twinStorage;
+    size_t n;
+} Workload;
+
+/**
+ * The state handed to an operation.
+ * list is prepared according to the setup of the operation, copy holds
+ * the same words as list for the operations that need a second list.
+ */
+typedef struct OpCtx
+{
+    Workload *w;
+    StrList *list;
+    StrList *copy;
+    int flags;
+    int threads;
+    ThreadPool *pool;
+    int devNull;
+    char snapshot[64]; // the file of the save and load operations
+    uint64_t rng;
+} OpCtx;
+
+enum
+{
+    SETUP_EMPTY,  // every call starts from a new empty list
+    SETUP_FRESH,  // every call gets a new list holding the workload
+    SETUP_SHARED, // all the calls share one list holding the workload
+    SETUP_CONCURRENT, // same, with a STRLIST_CONCURRENT list
+    SETUP_PREFIX, // same, with a STRLIST_PREFIX_INDEX list
+    SETUP_SORTED, // every call starts from a new empty STRLIST_SORTED list
+    SETUP_NONE    // the calls work on the words of the workload alone
+};
+
+/**
+ * A benchmarked operation: run performs one timed call and returns the number
+ * of elements it handled.
+ */
+typedef struct Op
+{
+    const char *name;
+    int setup;
+    int needsCopy;
+    long (*run)(OpCtx *ctx);
+} Op;
+
+/**
+ * A HELPER FUNCTION
+ * Returns a monotonic time in seconds.
+ */
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/**
+ * A HELPER FUNCTION
+ * xorshift64*, a fast generator good enough for workloads and positions.
+ */
+static uint64_t nextRandom(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+ * A HELPER FUNCTION
+ * Writes a random lowercase word of minLen to maxLen chars at out and returns its length.
+ */
+static size_t randomWord(char *out, size_t minLen, size_t maxLen, uint64_t *rng)
+{
+    size_t len = minLen + (size_t)(nextRandom(rng) % (maxLen - minLen + 1));
+    for (size_t i = 0; i < len; i++)
+    {
+        out[i] = (char)('a' + nextRandom(rng) % 26);
+    }
+    out[len] = '\0';
+    return len;
+}
+
+/**
+ * A HELPER FUNCTION
+ * strcmp on two char* elements, for qsort.
+ */
+static int compareWords(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/**
+ * A HELPER FUNCTION
+ * Allocates the arrays of a workload of n words of at most maxLen chars.
+ * Returns 1 on success, 0 if the allocation failed.
+ */
+static int Workload_init(Workload *w, const char *name, size_t n, size_t maxLen)
+{
+    w->name = name;
+    w->n = n;
+    w->words = (char **)malloc(n * sizeof(char *));
+    w->lens = (size_t *)malloc(n * sizeof(size_t));
+    w->storage = (char *)malloc(n * (maxLen + 1));
+    return w->words != NULL && w->lens != NULL && w->storage != NULL;
+}
+
+/**
+ * Frees the arrays of a workload.
+ */
+static void Workload_free(Workload *w)
+{
+    free(w->words);
+    free(w->lens);
+    free(w->twins);
+    free(w->storage);
+    free(w->twinStorage);
+}
+
+/**
+ * Generates the workload called name with n words. The workloads are:
+ * random   - random words of 3 to 12 letters, nearly all distinct
+ * zipf     - words drawn from a vocabulary of n/10 words with Zipfian frequencies (s=1)
+ * prefix   - random words sharing a 64 char prefix, so comparing them is slow
+ * deep     - random words sharing a 150 char prefix, the worst case of a radix sort
+ * long     - random words of 64 to 128 letters, half of them repeating an earlier one
+ * sorted   - the random words in increasing order
+ * reversed - the random words in decreasing order
+ * Returns 1 on success, 0 for an unknown name or a failed allocation.
+ */
+static int Workload_generate(Workload *w, const char *name, size_t n, uint64_t seed)
+{
+    uint64_t rng = seed;
+    memset(w, 0, sizeof(Workload));
+    if (strcmp(name, "random") == 0 || strcmp(name, "sorted") == 0 || strcmp(name, "reversed") == 0)
+    {
+        if (!Workload_init(w, name, n, 12))
+        {
+            return 0;
+        }
+        char *at = w->storage;
+        for (size_t i = 0; i < n; i++)
+        {
+            w->words[i] = at;
+            at += randomWord(at, 3, 12, &rng) + 1;
+        }
+        if (strcmp(name, "random") != 0)
+        {
+            qsort(w->words, n, sizeof(char *), compareWords);
+        }
+        if (strcmp(name, "reversed") == 0)
+        {
+            for (size_t i = 0; i < n / 2; i++)
+            {
+                char *tmp = w->words[i];
+                w->words[i] = w->words[n - 1 - i];
+                w->words[n - 1 - i] = tmp;
+            }
+        }
+        return 1;
+    }
+    if (strcmp(name, "zipf") == 0)
+    {
+        size_t vocab = n / 10 < 1 ? 1 : n / 10;
+        double *cdf = (double *)malloc(vocab * sizeof(double));
+        if (cdf == NULL || !Workload_init(w, name, n, 12))
+        {
+            free(cdf);
+            return 0;
+        }
+        // storage holds the vocabulary, the words point into it
+        char *at = w->storage;
+        char **entries = (char **)malloc(vocab * sizeof(char *));
+        if (entries == NULL)
+        {
+            free(cdf);
+            return 0;
+        }
+        double total = 0;
+        for (size_t i = 0; i < vocab; i++)
+        {
+            entries[i] = at;
+            at += randomWord(at, 3, 12, &rng) + 1;
+            total += 1.0 / (double)(i + 1);
+            cdf[i] = total;
+        }
+        for (size_t i = 0; i < n; i++)
+        {
+            double u = (double)(nextRandom(&rng) >> 11) / 9007199254740992.0 * total;
+            size_t lo = 0, hi = vocab - 1;
+            while (lo < hi)
+            {
+                size_t mid = (lo + hi) / 2;
+                if (cdf[mid] < u)
+                {
+                    lo = mid + 1;
+                }
+                else
+                {
+                    hi = mid;
+                }
+            }
+            w->words[i] = entries[lo];
+        }
+        free(entries);
+        free(cdf);
+        return 1;
+    }
+    if (strcmp(name, "prefix") == 0 || strcmp(name, "deep") == 0)
+    {
+        size_t shared = (strcmp(name, "deep") == 0) ? 150 : 64;
+        if (!Workload_init(w, name, n, shared + 8))
+        {
+            return 0;
+        }
+        char *at = w->storage;
+        for (size_t i = 0; i < n; i++)
+        {
+            w->words[i] = at;
+            memset(at, 'p', shared);
+            at += shared + randomWord(at + shared, 4, 8, &rng) + 1;
+        }
+        return 1;
+    }
+    if (strcmp(name, "long") == 0)
+    {
+        if (!Workload_init(w, name, n, 128))
+        {
+            return 0;
+        }
+        char *at = w->storage;
+        for (size_t i = 0; i < n; i++)
+        {
+            if (i > 0 && nextRandom(&rng) % 2 == 0)
+            {
+                w->words[i] = w->words[nextRandom(&rng) % i];
+                continue;
+            }
+            w->words[i] = at;
+            at += randomWord(at, 64, 128, &rng) + 1;
+        }
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Generates the workload called name with n words (see Workload_generate),
+ * measures their lengths and copies them to the twins.
+ * Returns 1 on success, 0 for an unknown name or a failed allocation.
+ */
+static int Workload_make(Workload *w, const char *name, size_t n, uint64_t seed)
+{
+    if (!Workload_generate(w, name, n, seed))
+    {
+        return 0;
+    }
+    size_t total = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        w->lens[i] = strlen(w->words[i]);
+        total += w->lens[i] + 1;
+    }
+    w->twins = (char **)malloc(n * sizeof(char *));
+    w->twinStorage = (char *)malloc(total);
+    if (w->twins == NULL || w->twinStorage == NULL)
+    {
+        return 0;
+    }
+    char *at = w->twinStorage;
+    for (size_t i = 0; i < n; i++)
+    {
+        w->twins[i] = at;
+        memcpy(at, w->words[i], w->lens[i] + 1);
+        at += w->lens[i] + 1;
+    }
+    return 1;
+}
+
+/**
+ * A HELPER FUNCTION
+ * Returns a list holding the words of the workload, in order.
+ */
+static StrList *buildList(const Workload *w, int flags)
+{
+    StrList *list = StrList_allocWith(flags);
+    if (list != NULL)
+    {
+        StrList_appendArray(list, (const char *const *)w->words, w->n);
+    }
+    return list;
+}
+
+/**
+ * A HELPER FUNCTION
+ * Returns a random position in [0, bound].
+ */
+static int randomIndex(OpCtx *ctx, size_t bound)
+{
+    return (int)(nextRandom(&ctx->rng) % (bound + 1));
+}
+
+/**
+ * A HELPER FUNCTION
+ * Returns a random word of the workload.
+ */
+static const char *randomWordOf(OpCtx *ctx)
+{
+    return ctx->w->words[nextRandom(&ctx->rng) % ctx->w->n];
+}
+
+static long runInsertLast(OpCtx *ctx)
+{
+    for (size_t i = 0; i < ctx->w->n; i++)
+    {
+        StrList_insertLast(ctx->list, ctx->w->words[i]);
+    }
+    return (long)ctx->w->n;
+}
+
+static long runAppendArray(OpCtx *ctx)
+{
+    StrList_appendArray(ctx->list, (const char *const *)ctx->w->words, ctx->w->n);
+    return (long)ctx->w->n;
+}
+
+static long runInsertMany(OpCtx *ctx)
+{
+    size_t n = ctx->w->n < INSERT_MANY_BATCH ? ctx->w->n : INSERT_MANY_BATCH;
+    StrList_insertMany(ctx->list, (const char *const *)ctx->w->words, n,
+                       randomIndex(ctx, StrList_size(ctx->list)));
+    return (long)n;
+}
+
+static long runInsertAt(OpCtx *ctx)
+{
+    for (int i = 0; i < POSITIONAL_BATCH; i++)
+    {
+        StrList_insertAt(ctx->list, randomWordOf(ctx), randomIndex(ctx, StrList_size(ctx->list)));
+    }
+    return POSITIONAL_BATCH;
+}
+
+static long runFirstData(OpCtx *ctx)
+{
+    return StrList_firstData(ctx->list) != NULL;
+}
+
+static long runSize(OpCtx *ctx)
+{
+    return StrList_size(ctx->list) > 0;
+}
+
+static long runPrint(OpCtx *ctx)
+{
+    StrList_printToFd(ctx->list, ctx->devNull);
+    return (long)ctx->w->n;
+}
+
+static long runPrintAt(OpCtx *ctx)
+{
+    // printAt writes to stdout, which main points at /dev/null while timing
+    for (int i = 0; i < POSITIONAL_BATCH; i++)
+    {
+        StrList_printAt(ctx->list, randomIndex(ctx, StrList_size(ctx->list) - 1));
+    }
+    return POSITIONAL_BATCH;
+}
+
+static long runPrintAtSequential(OpCtx *ctx)
+{
+    for (size_t i = 0; i < ctx->w->n; i++)
+    {
+        StrList_printAt(ctx->list, (int)i);
+    }
+    return (long)ctx->w->n;
+}
+
+static long runPrintLen(OpCtx *ctx)
+{
+    return StrList_printLen(ctx->list) >= 0;
+}
+
+static long runCount(OpCtx *ctx)
+{
+    StrList_count(ctx->list, randomWordOf(ctx));
+    return (long)ctx->w->n;
+}
+
+static long runRemove(OpCtx *ctx)
+{
+    StrList_remove(ctx->list, randomWordOf(ctx));
+    return (long)ctx->w->n;
+}
+
+static long runRemoveAll(OpCtx *ctx)
+{
+    const char *words[REMOVE_ALL_BATCH];
+    for (int i = 0; i < REMOVE_ALL_BATCH; i++)
+    {
+        words[i] = randomWordOf(ctx);
+    }
+    StrList_removeAll(ctx->list, words, REMOVE_ALL_BATCH);
+    return (long)ctx->w->n;
+}
+
+static long runRemoveEach(OpCtx *ctx)
+{
+    for (int i = 0; i < REMOVE_ALL_BATCH; i++)
+    {
+        StrList_remove(ctx->list, randomWordOf(ctx));
+    }
+    return (long)ctx->w->n;
+}
+
+static int startsWithVowel(const char *line, void *ctx)
+{
+    (void)ctx;
+    return strchr("aeiou", line[0]) != NULL && line[0] != '\0';
+}
+
+static long runRemoveIf(OpCtx *ctx)
+{
+    StrList_removeIf(ctx->list, startsWithVowel, NULL);
+    return (long)ctx->w->n;
+}
+
+// the first half of a random word of the workload, at most PREFIX_MAX - 1 characters
+static const char *randomPrefixOf(OpCtx *ctx, char *prefix)
+{
+    const char *word = randomWordOf(ctx);
+    size_t len = strlen(word) / 2;
+    if (len > PREFIX_MAX - 1)
+    {
+        len = PREFIX_MAX - 1;
+    }
+    memcpy(prefix, word, len);
+    prefix[len] = '\0';
+    return prefix;
+}
+
+static long runCountPrefix(OpCtx *ctx)
+{
+    char prefix[PREFIX_MAX];
+    StrList_countPrefix(ctx->list, randomPrefixOf(ctx, prefix));
+    return (long)ctx->w->n;
+}
+
+static long runRemovePrefix(OpCtx *ctx)
+{
+    char prefix[PREFIX_MAX];
+    StrList_removePrefix(ctx->list, randomPrefixOf(ctx, prefix));
+    return (long)ctx->w->n;
+}
+
+static void ignoreCompletion(const char *word, size_t count, void *ctx)
+{
+    (void)word;
+    (void)count;
+    (void)ctx;
+}
+
+static long runListPrefix(OpCtx *ctx)
+{
+    char prefix[PREFIX_MAX];
+    StrList_listPrefix(ctx->list, randomPrefixOf(ctx, prefix), LIST_PREFIX_COUNT, ignoreCompletion, NULL);
+    return (long)ctx->w->n;
+}
+
+static long runRemoveAt(OpCtx *ctx)
+{
+    int batch = (size_t)POSITIONAL_BATCH < ctx->w->n ? POSITIONAL_BATCH : (int)ctx->w->n;
+    for (int i = 0; i < batch; i++)
+    {
+        StrList_removeAt(ctx->list, randomIndex(ctx, StrList_size(ctx->list) - 1));
+    }
+    return batch;
+}
+
+static long runCursorWalk(OpCtx *ctx)
+{
+    StrListCursor cursor;
+    long chars = 0;
+    for (const char *s = StrList_begin(ctx->list, &cursor); s != NULL; s = StrList_next(&cursor))
+    {
+        chars += s[0];
+    }
+    return chars >= 0 ? (long)ctx->w->n : 0;
+}
+
+static long runInsertHere(OpCtx *ctx)
+{
+    // one new word before each element
+    StrListCursor cursor;
+    for (const char *s = StrList_begin(ctx->list, &cursor); s != NULL; s = StrList_next(&cursor))
+    {
+        StrList_insertHere(&cursor, s);
+    }
+    return (long)ctx->w->n;
+}
+
+static long runRemoveHere(OpCtx *ctx)
+{
+    // every other element
+    StrListCursor cursor;
+    for (const char *s = StrList_begin(ctx->list, &cursor); s != NULL; s = StrList_next(&cursor))
+    {
+        StrList_removeHere(&cursor);
+    }
+    return (long)ctx->w->n;
+}
+
+/**
+ * A HELPER FUNCTION
+ * Reads the list from one thread: CONCURRENT_BATCH calls alternating count and printAt.
+ */
+static void readTask(OpCtx *ctx, uint64_t seed)
+{
+    uint64_t rng = seed;
+    for (int i = 0; i < CONCURRENT_BATCH; i++)
+    {
+        if (i % 2 == 0)
+        {
+            StrList_count(ctx->list, ctx->w->words[nextRandom(&rng) % ctx->w->n]);
+        }
+        else
+        {
+            StrList_printAt(ctx->list, (int)(nextRandom(&rng) % StrList_size(ctx->list)));
+        }
+    }
+}
+
+static void concurrentReadTask(void *arg, int i)
+{
+    readTask((OpCtx *)arg, 0x9E3779B97F4A7C15ULL * (uint64_t)(i + 1));
+}
+
+static void concurrentMixedTask(void *arg, int i)
+{
+    OpCtx *ctx = (OpCtx *)arg;
+    if (i > 0)
+    {
+        readTask(ctx, 0x9E3779B97F4A7C15ULL * (uint64_t)(i + 1));
+        return;
+    }
+    // one writer, keeping the size of the list
+    uint64_t rng = 0x2545F4914F6CDD1DULL;
+    for (int j = 0; j < CONCURRENT_BATCH / 10; j++)
+    {
+        StrList_insertAt(ctx->list, ctx->w->words[nextRandom(&rng) % ctx->w->n],
+                         (int)(nextRandom(&rng) % StrList_size(ctx->list)));
+        StrList_removeAt(ctx->list, (int)(nextRandom(&rng) % StrList_size(ctx->list)));
+    }
+}
+
+static void concurrentAppendTask(void *arg, int i)
+{
+    OpCtx *ctx = (OpCtx *)arg;
+    for (int j = 0; j < CONCURRENT_BATCH; j++)
+    {
+        StrList_insertLast(ctx->list, ctx->w->words[((size_t)i * CONCURRENT_BATCH + j) % ctx->w->n]);
+    }
+}
+
+static long runConcurrentReads(OpCtx *ctx)
+{
+    ThreadPool_parallelFor(ctx->pool, ctx->threads, concurrentReadTask, ctx);
+    return (long)ctx->threads * CONCURRENT_BATCH;
+}
+
+static long runConcurrentMixed(OpCtx *ctx)
+{
+    ThreadPool_parallelFor(ctx->pool, ctx->threads, concurrentMixedTask, ctx);
+    return (long)(ctx->threads - 1) * CONCURRENT_BATCH + CONCURRENT_BATCH / 5;
+}
+
+static long runConcurrentAppends(OpCtx *ctx)
+{
+    ThreadPool_parallelFor(ctx->pool, ctx->threads, concurrentAppendTask, ctx);
+    return (long)ctx->threads * CONCURRENT_BATCH;
+}
+
+/*
+ * The results of the comparisons, kept so that they are not optimized out.
+ */
+static volatile long compareSink;
+
+static long runStrcmp(OpCtx *ctx)
+{
+    long sum = 0;
+    for (size_t i = 1; i < ctx->w->n; i++)
+    {
+        sum += strcmp(ctx->w->words[i - 1], ctx->w->words[i]) > 0;
+    }
+    compareSink += sum;
+    return (long)ctx->w->n - 1;
+}
+
+static long runKernelCompare(OpCtx *ctx)
+{
+    long sum = 0;
+    for (size_t i = 1; i < ctx->w->n; i++)
+    {
+        sum += StrKernels_compare(ctx->w->words[i - 1], ctx->w->lens[i - 1], ctx->w->words[i], ctx->w->lens[i]) > 0;
+    }
+    compareSink += sum;
+    return (long)ctx->w->n - 1;
+}
+
+static long runMemcmp(OpCtx *ctx)
+{
+    long sum = 0;
+    for (size_t i = 0; i < ctx->w->n; i++)
+    {
+        sum += memcmp(ctx->w->words[i], ctx->w->twins[i], ctx->w->lens[i]) == 0;
+    }
+    compareSink += sum;
+    return (long)ctx->w->n;
+}
+
+static long runKernelEqual(OpCtx *ctx)
+{
+    long sum = 0;
+    for (size_t i = 0; i < ctx->w->n; i++)
+    {
+        sum += StrKernels_equal(ctx->w->words[i], ctx->w->twins[i], ctx->w->lens[i]);
+    }
+    compareSink += sum;
+    return (long)ctx->w->n;
+}
+
+static long runIsEqual(OpCtx *ctx)
+{
+    StrList_isEqual(ctx->list, ctx->copy);
+    return (long)ctx->w->n;
+}
+
+static long runClone(OpCtx *ctx)
+{
+    StrList_free(ctx->copy);
+    ctx->copy = StrList_clone(ctx->list);
+    return (long)ctx->w->n;
+}
+
+static long runReverse(OpCtx *ctx)
+{
+    StrList_reverse(ctx->list);
+    return (long)ctx->w->n;
+}
+
+static long runSort(OpCtx *ctx)
+{
+    StrList_sort(ctx->list);
+    return (long)ctx->w->n;
+}
+
+static long runSortParallel(OpCtx *ctx)
+{
+    StrList_sortParallel(ctx->list, ctx->threads);
+    return (long)ctx->w->n;
+}
+
+static long runIsSorted(OpCtx *ctx)
+{
+    StrList_isSorted(ctx->list);
+    return (long)ctx->w->n;
+}
+
+static long runCompact(OpCtx *ctx)
+{
+    StrList_compact(ctx->list);
+    return (long)ctx->w->n;
+}
+
+static long runMemoryUsage(OpCtx *ctx)
+{
+    StrListMemory usage;
+    StrList_memoryUsage(ctx->list, &usage);
+    return (long)ctx->w->n;
+}
+
+static long runCountParallel(OpCtx *ctx)
+{
+    StrList_setParallelScan(1, ctx->threads);
+    StrList_count(ctx->list, randomWordOf(ctx));
+    StrList_setParallelScan(0, 0);
+    return (long)ctx->w->n;
+}
+
+static long runIsEqualParallel(OpCtx *ctx)
+{
+    StrList_setParallelScan(1, ctx->threads);
+    StrList_isEqual(ctx->list, ctx->copy);
+    StrList_setParallelScan(0, 0);
+    return (long)ctx->w->n;
+}
+
+static long runClear(OpCtx *ctx)
+{
+    StrList_clear(ctx->list);
+    return (long)ctx->w->n;
+}
+
+static long runFree(OpCtx *ctx)
+{
+    StrList_free(ctx->list);
+    ctx->list = NULL;
+    return (long)ctx->w->n;
+}
+
+static long runSave(OpCtx *ctx)
+{
+    StrList_save(ctx->list, ctx->snapshot);
+    return (long)ctx->w->n;
+}
+
+// the load operations read the snapshot of the workload written by save, which runs before them
+static long runLoad(OpCtx *ctx)
+{
+    StrList_free(StrList_load(ctx->snapshot, ctx->flags));
+    return (long)ctx->w->n;
+}
+
+// loads the snapshot and changes the list, which creates all its elements
+static long runLoadBuild(OpCtx *ctx)
+{
+    StrList *list = StrList_load(ctx->snapshot, ctx->flags);
+    if (list != NULL)
+    {
+        StrList_insertLast(list, "x");
+        StrList_free(list);
+    }
+    return (long)ctx->w->n;
+}
+
+static const Op OPS[] = {
+    {"insertLast", SETUP_EMPTY, 0, runInsertLast},
+    {"sortedInsert", SETUP_SORTED, 0, runInsertLast},
+    {"appendArray", SETUP_EMPTY, 0, runAppendArray},
+    {"insertMany", SETUP_FRESH, 0, runInsertMany},
+    {"insertAt", SETUP_FRESH, 0, runInsertAt},
+    {"firstData", SETUP_SHARED, 0, runFirstData},
+    {"size", SETUP_SHARED, 0, runSize},
+    {"print", SETUP_SHARED, 0, runPrint},
+    {"printAt", SETUP_SHARED, 0, runPrintAt},
+    {"printAtSequential", SETUP_SHARED, 0, runPrintAtSequential},
+    {"printLen", SETUP_SHARED, 0, runPrintLen},
+    {"count", SETUP_SHARED, 0, runCount},
+    {"countParallel", SETUP_SHARED, 0, runCountParallel},
+    {"remove", SETUP_FRESH, 0, runRemove},
+    {"removeAt", SETUP_FRESH, 0, runRemoveAt},
+    {"removeAll", SETUP_FRESH, 0, runRemoveAll},
+    {"removeEach", SETUP_FRESH, 0, runRemoveEach},
+    {"removeIf", SETUP_FRESH, 0, runRemoveIf},
+    {"countPrefixScan", SETUP_SHARED, 0, runCountPrefix},
+    {"countPrefix", SETUP_PREFIX, 0, runCountPrefix},
+    {"removePrefix", SETUP_FRESH, 0, runRemovePrefix},
+    {"listPrefix", SETUP_PREFIX, 0, runListPrefix},
+    {"cursorWalk", SETUP_SHARED, 0, runCursorWalk},
+    {"insertHere", SETUP_FRESH, 0, runInsertHere},
+    {"removeHere", SETUP_FRESH, 0, runRemoveHere},
+    {"isEqual", SETUP_SHARED, 1, runIsEqual},
+    {"isEqualParallel", SETUP_SHARED, 1, runIsEqualParallel},
+    {"clone", SETUP_SHARED, 0, runClone},
+    {"reverse", SETUP_SHARED, 0, runReverse},
+    {"sort", SETUP_FRESH, 0, runSort},
+    {"sortParallel", SETUP_FRESH, 0, runSortParallel},
+    {"isSorted", SETUP_SHARED, 0, runIsSorted},
+    {"compact", SETUP_FRESH, 0, runCompact},
+    {"memoryUsage", SETUP_SHARED, 0, runMemoryUsage},
+    {"clear", SETUP_FRESH, 0, runClear},
+    {"free", SETUP_FRESH, 0, runFree},
+    {"save", SETUP_SHARED, 0, runSave},
+    {"load", SETUP_SHARED, 0, runLoad},
+    {"loadBuild", SETUP_SHARED, 0, runLoadBuild},
+    {"concurrentReads", SETUP_CONCURRENT, 0, runConcurrentReads},
+    {"concurrentMixed", SETUP_CONCURRENT, 0, runConcurrentMixed},
+    {"concurrentAppends", SETUP_CONCURRENT, 0, runConcurrentAppends},
+    {"strcmp", SETUP_NONE, 0, runStrcmp},
+    {"kernelCompare", SETUP_NONE, 0, runKernelCompare},
+    {"memcmp", SETUP_NONE, 0, runMemcmp},
+    {"kernelEqual", SETUP_NONE, 0, runKernelEqual},
+};
+
+/**
+ * A HELPER FUNCTION
+ * Times op on the workload, repeating it for at least minTime seconds,
+ * and writes its CSV row to report.
+ */
+static void benchOp(const Op *op, OpCtx *ctx, double minTime, FILE *report)
+{
+    long calls = 0;
+    long items = 0;
+    double elapsed = 0;
+    int shared = (op->setup == SETUP_SHARED || op->setup == SETUP_CONCURRENT || op->setup == SETUP_PREFIX ||
+                  op->setup == SETUP_NONE);
+    int flags = ctx->flags;
+    if (op->setup == SETUP_CONCURRENT)
+    {
+        flags |= STRLIST_CONCURRENT;
+    }
+    else if (op->setup == SETUP_SORTED)
+    {
+        flags |= STRLIST_SORTED;
+    }
+    else if (op->setup == SETUP_PREFIX)
+    {
+        flags |= STRLIST_PREFIX_INDEX;
+    }
+    ctx->list = NULL;
+    ctx->copy = NULL;
+    if (shared && op->setup != SETUP_NONE)
+    {
+        ctx->list = buildList(ctx->w, flags);
+    }
+    if (op->needsCopy)
+    {
+        ctx->copy = buildList(ctx->w, ctx->flags);
+    }
+    double wallStart = now();
+    long batch = 1;
+    while (calls == 0 || (elapsed < minTime && calls < MAX_CALLS && now() - wallStart < SETUP_TIME_FACTOR * minTime))
+    {
+        if (shared)
+        {
+            // cheap calls are timed in doubling batches, so the clock is not what gets measured
+            double start = now();
+            for (long i = 0; i < batch; i++)
+            {
+                items += op->run(ctx);
+            }
+            elapsed += now() - start;
+            calls += batch;
+            batch *= 2;
+            continue;
+        }
+        if (op->setup == SETUP_EMPTY || op->setup == SETUP_SORTED)
+        {
+            ctx->list = StrList_allocWith(flags);
+        }
+        else
+        {
+            ctx->list = buildList(ctx->w, ctx->flags);
+        }
+        if (ctx->list == NULL)
+        {
+            fprintf(stderr, "%s: failed to allocate memory\n", op->name);
+            return;
+        }
+        double start = now();
+        items += op->run(ctx);
+        elapsed += now() - start;
+        calls++;
+        StrList_free(ctx->list);
+        ctx->list = NULL;
+    }
+    StrList_free(ctx->list);
+    StrList_free(ctx->copy);
+    double nsPerCall = elapsed * 1e9 / (double)calls;
+    double nsPerItem = items > 0 ? elapsed * 1e9 / (double)items : 0;
+    fprintf(report, "%s,%s,%d,%d,%zu,%ld,%ld,%.6f,%.2f,%.3f\n",
+            op->name, ctx->w->name, flags, ctx->threads, ctx->w->n, calls, items, elapsed, nsPerCall, nsPerItem);
+    fflush(report);
+    fprintf(stderr, "%-12s %-8s %9zu  %14.2f ns/call %10.3f ns/item\n",
+            op->name, ctx->w->name, ctx->w->n, nsPerCall, nsPerItem);
+}
+
+/**
+ * A HELPER FUNCTION
+ * Parses a comma separated list of sizes into sizes (at most MAX_SIZES).
+ * Returns the number of sizes, 0 if the list is invalid.
+ */
+static int parseSizes(const char *text, size_t *sizes)
+{
+    int count = 0;
+    while (*text != '\0' && count < MAX_SIZES)
+    {
+        char *end;
+        unsigned long long value = strtoull(text, &end, 10);
+        if (end == text || value == 0 || value > (unsigned long long)INT32_MAX)
+        {
+            return 0;
+        }
+        sizes[count++] = (size_t)value;
+        text = (*end == ',') ? end + 1 : end;
+        if (*end != ',' && *end != '\0')
+        {
+            return 0;
+        }
+    }
+    return count;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *sizeList = DEFAULT_SIZES;
+    const char *workloadList = "random,zipf,prefix,deep,long,sorted,reversed";
+    const char *reportPath = NULL;
+    double minTime = DEFAULT_MIN_TIME;
+    OpCtx ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.flags = STRLIST_ARENA | STRLIST_HASH_INDEX; // the mode Main.c uses, less its prefix index (see SETUP_PREFIX)
+    ctx.threads = ThreadPool_cpuCount();
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "-s") == 0)
+        {
+            sizeList = argv[i + 1];
+        }
+        else if (strcmp(argv[i], "-w") == 0)
+        {
+            workloadList = argv[i + 1];
+        }
+        else if (strcmp(argv[i], "-f") == 0)
+        {
+            ctx.flags = atoi(argv[i + 1]);
+        }
+        else if (strcmp(argv[i], "-t") == 0)
+        {
+            ctx.threads = atoi(argv[i + 1]);
+        }
+        else if (strcmp(argv[i], "-k") == 0)
+        {
+            if (StrKernels_use(argv[i + 1]) != 0)
+            {
+                fprintf(stderr, "kernels %s are not available\n", argv[i + 1]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "-m") == 0)
+        {
+            minTime = atof(argv[i + 1]);
+        }
+        else if (strcmp(argv[i], "-o") == 0)
+        {
+            reportPath = argv[i + 1];
+        }
+        else
+        {
+            break;
+        }
+    }
+    if (argc % 2 == 0)
+    {
+        fprintf(stderr, "usage: %s [-s sizes] [-w workloads] [-f flags] [-t threads] [-k kernels] [-m seconds] [-o report.csv]\n",
+                argv[0]);
+        return 1;
+    }
+
+    size_t sizes[MAX_SIZES];
+    int nsizes = parseSizes(sizeList, sizes);
+    if (nsizes == 0)
+    {
+        fprintf(stderr, "invalid sizes: %s\n", sizeList);
+        return 1;
+    }
+    if (ctx.threads <= 0)
+    {
+        ctx.threads = ThreadPool_cpuCount();
+    }
+    StrList_setParallelScan(0, 0); // the parallel scans are timed by their own operations
+    ctx.pool = ThreadPool_alloc(ctx.threads);
+    if (ctx.pool == NULL)
+    {
+        fprintf(stderr, "cannot start %d threads\n", ctx.threads);
+        return 1;
+    }
+    FILE *report = (reportPath != NULL) ? fopen(reportPath, "w") : stdout;
+    ctx.devNull = open("/dev/null", O_WRONLY);
+    if (report == NULL || ctx.devNull < 0)
+    {
+        fprintf(stderr, "cannot open the report or /dev/null\n");
+        return 1;
+    }
+    if (report == stdout)
+    {
+        // the rows go to the original stdout, printAt writes to /dev/null
+        report = fdopen(dup(STDOUT_FILENO), "w");
+    }
+    dup2(ctx.devNull, STDOUT_FILENO);
+    const char *tmpDir = getenv("TMPDIR");
+    snprintf(ctx.snapshot, sizeof(ctx.snapshot), "%s/StrListBench.%d.snap",
+             tmpDir != NULL && strlen(tmpDir) < 32 ? tmpDir : "/tmp", (int)getpid());
+    fprintf(stderr, "kernels: %s\n", StrKernels_name());
+    fprintf(report, "operation,workload,flags,threads,size,calls,items,seconds,ns_per_call,ns_per_item\n");
+
+    char *names = strdup(workloadList);
+    for (int s = 0; s < nsizes; s++)
+    {
+        for (char *name = strtok(names, ","); name != NULL; name = strtok(NULL, ","))
+        {
+            Workload w;
+            if (!Workload_make(&w, name, sizes[s], 0x9E3779B97F4A7C15ULL ^ sizes[s]))
+            {
+                fprintf(stderr, "cannot make workload %s of %zu words\n", name, sizes[s]);
+                Workload_free(&w);
+                continue;
+            }
+            ctx.w = &w;
+            ctx.rng = 0x2545F4914F6CDD1DULL ^ sizes[s];
+            for (size_t i = 0; i < sizeof(OPS) / sizeof(OPS[0]); i++)
+            {
+                benchOp(&OPS[i], &ctx, minTime, report);
+            }
+            Workload_free(&w);
+        }
+        strcpy(names, workloadList); // strtok cut it
+    }
+    free(names);
+    unlink(ctx.snapshot);
+    fclose(report);
+    close(ctx.devNull);
+    ThreadPool_free(ctx.pool);
+    return 0;
+}
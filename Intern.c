@@ -0,0 +1,167 @@
+#include "Intern.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INTERN_INITIAL_SLOTS 1024   // slots of the table when the first string is interned (a power of 2)
+
+/**
+ * An interned string: its chars follow the header, refs counts its holders.
+ */
+typedef struct Entry {
+    size_t refs;
+    uint32_t len;
+    uint32_t hash;
+    char chars[];
+} Entry;
+
+/**
+ * The pool: an open addressing table of entries with linear probing,
+ * kept at most 3/4 full and emptied with backward shift deletion.
+ */
+static Entry** slots;
+static size_t cap;
+static size_t used;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** A HELPER FUNCTION
+ * Returns the entry holding an interned string.
+ */
+static Entry* entryOf(const char* interned) {
+    return (Entry*)(interned - offsetof(Entry, chars));
+}
+
+/** A HELPER FUNCTION
+ * Returns the slot holding line, or the empty slot where it would go.
+ * The table must exist.
+ */
+static size_t findSlot(const char* line, size_t len, uint32_t hash) {
+    size_t mask = cap - 1;
+    size_t i = hash & mask;
+    while (slots[i] != NULL) {
+        Entry* entry = slots[i];
+        if (entry->hash == hash && entry->len == len && memcmp(entry->chars, line, len) == 0) {
+            return i;
+        }
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+/** A HELPER FUNCTION
+ * Makes room for one more entry, allocating or doubling the table.
+ * @return 1 on success, 0 if the allocation failed.
+ */
+static int reserve() {
+    if (slots != NULL && (used + 1) * 4 <= cap * 3) {
+        return 1;
+    }
+    size_t newCap = (slots == NULL) ? INTERN_INITIAL_SLOTS : cap * 2;
+    Entry** newSlots = (Entry**)calloc(newCap, sizeof(Entry*));
+    if (newSlots == NULL) {
+        return 0;
+    }
+    for (size_t i = 0; i < cap; i++) {
+        if (slots[i] != NULL) {
+            size_t j = slots[i]->hash & (newCap - 1);
+            while (newSlots[j] != NULL) {
+                j = (j + 1) & (newCap - 1);
+            }
+            newSlots[j] = slots[i];
+        }
+    }
+    free(slots);
+    slots = newSlots;
+    cap = newCap;
+    return 1;
+}
+
+/** A HELPER FUNCTION
+ * Empties a used slot, shifting back the entries after it in its probe sequence.
+ */
+static void eraseSlot(size_t hole) {
+    size_t mask = cap - 1;
+    size_t i = hole;
+    while (1) {
+        i = (i + 1) & mask;
+        if (slots[i] == NULL) {
+            break;
+        }
+        // slots[i] may move to the hole only if its home slot is not in (hole, i]
+        size_t home = slots[i]->hash & mask;
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            slots[hole] = slots[i];
+            hole = i;
+        }
+    }
+    slots[hole] = NULL;
+    used--;
+}
+
+const char* Intern_acquire(const char* line, size_t len, uint32_t hash) {
+    pthread_mutex_lock(&lock);
+    if (!reserve()) {
+        pthread_mutex_unlock(&lock);
+        return NULL;
+    }
+    size_t i = findSlot(line, len, hash);
+    Entry* entry = slots[i];
+    if (entry == NULL) {
+        entry = (Entry*)malloc(sizeof(Entry) + len + 1);
+        if (entry == NULL) {
+            pthread_mutex_unlock(&lock);
+            return NULL;
+        }
+        entry->refs = 0;
+        entry->len = (uint32_t)len;
+        entry->hash = hash;
+        memcpy(entry->chars, line, len);
+        entry->chars[len] = '\0';
+        slots[i] = entry;
+        used++;
+    }
+    entry->refs++;
+    pthread_mutex_unlock(&lock);
+    return entry->chars;
+}
+
+void Intern_retain(const char* interned) {
+    pthread_mutex_lock(&lock);
+    entryOf(interned)->refs++;
+    pthread_mutex_unlock(&lock);
+}
+
+void Intern_release(const char* interned) {
+    Entry* entry = entryOf(interned);
+    pthread_mutex_lock(&lock);
+    if (--entry->refs == 0) {
+        size_t mask = cap - 1;
+        size_t i = entry->hash & mask;
+        while (slots[i] != entry) {
+            i = (i + 1) & mask;
+        }
+        eraseSlot(i);
+        free(entry);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+const char* Intern_find(const char* line, size_t len, uint32_t hash) {
+    pthread_mutex_lock(&lock);
+    const char* found = NULL;
+    if (slots != NULL) {
+        Entry* entry = slots[findSlot(line, len, hash)];
+        if (entry != NULL) {
+            found = entry->chars;
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    return found;
+}
+
+size_t Intern_size() {
+    pthread_mutex_lock(&lock);
+    size_t size = used;
+    pthread_mutex_unlock(&lock);
+    return size;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/********************************************************************************
+ *
+ * A process wide string interning pool.
+ *
+ * Every distinct string acquired from the pool is stored once, in a reference
+ * counted entry, and the pool hands out the same pointer for equal strings: two
+ * interned strings are equal exactly when their pointers are. An entry is freed
+ * when its last reference is released.
+ *
+ * The pool is protected by a mutex, so it may be used from several threads.
+ * The caller supplies the hash of each string (any function, as long as it is
+ * always the same one).
+ *
+ ********************************************************************************/
+
+/*
+ * Returns the interned copy of the len chars of line (followed by a '\0'),
+ * adding a reference to it, or NULL if the allocation failed.
+ */
+const char* Intern_acquire(const char* line, size_t len, uint32_t hash);
+
+/*
+ * Adds one more reference to an interned string.
+ */
+void Intern_retain(const char* interned);
+
+/*
+ * Drops a reference to an interned string, freeing it with the last one.
+ */
+void Intern_release(const char* interned);
+
+/*
+ * Returns the interned copy of the len chars of line without adding a reference,
+ * or NULL if no one holds such a string.
+ */
+const char* Intern_find(const char* line, size_t len, uint32_t hash);
+
+/*
+ * Returns the number of distinct strings in the pool.
+ */
+size_t Intern_size();
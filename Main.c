@@ -1,100 +1,335 @@
+#define _POSIX_C_SOURCE 200809L
 #include "StrList.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
-#define MAX_WORD_LEN 512
-#define INIT_CAPACITY 10
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define READ_BLOCK (1 << 20)
+#define WORD_BATCH 4096
+#define OUTPUT_BUFFER (1 << 16)
 
 /**
- * A HELPER FUNCTION TO READ A WORD FROM THE STANDARD INPUT
- * This function reads a word from the standard input (stdin)
- * and returns it as a dynamically allocated string.
- * If the input starts with a space or a newline, these characters are ignored.
- * The function dynamically resizes the string as needed to accommodate the word.
- * If the word is empty (consists only of spaces or newlines), the function returns an empty string.
- * If memory allocation fails at any point, the function frees any allocated memory and returns NULL.
+ * A buffered tokenizer over a file descriptor.
+ * Input is read in READ_BLOCK sized blocks into buf (or the whole file is mmapped
+ * when it's a regular file), and tokens are split in place by writing a '\0' over
+ * the whitespace that ends them, so no token is copied or allocated.
+ * A token stays valid until the buffer is refilled; beforeRefill, when set, is
+ * called with ctx right before that happens.
  */
-char *inWord()
+typedef struct Reader
 {
-    int maxCap = INIT_CAPACITY;
-    char *word = (char *)malloc(maxCap * sizeof(char));
-    if (word == NULL) {
-        printf("Failed to allocate memory for the word\n");
-        return NULL;
+    int fd;
+    char *buf;
+    size_t cap;
+    size_t len;  // bytes of input in buf
+    size_t pos;  // next byte to look at
+    int eof;     // nothing left to read past len
+    void *map;   // the mapping of an mmapped input, NULL otherwise
+    size_t mapLen;
+    char *last;  // copy of a last token with no room for its '\0' in the mapping
+    void (*beforeRefill)(void *ctx);
+    void *ctx;
+} Reader;
+
+/**
+ * A HELPER FUNCTION
+ * Tells whether c separates tokens.
+ */
+static int isSeparator(char c)
+{
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+/**
+ * Prepares a Reader over fd.
+ * A regular file is mmapped privately (copy on write, so the '\0' written in place never reach it)
+ * from the current offset of fd; anything else is read in blocks.
+ * Returns 1 on success, 0 if the buffer could not be allocated.
+ */
+static int Reader_open(Reader *reader, int fd)
+{
+    memset(reader, 0, sizeof(Reader));
+    reader->fd = fd;
+    struct stat st;
+    off_t offset = lseek(fd, 0, SEEK_CUR);
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && offset >= 0 && st.st_size > offset)
+    {
+        long page = sysconf(_SC_PAGESIZE);
+        off_t base = offset - offset % page;
+        size_t mapLen = (size_t)(st.st_size - base);
+        void *map = mmap(NULL, mapLen, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, base);
+        if (map != MAP_FAILED)
+        {
+            reader->map = map;
+            reader->mapLen = mapLen;
+            reader->buf = (char *)map;
+            reader->len = mapLen;
+            reader->pos = (size_t)(offset - base);
+            reader->eof = 1;
+            return 1;
+        }
     }
+    reader->cap = READ_BLOCK;
+    reader->buf = (char *)malloc(reader->cap);
+    return reader->buf != NULL;
+}
+
+/**
+ * Releases the buffer or the mapping of a Reader.
+ */
+static void Reader_close(Reader *reader)
+{
+    if (reader->map != NULL)
+    {
+        munmap(reader->map, reader->mapLen);
+    }
+    else
+    {
+        free(reader->buf);
+    }
+    free(reader->last);
+}
 
-    int indx = 0;
-    char c = 0;
-    while (1){
-        c = getchar();
-        if (c == ' ' || c == '\n')
+/**
+ * A HELPER FUNCTION
+ * Drops the input before keepFrom and reads the next block after the rest.
+ * The buffer doubles when the kept part fills it (a token longer than a block).
+ * One byte is always left free after the input, for the '\0' of a last token.
+ */
+static void Reader_refill(Reader *reader, size_t keepFrom)
+{
+    if (reader->beforeRefill != NULL)
+    {
+        reader->beforeRefill(reader->ctx);
+    }
+    memmove(reader->buf, reader->buf + keepFrom, reader->len - keepFrom);
+    reader->len -= keepFrom;
+    reader->pos -= keepFrom;
+    if (reader->len + 1 >= reader->cap)
+    {
+        char *bigger = (char *)realloc(reader->buf, reader->cap * 2);
+        if (bigger == NULL)
+        {
+            reader->eof = 1;
+            return;
+        }
+        reader->buf = bigger;
+        reader->cap *= 2;
+    }
+    ssize_t n = read(reader->fd, reader->buf + reader->len, reader->cap - 1 - reader->len);
+    if (n <= 0)
+    {
+        reader->eof = 1;
+        return;
+    }
+    reader->len += (size_t)n;
+}
+
+/**
+ * Returns the next whitespace separated token of the input as a null-terminated string,
+ * or NULL at the end of the input.
+ */
+static char *Reader_next(Reader *reader)
+{
+    while (1)
+    {
+        while (reader->pos < reader->len && isSeparator(reader->buf[reader->pos]))
+        {
+            reader->pos++;
+        }
+        if (reader->pos < reader->len)
         {
-            if (indx == 0){
-                continue;
-            }
-            word[indx] = '\0';
             break;
         }
-        word[indx] = c;
-        indx++;
-        if (indx >= maxCap)
+        if (reader->eof)
         {
-            maxCap *= 2;
-            // we use temp because otherwise in a case of allocation failur,
-            // word will be lost. so that way we can safely check 
-            // if the allocation was successful
-            char* temp = (char *)realloc(word, maxCap * sizeof(char));
-            if (temp == NULL) {
-                printf("Failed to allocate memory for the word\n");
-                free(word);
-                return NULL;
-            }
-            word = temp;
+            return NULL;
         }
+        Reader_refill(reader, reader->pos);
     }
-    // in case the word is empty
-    // we sets the first character to '\0'
-    // because we want to return an empty null-terminated string
-    if (indx == 0) {
-        word[indx] = '\0';
+    size_t start = reader->pos;
+    while (1)
+    {
+        while (reader->pos < reader->len && !isSeparator(reader->buf[reader->pos]))
+        {
+            reader->pos++;
+        }
+        if (reader->pos < reader->len || reader->eof)
+        {
+            break;
+        }
+        Reader_refill(reader, start);
+        start = 0;
+    }
+    if (reader->pos < reader->len)
+    {
+        reader->buf[reader->pos++] = '\0';
+        return reader->buf + start;
     }
-    return word;
+    // the token ends the input
+    if (reader->map == NULL)
+    {
+        reader->buf[reader->len] = '\0';
+        return reader->buf + start;
+    }
+    free(reader->last);
+    reader->last = (char *)malloc(reader->len - start + 1);
+    if (reader->last == NULL)
+    {
+        return NULL;
+    }
+    memcpy(reader->last, reader->buf + start, reader->len - start);
+    reader->last[reader->len - start] = '\0';
+    return reader->last;
+}
+
+/**
+ * A HELPER FUNCTION
+ * Parses a token as an int.
+ * Returns 1 on success, 0 if the token is not a number.
+ */
+static int parseInt(const char *token, int *value)
+{
+    char *end;
+    long n = strtol(token, &end, 10);
+    if (*end != '\0' || end == token)
+    {
+        return 0;
+    }
+    *value = (int)n;
+    return 1;
+}
+
+/**
+ * Reads the next token as an int.
+ * Returns 1 on success, 0 at the end of the input or if the token is not a number.
+ */
+static int Reader_nextInt(Reader *reader, int *value)
+{
+    char *token = Reader_next(reader);
+    return token != NULL && parseInt(token, value);
+}
+
+/**
+ * Words of command 1 waiting to be appended to the list, or of command 18 waiting
+ * to be removed from it.
+ * They point into the Reader's buffer, so they are flushed before it is refilled.
+ */
+typedef struct WordBatch
+{
+    StrList *list;
+    size_t count;
+    const char *words[WORD_BATCH];
+} WordBatch;
+
+/**
+ * A HELPER FUNCTION
+ * Appends the pending words of a WordBatch to its list.
+ */
+static void flushBatch(void *ctx)
+{
+    WordBatch *batch = (WordBatch *)ctx;
+    StrList_appendArray(batch->list, batch->words, batch->count);
+    batch->count = 0;
+}
+
+/**
+ * A HELPER FUNCTION
+ * Removes the pending words of a WordBatch from its list.
+ */
+static void flushRemoval(void *ctx)
+{
+    WordBatch *batch = (WordBatch *)ctx;
+    StrList_removeAll(batch->list, batch->words, batch->count);
+    batch->count = 0;
+}
+
+/**
+ * A HELPER FUNCTION
+ * Reads num_words words and hands them to flush in batches of up to WORD_BATCH words.
+ */
+static void readBatches(Reader *in, WordBatch *batch, StrList *list, int num_words, void (*flush)(void *ctx))
+{
+    batch->list = list;
+    batch->count = 0;
+    in->beforeRefill = flush;
+    in->ctx = batch;
+    for (int i = 0; i < num_words; i++)
+    {
+        char *word = Reader_next(in);
+        if (word == NULL)
+        {
+            break;
+        }
+        batch->words[batch->count++] = word;
+        if (batch->count == WORD_BATCH)
+        {
+            flush(batch);
+        }
+    }
+    flush(batch);
+    in->beforeRefill = NULL;
+}
+
+/**
+ * A HELPER FUNCTION
+ * Prints a completion of command 23, after a space unless it's the first one.
+ */
+static void printCompletion(const char *word, size_t count, void *ctx)
+{
+    (void)count;
+    int *printed = (int *)ctx;
+    printf("%s%s", (*printed)++ ? " " : "", word);
 }
 
 int main()
 {
+    // replies go out in large blocks unless someone is reading them live
+    if (!isatty(STDOUT_FILENO))
+    {
+        setvbuf(stdout, NULL, _IOFBF, OUTPUT_BUFFER);
+    }
 
-    StrList *myList = StrList_alloc();
+    StrList *myList = StrList_allocWith(STRLIST_ARENA | STRLIST_HASH_INDEX | STRLIST_PREFIX_INDEX);
     int choice; // Initialize choice
     int index;
     int num_words;
-    char word[MAX_WORD_LEN];
-    char *data;
+    int num_threads;
+    char *word;
+    static WordBatch batch;
+    Reader in;
+    if (myList == NULL || !Reader_open(&in, STDIN_FILENO))
+    {
+        printf("Failed to allocate memory\n");
+        return 1;
+    }
 
     while (1)
     {
-        scanf("%d", &choice); // Read the choice character
+        word = Reader_next(&in); // Read the choice
+        if (word == NULL)
+        {
+            choice = 0; // end of the input
+        }
+        else if (!parseInt(word, &choice))
+        {
+            printf("Invalid choice\n");
+            continue;
+        }
 
         switch (choice)
         {
         case 1:
         {
-            if (scanf("%d", &num_words) != 1)
+            if (!Reader_nextInt(&in, &num_words))
             {
                 printf("Invalid choice\n");
                 break;
             }
-            for (int i = 0; i < num_words; i++)
-            {
-                data = inWord();
-                if (data == NULL)
-                {
-                    printf("Invalid choice\n");
-                    break;
-                }
-                StrList_insertLast(myList, data);
-                free(data);
-            }
+            // the words are appended in batches, straight from the input buffer
+            readBatches(&in, &batch, myList, num_words, flushBatch);
             break;
         }
         // case 1: {
@@ -109,8 +344,10 @@ int main()
         // }
         case 2:
         {
-            scanf("%d %s", &index, word);
-            StrList_insertAt(myList, word, index);
+            if (Reader_nextInt(&in, &index) && (word = Reader_next(&in)) != NULL)
+            {
+                StrList_insertAt(myList, word, index);
+            }
             break;
         }
         case 3:
@@ -125,8 +362,10 @@ int main()
         }
         case 5:
         {
-            scanf("%d", &index);
-            StrList_printAt(myList, index);
+            if (Reader_nextInt(&in, &index))
+            {
+                StrList_printAt(myList, index);
+            }
             break;
         }
         case 6:
@@ -136,20 +375,26 @@ int main()
         }
         case 7:
         {
-            scanf("%s", word);
-            printf("%d\n", StrList_count(myList, word));
+            if ((word = Reader_next(&in)) != NULL)
+            {
+                printf("%d\n", StrList_count(myList, word));
+            }
             break;
         }
         case 8:
         {
-            scanf("%s", word);
-            StrList_remove(myList, word);
+            if ((word = Reader_next(&in)) != NULL)
+            {
+                StrList_remove(myList, word);
+            }
             break;
         }
         case 9:
         {
-            scanf("%d", &index);
-            StrList_removeAt(myList, index);
+            if (Reader_nextInt(&in, &index))
+            {
+                StrList_removeAt(myList, index);
+            }
             break;
         }
         case 10:
@@ -159,8 +404,7 @@ int main()
         }
         case 11:
         {
-            StrList_free(myList);
-            myList = StrList_alloc();
+            StrList_clear(myList);
             break;
         }
         case 12:
@@ -180,9 +424,102 @@ int main()
             }
             break;
         }
+        case 14:
+        {
+            if (Reader_nextInt(&in, &num_threads))
+            {
+                StrList_sortParallel(myList, num_threads);
+            }
+            break;
+        }
+        case 15:
+        {
+            StrList_printStats(stdout);
+            break;
+        }
+        case 16:
+        {
+            if ((word = Reader_next(&in)) != NULL && StrList_save(myList, word) != 0)
+            {
+                printf("Failed to save\n");
+            }
+            break;
+        }
+        case 17:
+        {
+            if ((word = Reader_next(&in)) == NULL)
+            {
+                break;
+            }
+            StrList *loaded = StrList_load(word, STRLIST_ARENA | STRLIST_HASH_INDEX | STRLIST_PREFIX_INDEX);
+            if (loaded == NULL)
+            {
+                printf("Failed to load\n");
+                break;
+            }
+            StrList_free(myList);
+            myList = loaded;
+            break;
+        }
+        case 18:
+        {
+            if (!Reader_nextInt(&in, &num_words))
+            {
+                printf("Invalid choice\n");
+                break;
+            }
+            // removing the words a batch at a time removes them all
+            readBatches(&in, &batch, myList, num_words, flushRemoval);
+            break;
+        }
+        case 19:
+        {
+            if (StrList_compact(myList) != 0)
+            {
+                printf("Failed to compact\n");
+            }
+            break;
+        }
+        case 20:
+        {
+            StrListMemory usage;
+            StrList_memoryUsage(myList, &usage);
+            printf("elements %zu chars %zu used %zu wasted %zu overhead %.1f\n",
+                   usage.elements, usage.chars, usage.usedBytes, usage.wastedBytes, usage.overheadPerElement);
+            break;
+        }
+        case 21:
+        {
+            if ((word = Reader_next(&in)) != NULL)
+            {
+                printf("%d\n", StrList_countPrefix(myList, word));
+            }
+            break;
+        }
+        case 22:
+        {
+            if ((word = Reader_next(&in)) != NULL)
+            {
+                StrList_removePrefix(myList, word);
+            }
+            break;
+        }
+        case 23:
+        {
+            if (!Reader_nextInt(&in, &index) || (word = Reader_next(&in)) == NULL)
+            {
+                printf("Invalid choice\n");
+                break;
+            }
+            int printed = 0;
+            StrList_listPrefix(myList, word, index > 0 ? (size_t)index : 0, printCompletion, &printed);
+            printf("\n");
+            break;
+        }
         case 0:
         {
             StrList_free(myList);
+            Reader_close(&in);
             exit(0);
         }
 
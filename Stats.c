@@ -0,0 +1,303 @@
+#define _POSIX_C_SOURCE 200809L
+#include "Stats.h"
+#include "StrList.h"
+#include <string.h>
+#include <time.h>
+
+static const char* const OP_NAMES[STATS_OPS] = {
+    "alloc", "free", "clear", "size", "insertLast", "appendArray", "insertMany",
+    "insertAt", "firstData", "print", "printAt", "printLen", "count", "remove",
+    "removeAt", "removeAll", "removeIf", "countPrefix", "removePrefix", "listPrefix",
+    "isEqual", "clone", "reverse", "sort", "sortParallel", "isSorted", "begin", "seek",
+    "insertHere", "removeHere", "save", "load", "compact", "memoryUsage",
+};
+
+_Static_assert(STATS_OPS <= STRLIST_STATS_MAX_OPS, "STRLIST_STATS_MAX_OPS is too small");
+
+#ifdef STRLIST_STATS
+#include <stdatomic.h>
+#include <pthread.h>
+
+/**
+ * The counters of one thread.
+ * Only their thread writes them (a relaxed load and store, no locked instruction),
+ * StrList_stats reads them all under statsLock. A block belongs to the reset
+ * generation gen: once StrList_resetStats moves past it, readers ignore it and
+ * its thread zeroes it before counting again.
+ * When a thread exits its counts move to retired and its block is freed.
+ */
+typedef struct ThreadStats {
+    _Atomic uint64_t calls[STATS_OPS];
+    _Atomic uint64_t totalNs[STATS_OPS];
+    _Atomic uint64_t maxNs[STATS_OPS];
+    _Atomic uint64_t histogram[STATS_OPS][STRLIST_STATS_BUCKETS];
+    _Atomic uint64_t nodes;
+    _Atomic uint64_t bytes;
+    _Atomic uint64_t compares;
+    _Atomic unsigned long gen;
+    struct ThreadStats* next;
+    struct ThreadStats* prev;
+} ThreadStats;
+
+static pthread_mutex_t statsLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t statsOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t statsKey;
+static ThreadStats* live;         // the blocks of the running threads
+static ThreadStats retired;       // the counts of the threads that exited
+static _Atomic unsigned long resetGen;
+
+_Thread_local uint64_t Stats_nodes;
+_Thread_local uint64_t Stats_bytes;
+_Thread_local uint64_t Stats_compares;
+static _Thread_local ThreadStats* mine;
+static _Thread_local int depth; // operations running on this thread
+
+/** A HELPER FUNCTION
+ * Adds value to a counter only the calling thread writes.
+ */
+static void bump(_Atomic uint64_t* counter, uint64_t value) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value,
+            memory_order_relaxed);
+}
+
+/** A HELPER FUNCTION
+ * Adds the counts of a block to another one (both under statsLock).
+ */
+static void addBlock(ThreadStats* to, ThreadStats* from) {
+    for (int i = 0; i < STATS_OPS; i++) {
+        bump(&to->calls[i], atomic_load_explicit(&from->calls[i], memory_order_relaxed));
+        bump(&to->totalNs[i], atomic_load_explicit(&from->totalNs[i], memory_order_relaxed));
+        uint64_t max = atomic_load_explicit(&from->maxNs[i], memory_order_relaxed);
+        if (max > atomic_load_explicit(&to->maxNs[i], memory_order_relaxed)) {
+            atomic_store_explicit(&to->maxNs[i], max, memory_order_relaxed);
+        }
+        for (int j = 0; j < STRLIST_STATS_BUCKETS; j++) {
+            bump(&to->histogram[i][j], atomic_load_explicit(&from->histogram[i][j], memory_order_relaxed));
+        }
+    }
+    bump(&to->nodes, atomic_load_explicit(&from->nodes, memory_order_relaxed));
+    bump(&to->bytes, atomic_load_explicit(&from->bytes, memory_order_relaxed));
+    bump(&to->compares, atomic_load_explicit(&from->compares, memory_order_relaxed));
+}
+
+/** A HELPER FUNCTION
+ * Zeroes the counts of a block and moves it to the current reset generation.
+ */
+static void clearBlock(ThreadStats* block) {
+    ThreadStats* next = block->next;
+    ThreadStats* prev = block->prev;
+    memset(block, 0, sizeof(ThreadStats));
+    block->next = next;
+    block->prev = prev;
+    atomic_store_explicit(&block->gen, atomic_load_explicit(&resetGen, memory_order_relaxed),
+            memory_order_relaxed);
+}
+
+/** A HELPER FUNCTION
+ * Destructor of statsKey: retires the block of an exiting thread.
+ */
+static void retireBlock(void* arg) {
+    ThreadStats* block = (ThreadStats*)arg;
+    pthread_mutex_lock(&statsLock);
+    if (atomic_load_explicit(&block->gen, memory_order_relaxed) == atomic_load_explicit(&resetGen, memory_order_relaxed)) {
+        addBlock(&retired, block);
+    }
+    if (block->prev != NULL) {
+        block->prev->next = block->next;
+    } else {
+        live = block->next;
+    }
+    if (block->next != NULL) {
+        block->next->prev = block->prev;
+    }
+    pthread_mutex_unlock(&statsLock);
+    free(block);
+}
+
+/** A HELPER FUNCTION
+ * Creates statsKey, once per process.
+ */
+static void createKey() {
+    pthread_key_create(&statsKey, retireBlock);
+}
+
+/** A HELPER FUNCTION
+ * Returns the block of the calling thread, registering a new one on its first call.
+ * Returns NULL if it could not be allocated (the counts are then dropped).
+ */
+static ThreadStats* myBlock() {
+    if (mine == NULL) {
+        pthread_once(&statsOnce, createKey);
+        ThreadStats* block = (ThreadStats*)calloc(1, sizeof(ThreadStats));
+        if (block == NULL) {
+            return NULL;
+        }
+        pthread_mutex_lock(&statsLock);
+        clearBlock(block);
+        block->next = live;
+        if (live != NULL) {
+            live->prev = block;
+        }
+        live = block;
+        pthread_mutex_unlock(&statsLock);
+        pthread_setspecific(statsKey, block);
+        mine = block;
+    }
+    if (atomic_load_explicit(&mine->gen, memory_order_relaxed) != atomic_load_explicit(&resetGen, memory_order_relaxed)) {
+        pthread_mutex_lock(&statsLock);
+        clearBlock(mine);
+        pthread_mutex_unlock(&statsLock);
+    }
+    return mine;
+}
+
+/** A HELPER FUNCTION
+ * Returns a monotonic time in ns.
+ */
+static uint64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/** A HELPER FUNCTION
+ * Returns the histogram bucket of a duration: floor(log2(ns)), capped to the last bucket.
+ */
+static int bucketOf(uint64_t ns) {
+    int bucket = 63 - __builtin_clzll(ns | 1);
+    return bucket < STRLIST_STATS_BUCKETS ? bucket : STRLIST_STATS_BUCKETS - 1;
+}
+
+StatsTimer Stats_start(int op) {
+    StatsTimer timer;
+    timer.op = op;
+    timer.outer = (depth++ == 0);
+    timer.start = timer.outer ? nowNs() : 0;
+    return timer;
+}
+
+void Stats_stop(StatsTimer* timer) {
+    depth--;
+    if (!timer->outer) {
+        return;
+    }
+    uint64_t ns = nowNs() - timer->start;
+    ThreadStats* block = myBlock();
+    if (block != NULL) {
+        bump(&block->calls[timer->op], 1);
+        bump(&block->totalNs[timer->op], ns);
+        bump(&block->histogram[timer->op][bucketOf(ns)], 1);
+        if (ns > atomic_load_explicit(&block->maxNs[timer->op], memory_order_relaxed)) {
+            atomic_store_explicit(&block->maxNs[timer->op], ns, memory_order_relaxed);
+        }
+    }
+    Stats_flush();
+}
+
+void Stats_flush(void) {
+    ThreadStats* block = myBlock();
+    if (block != NULL) {
+        bump(&block->nodes, Stats_nodes);
+        bump(&block->bytes, Stats_bytes);
+        bump(&block->compares, Stats_compares);
+    }
+    Stats_nodes = 0;
+    Stats_bytes = 0;
+    Stats_compares = 0;
+}
+
+/** A HELPER FUNCTION
+ * Returns the upper bound of the bucket holding the p-th fraction of the calls of an operation.
+ */
+static uint64_t percentile(const StrListOpStats* op, double p) {
+    uint64_t rank = (uint64_t)(p * (double)op->calls);
+    uint64_t seen = 0;
+    for (int i = 0; i < STRLIST_STATS_BUCKETS; i++) {
+        seen += op->histogram[i];
+        if (seen > rank) {
+            uint64_t bound = (uint64_t)2 << i;
+            return bound < op->maxNs ? bound : op->maxNs;
+        }
+    }
+    return op->maxNs;
+}
+#endif
+
+void StrList_stats(StrListStats* stats) {
+    memset(stats, 0, sizeof(StrListStats));
+    stats->nops = STATS_OPS;
+    for (int i = 0; i < STATS_OPS; i++) {
+        stats->ops[i].name = OP_NAMES[i];
+    }
+#ifdef STRLIST_STATS
+    stats->enabled = 1;
+    ThreadStats* sum = (ThreadStats*)calloc(1, sizeof(ThreadStats));
+    if (sum == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&statsLock);
+    unsigned long gen = atomic_load_explicit(&resetGen, memory_order_relaxed);
+    addBlock(sum, &retired);
+    for (ThreadStats* block = live; block != NULL; block = block->next) {
+        if (atomic_load_explicit(&block->gen, memory_order_relaxed) == gen) {
+            addBlock(sum, block);
+        }
+    }
+    pthread_mutex_unlock(&statsLock);
+    for (int i = 0; i < STATS_OPS; i++) {
+        StrListOpStats* op = &stats->ops[i];
+        op->calls = sum->calls[i];
+        op->totalNs = sum->totalNs[i];
+        op->maxNs = sum->maxNs[i];
+        for (int j = 0; j < STRLIST_STATS_BUCKETS; j++) {
+            op->histogram[j] = sum->histogram[i][j];
+        }
+        op->p50Ns = percentile(op, 0.50);
+        op->p90Ns = percentile(op, 0.90);
+        op->p99Ns = percentile(op, 0.99);
+    }
+    stats->nodesTraversed = sum->nodes;
+    stats->bytesAllocated = sum->bytes;
+    stats->compares = sum->compares;
+    free(sum);
+#endif
+}
+
+void StrList_printStats(FILE* file) {
+    StrListStats* stats = (StrListStats*)malloc(sizeof(StrListStats));
+    if (stats == NULL) {
+        return;
+    }
+    StrList_stats(stats);
+    if (!stats->enabled) {
+        fprintf(file, "stats are not compiled in (build with STRLIST_STATS)\n");
+        free(stats);
+        return;
+    }
+    fprintf(file, "%-12s %10s %12s %10s %10s %10s %10s %10s\n",
+            "operation", "calls", "total_ms", "mean_us", "p50_us", "p90_us", "p99_us", "max_us");
+    for (int i = 0; i < stats->nops; i++) {
+        const StrListOpStats* op = &stats->ops[i];
+        if (op->calls == 0) {
+            continue;
+        }
+        fprintf(file, "%-12s %10llu %12.3f %10.3f %10.3f %10.3f %10.3f %10.3f\n",
+                op->name, (unsigned long long)op->calls, (double)op->totalNs / 1e6,
+                (double)op->totalNs / (double)op->calls / 1e3, (double)op->p50Ns / 1e3,
+                (double)op->p90Ns / 1e3, (double)op->p99Ns / 1e3, (double)op->maxNs / 1e3);
+    }
+    fprintf(file, "nodes traversed: %llu\nbytes allocated: %llu\nstring compares: %llu\n",
+            (unsigned long long)stats->nodesTraversed, (unsigned long long)stats->bytesAllocated,
+            (unsigned long long)stats->compares);
+    free(stats);
+}
+
+void StrList_resetStats() {
+#ifdef STRLIST_STATS
+    // the blocks of the other threads are zeroed lazily, by their own thread
+    pthread_mutex_lock(&statsLock);
+    atomic_fetch_add_explicit(&resetGen, 1, memory_order_relaxed);
+    clearBlock(&retired);
+    pthread_mutex_unlock(&statsLock);
+#endif
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stdint.h>
+
+/********************************************************************************
+ *
+ * The instrumentation of the StrList library.
+ *
+ * Compiled in only when STRLIST_STATS is defined (make STATS=1). Otherwise every
+ * macro below expands to nothing and the library carries no trace of it.
+ *
+ * STATS_OP(op) starts timing a public operation; the timer stops when the enclosing
+ * function returns (it relies on the cleanup attribute of gcc and clang). Operations
+ * called from inside another one are not recorded on their own.
+ *
+ * The counters are thread local plain integers, so counting costs an increment.
+ * They are added to the process wide totals when the outermost operation of the
+ * thread returns, or by STATS_FLUSH() in threads that don't run operations.
+ *
+ ********************************************************************************/
+
+typedef enum StatsOp {
+    STATS_OP_ALLOC,
+    STATS_OP_FREE,
+    STATS_OP_CLEAR,
+    STATS_OP_SIZE,
+    STATS_OP_INSERT_LAST,
+    STATS_OP_APPEND_ARRAY,
+    STATS_OP_INSERT_MANY,
+    STATS_OP_INSERT_AT,
+    STATS_OP_FIRST_DATA,
+    STATS_OP_PRINT,
+    STATS_OP_PRINT_AT,
+    STATS_OP_PRINT_LEN,
+    STATS_OP_COUNT,
+    STATS_OP_REMOVE,
+    STATS_OP_REMOVE_AT,
+    STATS_OP_REMOVE_ALL,
+    STATS_OP_REMOVE_IF,
+    STATS_OP_COUNT_PREFIX,
+    STATS_OP_REMOVE_PREFIX,
+    STATS_OP_LIST_PREFIX,
+    STATS_OP_IS_EQUAL,
+    STATS_OP_CLONE,
+    STATS_OP_REVERSE,
+    STATS_OP_SORT,
+    STATS_OP_SORT_PARALLEL,
+    STATS_OP_IS_SORTED,
+    STATS_OP_BEGIN,
+    STATS_OP_SEEK,
+    STATS_OP_INSERT_HERE,
+    STATS_OP_REMOVE_HERE,
+    STATS_OP_SAVE,
+    STATS_OP_LOAD,
+    STATS_OP_COMPACT,
+    STATS_OP_MEMORY_USAGE,
+    STATS_OPS
+} StatsOp;
+
+#ifdef STRLIST_STATS
+
+/**
+ * A running operation: which one, when it started (ns), and whether it is the outermost one.
+ */
+typedef struct StatsTimer {
+    int op;
+    int outer;
+    uint64_t start;
+} StatsTimer;
+
+extern _Thread_local uint64_t Stats_nodes;
+extern _Thread_local uint64_t Stats_bytes;
+extern _Thread_local uint64_t Stats_compares;
+
+StatsTimer Stats_start(int op);
+void Stats_stop(StatsTimer* timer);
+void Stats_flush(void);
+
+#define STATS_OP(op) StatsTimer statsTimer __attribute__((cleanup(Stats_stop))) = Stats_start(op)
+#define STATS_NODES(n) (Stats_nodes += (uint64_t)(n))
+#define STATS_BYTES(n) (Stats_bytes += (uint64_t)(n))
+#define STATS_COMPARE() (Stats_compares++)
+#define STATS_FLUSH() Stats_flush()
+
+#else
+
+#define STATS_OP(op) ((void)0)
+#define STATS_NODES(n) ((void)0)
+#define STATS_BYTES(n) ((void)0)
+#define STATS_COMPARE() ((void)0)
+#define STATS_FLUSH() ((void)0)
+
+#endif
@@ -0,0 +1,435 @@
+#include "StrKernels.h"
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define STRKERNELS_X86
+#endif
+
+#define PAGE_SIZE 4096  // the smallest page size of the processors the kernels run on
+
+/*
+ * The short strings are read a whole word or vector at a time, past their end but
+ * never across a page boundary, as the libc string functions do. The sanitizers
+ * would take those bytes (which don't change the result) for errors, so they don't
+ * instrument these functions: AddressSanitizer and ThreadSanitizer no longer check
+ * the strings the library compares through them. The sanitized builds start on the
+ * scalar kernel instead, which is instrumented (see pickKernel).
+ */
+#define READS_PAST_END __attribute__((no_sanitize("address", "thread")))
+
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+#define STRKERNELS_SANITIZED
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer) || __has_feature(thread_sanitizer)
+#define STRKERNELS_SANITIZED
+#endif
+#endif
+
+/**
+ * An implementation of the kernels.
+ */
+typedef struct Kernel {
+    const char* name;
+    size_t (*mismatch)(const char* a, const char* b, size_t len);
+    int (*equal)(const char* a, const char* b, size_t len);
+    int (*compare)(const char* a, size_t aLen, const char* b, size_t bLen);
+} Kernel;
+
+/** A HELPER FUNCTION
+ * Tells whether size bytes can be read from p without crossing into the next page
+ * (the page of p being readable: at least one byte is).
+ */
+static inline int inPage(const void* p, size_t size) {
+    return ((uintptr_t)p & (PAGE_SIZE - 1)) <= PAGE_SIZE - size;
+}
+
+/** A HELPER FUNCTION
+ * Returns the index of the first byte at which two different 8 byte words,
+ * loaded from memory, differ.
+ */
+static inline size_t firstDiffByte(uint64_t x, uint64_t y) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return (size_t)__builtin_clzll(x ^ y) / 8;
+#else
+    return (size_t)__builtin_ctzll(x ^ y) / 8;
+#endif
+}
+
+/** A HELPER FUNCTION
+ * Turns the first differing byte at of two strings into the result of a comparison.
+ */
+static inline int compareAt(const char* a, size_t aLen, const char* b, size_t bLen, size_t at) {
+    if (at < aLen && at < bLen) {
+        return (int)(unsigned char)a[at] - (int)(unsigned char)b[at];
+    }
+    return (aLen > bLen) - (aLen < bLen); // without a '\0' inside, a prefix is smaller
+}
+
+/** A HELPER FUNCTION
+ * Finds the first differing byte of a and b in [from, len), 8 bytes at a time.
+ * The bytes before from must be equal: the last word may overlap them.
+ */
+READS_PAST_END
+static inline size_t mismatchWords(const char* a, const char* b, size_t from, size_t len) {
+    size_t i = from;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t x, y;
+        memcpy(&x, a + i, 8);
+        memcpy(&y, b + i, 8);
+        if (x != y) {
+            return i + firstDiffByte(x, y);
+        }
+    }
+    if (i == len) {
+        return len;
+    }
+    uint64_t x, y;
+    if (len >= 8) {
+        memcpy(&x, a + len - 8, 8);
+        memcpy(&y, b + len - 8, 8);
+        return (x != y) ? len - 8 + firstDiffByte(x, y) : len;
+    }
+    if (inPage(a, 8) && inPage(b, 8)) {
+        memcpy(&x, a, 8);
+        memcpy(&y, b, 8);
+        // only the first len bytes count
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        uint64_t keep = ~(~0ULL >> (8 * len));
+#else
+        uint64_t keep = (1ULL << (8 * len)) - 1;
+#endif
+        x &= keep;
+        y &= keep;
+        return (x != y) ? firstDiffByte(x, y) : len;
+    }
+    for (; i < len; i++) {
+        if (a[i] != b[i]) {
+            return i;
+        }
+    }
+    return len;
+}
+
+/** A HELPER FUNCTION
+ * The scalar kernel: one byte at a time, reading only the bytes it is given.
+ */
+static size_t mismatchScalar(const char* a, const char* b, size_t len) {
+    size_t i = 0;
+    while (i < len && a[i] == b[i]) {
+        i++;
+    }
+    return i;
+}
+
+static int equalScalar(const char* a, const char* b, size_t len) {
+    return mismatchScalar(a, b, len) == len;
+}
+
+static int compareScalar(const char* a, size_t aLen, const char* b, size_t bLen) {
+    return compareAt(a, aLen, b, bLen, mismatchScalar(a, b, (aLen < bLen) ? aLen : bLen));
+}
+
+/** A HELPER FUNCTION
+ * The portable kernel: one 8 byte word at a time.
+ */
+READS_PAST_END
+static size_t mismatchPortable(const char* a, const char* b, size_t len) {
+    return mismatchWords(a, b, 0, len);
+}
+
+READS_PAST_END
+static int equalPortable(const char* a, const char* b, size_t len) {
+    return mismatchWords(a, b, 0, len) == len;
+}
+
+READS_PAST_END
+static int comparePortable(const char* a, size_t aLen, const char* b, size_t bLen) {
+    return compareAt(a, aLen, b, bLen, mismatchWords(a, b, 0, (aLen < bLen) ? aLen : bLen));
+}
+
+#ifdef STRKERNELS_X86
+
+/** A HELPER FUNCTION
+ * Compares the 16 bytes at a and b: 0xFF where they are equal, 0 elsewhere.
+ */
+READS_PAST_END __attribute__((target("sse2")))
+static inline __m128i eq16(const char* a, const char* b) {
+    __m128i x = _mm_loadu_si128((const __m128i*)a);
+    __m128i y = _mm_loadu_si128((const __m128i*)b);
+    return _mm_cmpeq_epi8(x, y);
+}
+
+/** A HELPER FUNCTION
+ * Returns the bits of the bytes that differ in the 16 bytes at a and b.
+ */
+READS_PAST_END __attribute__((target("sse2")))
+static inline unsigned diff16(const char* a, const char* b) {
+    return (unsigned)_mm_movemask_epi8(eq16(a, b)) ^ 0xFFFFu;
+}
+
+/** A HELPER FUNCTION
+ * The SSE2 kernel: 16 bytes at a time, the last block overlapping the previous one.
+ * A string shorter than 16 bytes is one block, when that doesn't cross a page.
+ */
+READS_PAST_END __attribute__((target("sse2")))
+static inline size_t mismatch16(const char* a, const char* b, size_t len) {
+    if (len < 16) {
+        if (len == 0) {
+            return 0; // a and b may not point to a single readable byte
+        }
+        if (inPage(a, 16) && inPage(b, 16)) {
+            unsigned diff = diff16(a, b) & ((1u << len) - 1);
+            return (diff != 0) ? (size_t)__builtin_ctz(diff) : len;
+        }
+        return mismatchWords(a, b, 0, len);
+    }
+    unsigned diff = diff16(a, b);
+    if (diff != 0) {
+        return (size_t)__builtin_ctz(diff);
+    }
+    size_t i = 16;
+    for (; i + 16 <= len; i += 16) {
+        diff = diff16(a + i, b + i);
+        if (diff != 0) {
+            return i + (size_t)__builtin_ctz(diff);
+        }
+    }
+    if (i < len) {
+        diff = diff16(a + len - 16, b + len - 16);
+        if (diff != 0) {
+            return len - 16 + (size_t)__builtin_ctz(diff);
+        }
+    }
+    return len;
+}
+
+READS_PAST_END __attribute__((target("sse2")))
+static size_t mismatchSse2(const char* a, const char* b, size_t len) {
+    return mismatch16(a, b, len);
+}
+
+/** A HELPER FUNCTION
+ * Tells whether the 16 byte blocks at the four offsets of a and b are all equal.
+ */
+READS_PAST_END __attribute__((target("sse2")))
+static inline int equal4x16(const char* a, const char* b, size_t o1, size_t o2, size_t o3, size_t o4) {
+    __m128i eq = _mm_and_si128(_mm_and_si128(eq16(a + o1, b + o1), eq16(a + o2, b + o2)),
+                               _mm_and_si128(eq16(a + o3, b + o3), eq16(a + o4, b + o4)));
+    return _mm_movemask_epi8(eq) == 0xFFFF;
+}
+
+/** A HELPER FUNCTION
+ * Tells whether the len bytes at a and b are equal, 64 bytes (four blocks) at a time
+ * (see equalAvx2).
+ */
+READS_PAST_END __attribute__((target("sse2")))
+static int equalSse2(const char* a, const char* b, size_t len) {
+    if (len < 16) {
+        return mismatch16(a, b, len) == len;
+    }
+    if (len <= 64) {
+        size_t half = (len <= 32) ? len - 16 : 16;
+        return equal4x16(a, b, 0, half, (len <= 32) ? 0 : len - 32, len - 16);
+    }
+    for (size_t i = 0; i + 64 < len; i += 64) {
+        if (!equal4x16(a, b, i, i + 16, i + 32, i + 48)) {
+            return 0;
+        }
+    }
+    return equal4x16(a, b, len - 64, len - 48, len - 32, len - 16);
+}
+
+READS_PAST_END __attribute__((target("sse2")))
+static int compareSse2(const char* a, size_t aLen, const char* b, size_t bLen) {
+    return compareAt(a, aLen, b, bLen, mismatch16(a, b, (aLen < bLen) ? aLen : bLen));
+}
+
+/** A HELPER FUNCTION
+ * Compares the 32 bytes at a and b: 0xFF where they are equal, 0 elsewhere.
+ */
+READS_PAST_END __attribute__((target("avx2")))
+static inline __m256i eq32(const char* a, const char* b) {
+    __m256i x = _mm256_loadu_si256((const __m256i*)a);
+    __m256i y = _mm256_loadu_si256((const __m256i*)b);
+    return _mm256_cmpeq_epi8(x, y);
+}
+
+/** A HELPER FUNCTION
+ * Returns the bits of the bytes that differ in the 32 bytes at a and b.
+ */
+READS_PAST_END __attribute__((target("avx2")))
+static inline uint32_t diff32(const char* a, const char* b) {
+    return ~(uint32_t)_mm256_movemask_epi8(eq32(a, b));
+}
+
+/** A HELPER FUNCTION
+ * The AVX2 kernel: 32 bytes at a time, the last block overlapping the previous one.
+ * A string shorter than 32 bytes is one block, when that doesn't cross a page,
+ * or goes through the SSE2 kernel.
+ */
+READS_PAST_END __attribute__((target("avx2")))
+static inline size_t mismatch32(const char* a, const char* b, size_t len) {
+    if (len < 32) {
+        if (len == 0) {
+            return 0;
+        }
+        if (inPage(a, 32) && inPage(b, 32)) {
+            uint32_t diff = diff32(a, b) & (uint32_t)((1ULL << len) - 1);
+            return (diff != 0) ? (size_t)__builtin_ctz(diff) : len;
+        }
+        return mismatch16(a, b, len);
+    }
+    uint32_t diff = diff32(a, b);
+    if (diff != 0) {
+        return (size_t)__builtin_ctz(diff);
+    }
+    // the rest 128 bytes at a time, with a single test when they are equal
+    size_t i = 32;
+    for (; i + 128 <= len; i += 128) {
+        __m256i eq = _mm256_and_si256(
+            _mm256_and_si256(eq32(a + i, b + i), eq32(a + i + 32, b + i + 32)),
+            _mm256_and_si256(eq32(a + i + 64, b + i + 64), eq32(a + i + 96, b + i + 96)));
+        if ((uint32_t)_mm256_movemask_epi8(eq) != 0xFFFFFFFFu) {
+            break;
+        }
+    }
+    for (; i + 32 <= len; i += 32) {
+        diff = diff32(a + i, b + i);
+        if (diff != 0) {
+            return i + (size_t)__builtin_ctz(diff);
+        }
+    }
+    if (i < len) {
+        diff = diff32(a + len - 32, b + len - 32);
+        if (diff != 0) {
+            return len - 32 + (size_t)__builtin_ctz(diff);
+        }
+    }
+    return len;
+}
+
+READS_PAST_END __attribute__((target("avx2")))
+static size_t mismatchAvx2(const char* a, const char* b, size_t len) {
+    return mismatch32(a, b, len);
+}
+
+/** A HELPER FUNCTION
+ * Tells whether the 32 byte blocks at the four offsets of a and b are all equal.
+ */
+READS_PAST_END __attribute__((target("avx2")))
+static inline int equal4x32(const char* a, const char* b, size_t o1, size_t o2, size_t o3, size_t o4) {
+    __m256i eq = _mm256_and_si256(_mm256_and_si256(eq32(a + o1, b + o1), eq32(a + o2, b + o2)),
+                                  _mm256_and_si256(eq32(a + o3, b + o3), eq32(a + o4, b + o4)));
+    return (uint32_t)_mm256_movemask_epi8(eq) == 0xFFFFFFFFu;
+}
+
+/** A HELPER FUNCTION
+ * Tells whether the len bytes at a and b are equal, 128 bytes (four blocks) at a time,
+ * the last four blocks overlapping the previous ones. The strings compared for equality
+ * mostly are (their lengths and hashes match), so each group of blocks is tested once.
+ */
+READS_PAST_END __attribute__((target("avx2")))
+static int equalAvx2(const char* a, const char* b, size_t len) {
+    if (len < 32) {
+        return mismatch32(a, b, len) == len;
+    }
+    if (len <= 128) {
+        size_t half = (len <= 64) ? len - 32 : 32;
+        return equal4x32(a, b, 0, half, (len <= 64) ? 0 : len - 64, len - 32);
+    }
+    for (size_t i = 0; i + 128 < len; i += 128) {
+        if (!equal4x32(a, b, i, i + 32, i + 64, i + 96)) {
+            return 0;
+        }
+    }
+    return equal4x32(a, b, len - 128, len - 96, len - 64, len - 32);
+}
+
+READS_PAST_END __attribute__((target("avx2")))
+static int compareAvx2(const char* a, size_t aLen, const char* b, size_t bLen) {
+    return compareAt(a, aLen, b, bLen, mismatch32(a, b, (aLen < bLen) ? aLen : bLen));
+}
+
+#endif
+
+/**
+ * The implementations, from the slowest to the fastest.
+ */
+static const Kernel KERNELS[] = {
+    {"scalar", mismatchScalar, equalScalar, compareScalar},
+    {"portable", mismatchPortable, equalPortable, comparePortable},
+#ifdef STRKERNELS_X86
+    {"sse2", mismatchSse2, equalSse2, compareSse2},
+    {"avx2", mismatchAvx2, equalAvx2, compareAvx2},
+#endif
+};
+
+#define KERNEL_COUNT (sizeof(KERNELS) / sizeof(KERNELS[0]))
+
+static const Kernel* kernel = &KERNELS[0];
+
+/** A HELPER FUNCTION
+ * Tells whether the processor runs the i-th implementation.
+ */
+static int kernelSupported(size_t i) {
+#ifdef STRKERNELS_X86
+    if (strcmp(KERNELS[i].name, "sse2") == 0) {
+        return __builtin_cpu_supports("sse2");
+    }
+    if (strcmp(KERNELS[i].name, "avx2") == 0) {
+        return __builtin_cpu_supports("avx2");
+    }
+#endif
+    (void)i;
+    return 1;
+}
+
+/** A HELPER FUNCTION
+ * Picks the fastest implementation the processor runs, before main.
+ * Under AddressSanitizer or ThreadSanitizer it picks the scalar kernel, whose
+ * reads they check, unlike those of the others (see READS_PAST_END).
+ */
+__attribute__((constructor))
+static void pickKernel(void) {
+#ifdef STRKERNELS_SANITIZED
+    kernel = &KERNELS[0];
+#else
+#ifdef STRKERNELS_X86
+    __builtin_cpu_init(); // the constructors may run before the one of libgcc
+#endif
+    for (size_t i = KERNEL_COUNT; i-- > 0;) {
+        if (kernelSupported(i)) {
+            kernel = &KERNELS[i];
+            return;
+        }
+    }
+#endif
+}
+
+size_t StrKernels_mismatch(const char* a, const char* b, size_t len) {
+    return kernel->mismatch(a, b, len);
+}
+
+int StrKernels_equal(const char* a, const char* b, size_t len) {
+    return kernel->equal(a, b, len);
+}
+
+int StrKernels_compare(const char* a, size_t aLen, const char* b, size_t bLen) {
+    return kernel->compare(a, aLen, b, bLen);
+}
+
+const char* StrKernels_name() {
+    return kernel->name;
+}
+
+int StrKernels_use(const char* name) {
+    for (size_t i = 0; i < KERNEL_COUNT; i++) {
+        if (strcmp(KERNELS[i].name, name) == 0 && kernelSupported(i)) {
+            kernel = &KERNELS[i];
+            return 0;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stddef.h>
+
+/********************************************************************************
+ *
+ * String comparison kernels.
+ *
+ * The kernels compare strings whose lengths are known, 16 or 32 bytes at a
+ * time with SSE2 or AVX2 when the processor has them, 8 bytes at a time
+ * otherwise. They never look for a '\0', and their results only depend on the
+ * lengths they are given, but a string shorter than a word or vector is loaded
+ * whole, reading a few bytes past its end: never across a page boundary, so the
+ * load can't fault (the libc string functions do the same). Those functions are
+ * exempt from AddressSanitizer and ThreadSanitizer, which don't check their reads.
+ * The best implementation the processor supports is picked when the program
+ * starts, except in the builds with one of those sanitizers: they start on the
+ * scalar kernel, one byte at a time, which reads exactly the bytes it is given.
+ *
+ ********************************************************************************/
+
+/*
+ * Returns the index of the first of the len bytes at which a and b differ,
+ * or len if they are all equal.
+ */
+size_t StrKernels_mismatch(const char* a, const char* b, size_t len);
+
+/*
+ * Returns 1 if the len bytes at a and b are equal, 0 otherwise.
+ */
+int StrKernels_equal(const char* a, const char* b, size_t len);
+
+/*
+ * Compares the string a of aLen chars with the string b of bLen chars, neither
+ * holding a '\0', in strcmp order: returns a negative number, 0 or a positive
+ * number when a is smaller, equal or greater.
+ */
+int StrKernels_compare(const char* a, size_t aLen, const char* b, size_t bLen);
+
+/*
+ * Returns the name of the implementation in use: "avx2", "sse2", "portable" or "scalar".
+ */
+const char* StrKernels_name();
+
+/*
+ * Switches to the implementation called name (see StrKernels_name), e.g. to
+ * compare them. Must not be called while other threads use the kernels.
+ * Returns 0 on success, -1 if the name is unknown or the processor lacks it.
+ */
+int StrKernels_use(const char* name);
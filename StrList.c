@@ -1,53 +1,454 @@
+#define _POSIX_C_SOURCE 200809L
 #include "StrList.h"
+#include "Arena.h"
+#include "ThreadPool.h"
+#include "Stats.h"
+#include "Intern.h"
+#include "StrKernels.h"
 #include <string.h>
 #include <strings.h>
 #include <limits.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-
+#define SORT_RADIX_THRESHOLD 4096   // lists this long are sorted with multikey quicksort
+#define SORT_INSERTION_LIMIT 16     // multikey quicksort ranges this short use insertion sort
+#define PARALLEL_SORT_MIN 65536     // StrList_sortParallel gives each thread at least this many nodes
+#define HASH_INITIAL_SLOTS 64       // slots of a new hash index (a power of 2)
+#define CHUNK_CAP 64                // node pointers held by a chunk of the positional index
+#define POS_INDEX_MIN 256           // lists this long get a positional index on their first positional access
+#define PRINT_BUFFER (1 << 16)      // bytes of output assembled before each write of the print functions
+#define CLONE_BATCH 1024            // lines copied per buildChain when a shared list is detached
+#define SNAPSHOT_VERSION 1          // version of the snapshot files written by StrList_save
+#define SNAPSHOT_BYTE_ORDER 0x01020304u
+#define EAGER_POS_INDEX (STRLIST_CHUNKED | STRLIST_CONCURRENT | STRLIST_SORTED) // modes whose positional index is always there
+#define FINGER_WALK_MAX 32          // nodes getNodeAt walks from head, tail or the finger rather than search the positional index
+#define PARALLEL_SCAN_MIN (1 << 20) // default size from which count, isEqual and isSorted scan on several threads
+#define SCAN_STOP_CHECK 4096        // lines a parallel scan compares between two checks that no other range has stopped it
+#define LINE_MAX_LEN UINT32_MAX     // longest line a node holds (its len is a uint32_t)
 
 /**
- * Node structure for a singly linked list.
+ * Node structure for a doubly linked list.
  * Each node contains a line of text and a pointer to the next and previous nodes in the list.
+ * len and hash cache the length and hashLine of line, so most mismatches are found
+ * without reading the string (lines longer than LINE_MAX_LEN are refused).
+ * The chars of line are stored inline in data, right after the other fields,
+ * so a node and its line are a single allocation. In STRLIST_INTERN mode line
+ * points to the copy of the Intern pool instead and the node has no chars,
+ * and so do the nodes pointing to the lines of a snapshot (see StrList_load).
+ * In STRLIST_HASH_INDEX mode data starts with the NodeLinks of the node, before
+ * its chars (see nodeText): the other lists don't pay for them.
  */
 typedef struct Node {
     char* line;
+    uint32_t len;
+    uint32_t hash;
     struct Node* next;
     struct Node* prev;
+    char data[];
 } Node;
 
 /**
- * StringList structure, which is a singly linked list of Node.
+ * The links of a node of a STRLIST_HASH_INDEX list, at the start of its data.
+ * hashNext and hashPrev chain the nodes holding the same line, and chunk is the
+ * chunk of the positional index pointing to the node, if the list has one: the
+ * nodes of a chain are removed from it without knowing their positions.
+ */
+typedef struct NodeLinks {
+    struct Node* hashNext;
+    struct Node* hashPrev;
+    struct Chunk* chunk;
+} NodeLinks;
+
+/**
+ * The header of a snapshot file (see StrList_save). It is followed by count + 1
+ * offsets (uint64_t, from the start of the blob, the last one being blobSize) and by
+ * the blob, which holds the lines one after the other, each one ended by a '\0'.
+ * The integers are in the byte order of the machine that wrote the file, which
+ * byteOrder records.
+ */
+typedef struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t count;
+    uint64_t blobSize;
+} SnapshotHeader;
+
+static const char SNAPSHOT_MAGIC[8] = "StrList";
+
+/**
+ * A snapshot file mapped in memory by StrList_load: the whole mapping, and its
+ * offsets table and blob.
+ */
+typedef struct Mapping {
+    void* addr;
+    size_t len;
+    const uint64_t* offsets;
+    const char* blob;
+} Mapping;
+
+/**
+ * A slot of the hash index: all the nodes holding one distinct line.
+ * nodes is the first node of their hash chain (NULL for an empty slot),
+ * count is the length of the chain and hash the hash of the line.
+ */
+typedef struct HashSlot {
+    Node* nodes;
+    size_t count;
+    uint32_t hash;
+} HashSlot;
+
+/**
+ * Hash index structure: an open addressing (linear probing) table of HashSlot,
+ * with at most 3/4 of its slots in use.
+ */
+typedef struct HashIndex {
+    HashSlot* slots;
+    size_t cap;
+    size_t used;
+} HashIndex;
+
+/**
+ * A node of the prefix index, a radix tree of the lines of a list: the path from
+ * the root to a node spells the chars of the edges into the nodes on the way, the
+ * labelLen chars of label for each. count is the number of elements of the list
+ * whose line starts with the path of the node, here the number of those equal to it.
+ * The children, nchildren of the cap slots of children, are in the order of the
+ * first chars of their labels. The root has an empty label.
+ */
+typedef struct TrieNode {
+    struct TrieNode** children;
+    uint32_t nchildren;
+    uint32_t cap;
+    size_t count;
+    size_t here;
+    uint32_t labelLen;
+    char label[];
+} TrieNode;
+
+/**
+ * What a scan needs to know about a node, stored contiguously in the chunks
+ * of a STRLIST_CHUNKED list so that scans don't have to visit the nodes.
+ */
+typedef struct ScanEntry {
+    const char* line;
+    uint32_t len;
+    uint32_t hash;
+} ScanEntry;
+
+/**
+ * A chunk of the positional index: up to CHUNK_CAP consecutive nodes of the list.
+ * The chunks are the nodes of a treap whose in-order walk gives them in list order,
+ * total being the number of list nodes in the subtree (this chunk included).
+ * In STRLIST_CHUNKED mode scan points to the ScanEntry of each node (allocated with the chunk),
+ * otherwise it's NULL.
+ */
+typedef struct Chunk {
+    struct Chunk* left;
+    struct Chunk* right;
+    struct Chunk* parent;
+    uint32_t priority;
+    int count;
+    size_t total;
+    ScanEntry* scan;
+    Node* nodes[CHUNK_CAP];
+} Chunk;
+
+/**
+ * Positional index structure: the treap of chunks, its last chunk (where
+ * insertLast appends) and the state of the priority generator.
+ * withScan tells whether the chunks carry ScanEntry arrays, linked whether the
+ * nodes have NodeLinks, whose chunk the index keeps up to date.
+ */
+typedef struct PosIndex {
+    Chunk* root;
+    Chunk* last;
+    uint32_t seed;
+    int withScan;
+    int linked;
+} PosIndex;
+
+/**
+ * The storage of a StringList, which is a doubly linked list of Node.
  * Contains a pointer to the head of the list and the size of the list.
+ * In STRLIST_ARENA mode the Nodes and their lines come from the list's arena,
+ * otherwise arena is NULL and each of them is malloc'ed.
+ * In STRLIST_HASH_INDEX mode index maps each distinct line to its nodes,
+ * otherwise it's NULL.
+ * In STRLIST_INTERN mode the lines of the Nodes are references to the Intern pool.
+ * posIndex finds the node at an index in O(log n). It is built the first time a list
+ * of POS_INDEX_MIN nodes or more is accessed by index, and dropped (NULL) by the
+ * operations that reorder the whole list.
+ * In STRLIST_CHUNKED mode posIndex is built with the list and rebuilt right away
+ * when dropped, and the scans read the ScanEntry arrays of its chunks.
+ * In STRLIST_PREFIX_INDEX mode prefixIndex counts the lines by prefix (see
+ * StrList_countPrefix). It is built with the list and kept up to date by every
+ * change; if it can't grow it is dropped (NULL) until a prefix function rebuilds it.
+ * Otherwise it's NULL, and the prefix functions scan the list.
+ * finger is the last node found by position and fingerPos its position (see getNodeAt),
+ * or NULL when a change of the list lost track of it.
+ * map is the snapshot a list was loaded from (see StrList_load), NULL otherwise. While
+ * unbuilt is set the list has no Nodes yet: size and chars are right, and the
+ * lines are read from map. buildNodes creates the Nodes, pointing to the lines of
+ * map, the first time they are needed.
+ * ascents and descents count the pairs of neighbour nodes whose lines are in
+ * strcmp order and in reverse order (equal neighbours count in neither), so the
+ * list is sorted when descents is 0. Every change of the list keeps them up to date
+ * (one comparison per inserted node and three per removed one), except while unbuilt.
+ * In STRLIST_SORTED mode the nodes are kept in order and found with findSorted.
+ * chars is the total length of the lines. fingerprint combines the hashes of the
+ * lines in order (see fingerprintStep); appends keep it up to date, any other change
+ * clears fingerprintValid until StrList_isEqual walks the whole list again.
+ * refs counts the StringLists sharing the storage (see StrList_clone).
+ * cacheLock guards the caches the read functions fill (finger, positional index,
+ * fingerprint, prefix index) while clones share the Store: each clone may be read
+ * on a thread of its own (see Store_lockCaches).
  */
-struct _StrList {
+typedef struct Store {
     Node* head;
     Node* tail;
     size_t size;
+    size_t chars;
+    uint64_t fingerprint;
+    int fingerprintValid;
+    int flags;
+    Arena* arena;
+    HashIndex* index;
+    PosIndex* posIndex;
+    TrieNode* prefixIndex;
+    Node* finger;
+    size_t fingerPos;
+    Mapping* map;
+    int unbuilt;
+    size_t ascents;
+    size_t descents;
+    atomic_size_t refs;
+    pthread_mutex_t cacheLock;
+} Store;
+
+/**
+ * The synchronization of a STRLIST_CONCURRENT list (see Guard_read and Guard_write).
+ * lock is taken shared by the functions that only read the list, and exclusive by
+ * the ones that change it. pending is a lock-free stack of the nodes appended by
+ * StrList_insertLast that are not linked into the list yet, newest first; whoever
+ * next takes the lock links them in. flags are those of the list, for allocating
+ * those nodes without the lock.
+ */
+typedef struct Sync {
+    pthread_rwlock_t lock;
+    _Atomic(Node*) pending;
+    int flags;
+} Sync;
+
+/**
+ * StringList structure: a handle on a Store.
+ * Clones share the Store of their source until one of them changes (copy on write),
+ * so every function that changes a list calls detach first. The caches filled by
+ * the read functions (positional index, fingerprint) live in the Store and are
+ * shared too, filled under its cacheLock. A clone of a list loaded from a snapshot
+ * gets Nodes of its own rather than building those of the shared Store (see buildNodes).
+ * sync is NULL unless the list is STRLIST_CONCURRENT. Each handle has its own lock:
+ * the Stores shared by clones are never changed in place, only read.
+ * In STRLIST_CONCURRENT mode the read functions don't fill the caches, as they
+ * run in parallel: the positional index is kept by the writers, like in
+ * STRLIST_CHUNKED mode, and the finger and fingerprint are left to the writers.
+ * reversed is the direction in which the handle reads its Store: when it is set the
+ * list starts at the tail and follows the prev pointers, so StrList_reverse only
+ * flips it. The positions kept in the Store (finger, positional index) count
+ * from the head whatever the direction; the public functions translate the
+ * indices they get with nodePos and gapPos.
+ */
+struct _StrList {
+    Store* store;
+    Sync* sync;
+    int reversed;
 };
 
+/** A HELPER FUNCTION
+ * Returns the position from the head of the node at index of a list.
+ */
+static size_t nodePos(const StrList* StrList, size_t index) {
+    return StrList->reversed ? StrList->store->size - 1 - index : index;
+}
+
+/** A HELPER FUNCTION
+ * Returns the position from the head at which nodes inserted at index of a list are linked.
+ */
+static size_t gapPos(const StrList* StrList, size_t index) {
+    return StrList->reversed ? StrList->store->size - index : index;
+}
+
+/** A HELPER FUNCTION
+ * Returns the first node of a list in its direction.
+ */
+static Node* firstNode(const StrList* StrList) {
+    return StrList->reversed ? StrList->store->tail : StrList->store->head;
+}
+
+/** A HELPER FUNCTION
+ * Returns the node after node in the direction of a list.
+ */
+static Node* stepNode(const StrList* StrList, const Node* node) {
+    return StrList->reversed ? node->prev : node->next;
+}
+
+/** A HELPER FUNCTION
+ * Returns the NodeLinks of a node of a STRLIST_HASH_INDEX list.
+ */
+static NodeLinks* linksOf(const Node* node) {
+    return (NodeLinks*)node->data;
+}
+
+/** A HELPER FUNCTION
+ * Returns the number of bytes of a node of a Store before its chars: its fields,
+ * and its NodeLinks in STRLIST_HASH_INDEX mode.
+ */
+static size_t nodeHead(const Store* store) {
+    return offsetof(Node, data) + ((store->flags & STRLIST_HASH_INDEX) ? sizeof(NodeLinks) : 0);
+}
+
+/** A HELPER FUNCTION
+ * Returns where the chars of a node of a Store go when they are inline.
+ */
+static char* nodeText(const Store* store, Node* node) {
+    return (char*)node + nodeHead(store);
+}
+
+/** A HELPER FUNCTION
+ * Returns the number of bytes of a node of a Store holding a line of len chars.
+ */
+static size_t nodeSize(const Store* store, size_t len) {
+    return nodeHead(store) + ((store->flags & STRLIST_INTERN) ? 0 : len + 1);
+}
+
+/** A HELPER FUNCTION
+ * Returns the number of bytes of an allocated node of a Store: its line is inline
+ * or it has no chars.
+ */
+static size_t nodeBytes(const Store* store, Node* node) {
+    return nodeHead(store) + ((node->line == nodeText(store, node)) ? (size_t)node->len + 1 : 0);
+}
+
+/** A HELPER FUNCTION
+ * Returns line i of a mapped snapshot and sets len to its length.
+ */
+static const char* mappedLine(const Mapping* map, size_t i, size_t* len) {
+    *len = (size_t)(map->offsets[i + 1] - map->offsets[i] - 1);
+    return map->blob + map->offsets[i];
+}
+
+/** A HELPER FUNCTION
+ * Returns the 32 bit FNV-1a hash of the len first chars of line.
+ */
+static uint32_t hashLine(const char* line, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)line[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/** A HELPER FUNCTION
+ * Adds the hash of one more line to an order-sensitive fingerprint of a sequence of lines.
+ */
+static uint64_t fingerprintStep(uint64_t fingerprint, uint32_t hash) {
+    return fingerprint * 1099511628211u + hash + 1;
+}
+
+/** A HELPER FUNCTION
+ * Tells whether a node holds the string data, of length len and hash hash.
+ * The string is only read when the cached length and hash match.
+ */
+static int nodeHolds(const Node* node, const char* data, size_t len, uint32_t hash) {
+    return node->hash == hash && node->len == len && (STATS_COMPARE(), StrKernels_equal(node->line, data, len));
+}
+
+/** A HELPER FUNCTION
+ * Adds sign (1 or -1) to the ascents or descents of a Store for the neighbours a and b
+ * (nothing when either is NULL or their lines are equal).
+ */
+static void countPair(Store* store, const Node* a, const Node* b, int sign) {
+    if (a == NULL || b == NULL || a->line == b->line) {
+        return; // the same interned line
+    }
+    int cmp = (STATS_COMPARE(), StrKernels_compare(a->line, a->len, b->line, b->len));
+    if (cmp > 0) {
+        store->descents += (size_t)sign;
+    } else if (cmp < 0) {
+        store->ascents += (size_t)sign;
+    }
+}
+
+/** A HELPER FUNCTION
+ * Copies a line of len chars into the inline data of a node (or takes a reference to
+ * its interned copy in STRLIST_INTERN mode) and caches its length and hash.
+ * @return 1 on success, 0 if the interned copy could not be allocated.
+ */
+static int Node_init(const StrList* StrList, Node* node, const char* line, size_t len) {
+    uint32_t hash = hashLine(line, len);
+    if (StrList->store->flags & STRLIST_INTERN) {
+        node->line = (char*)Intern_acquire(line, len, hash);
+        if (node->line == NULL) {
+            return 0;
+        }
+    } else {
+        node->line = nodeText(StrList->store, node);
+        memcpy(node->line, line, len + 1); // Copy the string
+    }
+    node->len = (uint32_t)len;
+    node->hash = hash;
+    return 1;
+}
+
 /**
  * Allocates a new Node with the given line, nextNode, and prevNode.
- * The function will allocate memory for the new Node and its line.
+ * The function will allocate memory for the new Node with its line inline
+ * (or a reference to the interned line in intern mode),
+ * from the arena of the list if it has one.
  * It's the user's responsibility to free the memory with Node_free.
  *
+ * @param StrList The list the Node will belong to.
  * @param line The line to be stored in the Node. The function will create a copy of this line.
  * @param nextNode The next Node in the list.
  * @param prevNode The previous Node in the list.
- * @return A pointer to the newly allocated Node, or NULL if the allocation failed.
+ * @return A pointer to the newly allocated Node, or NULL if the allocation failed
+ *         or the line is longer than LINE_MAX_LEN.
  */
-Node* Node_alloc(const char* line, Node* nextNode, Node* prevNode){
-    Node* newNode = (Node*)malloc(sizeof(Node));
+Node* Node_alloc(StrList* StrList, const char* line, Node* nextNode, Node* prevNode){
+    size_t len = strlen(line);
+    if (len > LINE_MAX_LEN) {
+        return NULL;
+    }
+    size_t size = nodeSize(StrList->store, len);
+    Node* newNode;
+    if (StrList->store->arena != NULL) {
+        newNode = (Node*)Arena_new(StrList->store->arena, size);
+    } else {
+        newNode = (Node*)malloc(size);
+    }
     if (newNode == NULL){
         return NULL;
     }
-    newNode->line = (char*)malloc(strlen(line) + 1); // Allocate memory for the string
-    if (newNode->line == NULL){
-        free(newNode);
+    STATS_BYTES(size);
+    if (!Node_init(StrList, newNode, line, len)) {
+        if (StrList->store->arena != NULL) {
+            Arena_release(StrList->store->arena, newNode, size);
+        } else {
+            free(newNode);
+        }
         return NULL;
     }
-    strcpy(newNode->line, line); // Copy the string
     newNode->next = nextNode;
     newNode->prev = prevNode;
     return newNode;
@@ -55,443 +456,4292 @@ Node* Node_alloc(const char* line, Node* nextNode, Node* prevNode){
 
 /**
  * Frees the memory used by a Node and its line.
+ * In arena mode it goes back to the arena freelists for reuse.
+ * In intern mode the Node drops its reference to the interned line.
+ * @param StrList The list the Node belongs to.
  * @param node The node to free.
  */
-void Node_free(Node* node) {
-    free(node->line);
+void Node_free(StrList* StrList, Node* node) {
+    if (StrList->store->flags & STRLIST_INTERN) {
+        Intern_release(node->line);
+    }
+    if (StrList->store->arena != NULL) {
+        Arena_release(StrList->store->arena, node, nodeBytes(StrList->store, node));
+        return;
+    }
     free(node);
 }
 
-/**
- * Allocates memory for a new StringList and initializes its fields.
- * @return A pointer to the newly allocated StringList, or NULL if allocation failed.
+Node* getNodeAt(const StrList* StrList, int index);
+
+/** A HELPER FUNCTION
+ * Returns the slot holding line in the hash index,
+ * or the empty slot where it would go if no node holds it.
  */
-StrList* StrList_alloc() {
-    StrList* list = (StrList*)malloc(sizeof(StrList));
-    if (list == NULL) {
-        return NULL; // in case malloc failed
+static HashSlot* HashIndex_find(const HashIndex* index, const char* line, size_t len, uint32_t hash) {
+    size_t mask = index->cap - 1;
+    size_t i = hash & mask;
+    while (index->slots[i].nodes != NULL) {
+        HashSlot* slot = &index->slots[i];
+        if (slot->hash == hash && nodeHolds(slot->nodes, line, len, hash)) {
+            return slot;
+        }
+        i = (i + 1) & mask;
     }
-    list->head = NULL;
-    list->tail = NULL;
-    list->size = 0;
-    return list;
+    return &index->slots[i];
 }
 
-/**
- * Frees the memory used by a StringList and all its Nodes.
- * the function enters a loop that traverses the list until it
- * reaches the end of the list.
- *
- * For each Node the function first saves a pointer to the next Node, then frees
- * the current Node
- *
- * After all Nodes have been freed, the function frees the StringList
- * itself.
- *
- * @param list The StringList to free.
+/** A HELPER FUNCTION
+ * Allocates a new empty hash index.
+ * @return A pointer to the index, or NULL if the allocation failed.
  */
-void StrList_free(StrList* StrList) {
-    if (StrList == NULL) return;
-    Node* currNode = StrList->head;
-    Node* nextNode;
-    while(currNode) {
-        nextNode = currNode;
-        currNode = currNode-> next;
-        Node_free(nextNode);
+static HashIndex* HashIndex_alloc() {
+    HashIndex* index = (HashIndex*)malloc(sizeof(HashIndex));
+    if (index == NULL) {
+        return NULL;
+    }
+    index->slots = (HashSlot*)calloc(HASH_INITIAL_SLOTS, sizeof(HashSlot));
+    if (index->slots == NULL) {
+        free(index);
+        return NULL;
+    }
+    STATS_BYTES(sizeof(HashIndex) + HASH_INITIAL_SLOTS * sizeof(HashSlot));
+    index->cap = HASH_INITIAL_SLOTS;
+    index->used = 0;
+    return index;
+}
+
+/** A HELPER FUNCTION
+ * Frees a hash index (the nodes are not touched).
+ */
+static void HashIndex_free(HashIndex* index) {
+    if (index == NULL) return;
+    free(index->slots);
+    free(index);
+}
+
+/** A HELPER FUNCTION
+ * Doubles the number of slots of the hash index and rehashes the used ones.
+ * @return 1 on success, 0 if the allocation failed (the index is untouched).
+ */
+static int HashIndex_grow(HashIndex* index) {
+    HashSlot* old = index->slots;
+    size_t oldCap = index->cap;
+    index->slots = (HashSlot*)calloc(oldCap * 2, sizeof(HashSlot));
+    if (index->slots == NULL) {
+        index->slots = old;
+        return 0;
+    }
+    STATS_BYTES(oldCap * 2 * sizeof(HashSlot));
+    index->cap = oldCap * 2;
+    size_t mask = index->cap - 1;
+    for (size_t i = 0; i < oldCap; i++) {
+        if (old[i].nodes != NULL) {
+            size_t j = old[i].hash & mask;
+            while (index->slots[j].nodes != NULL) {
+                j = (j + 1) & mask;
+            }
+            index->slots[j] = old[i];
+        }
+    }
+    free(old);
+    return 1;
+}
+
+/** A HELPER FUNCTION
+ * Empties a used slot of the hash index. The slots after it in its probe
+ * sequence are shifted back, so lookups never need tombstones.
+ */
+static void HashIndex_erase(HashIndex* index, HashSlot* slot) {
+    size_t mask = index->cap - 1;
+    size_t hole = (size_t)(slot - index->slots);
+    size_t i = hole;
+    while (1) {
+        i = (i + 1) & mask;
+        HashSlot* next = &index->slots[i];
+        if (next->nodes == NULL) {
+            break;
+        }
+        // next may move to the hole only if its home slot is not in (hole, i]
+        size_t home = next->hash & mask;
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            index->slots[hole] = *next;
+            hole = i;
+        }
+    }
+    index->slots[hole].nodes = NULL;
+    index->slots[hole].count = 0;
+    index->used--;
+}
+
+/** A HELPER FUNCTION
+ * Adds a node of the list to its hash index.
+ * If the index can't grow it is dropped, and the list goes back to linear scans.
+ */
+static void indexAdd(StrList* StrList, Node* node) {
+    HashIndex* index = StrList->store->index;
+    if (index == NULL) {
+        return;
+    }
+    if ((index->used + 1) * 4 > index->cap * 3 && !HashIndex_grow(index)) {
+        HashIndex_free(index);
+        StrList->store->index = NULL;
+        return;
+    }
+    HashSlot* slot = HashIndex_find(index, node->line, node->len, node->hash);
+    if (slot->nodes == NULL) {
+        slot->hash = node->hash;
+        slot->count = 0;
+        index->used++;
+    } else {
+        linksOf(slot->nodes)->hashPrev = node;
+    }
+    linksOf(node)->hashNext = slot->nodes;
+    linksOf(node)->hashPrev = NULL;
+    slot->nodes = node;
+    slot->count++;
+}
+
+/** A HELPER FUNCTION
+ * Removes a node of the list from its hash index.
+ */
+static void indexRemove(StrList* StrList, Node* node) {
+    HashIndex* index = StrList->store->index;
+    if (index == NULL) {
+        return;
+    }
+    HashSlot* slot = HashIndex_find(index, node->line, node->len, node->hash);
+    if (--slot->count == 0) {
+        HashIndex_erase(index, slot);
+        return;
+    }
+    NodeLinks* links = linksOf(node);
+    if (links->hashPrev != NULL) {
+        linksOf(links->hashPrev)->hashNext = links->hashNext;
+    } else {
+        slot->nodes = links->hashNext;
+    }
+    if (links->hashNext != NULL) {
+        linksOf(links->hashNext)->hashPrev = links->hashPrev;
+    }
+}
+
+/** A HELPER FUNCTION
+ * Frees a subtree of the prefix index.
+ */
+static void Trie_free(TrieNode* node) {
+    if (node == NULL) return;
+    for (uint32_t i = 0; i < node->nchildren; i++) {
+        Trie_free(node->children[i]);
+    }
+    free(node->children);
+    free(node);
+}
+
+/** A HELPER FUNCTION
+ * Returns the bytes of a trie node with an edge of len chars (never less than the
+ * struct itself, the label shares its padding).
+ */
+static size_t TrieNode_size(size_t len) {
+    size_t bytes = offsetof(TrieNode, label) + len;
+    return (bytes < sizeof(TrieNode)) ? sizeof(TrieNode) : bytes;
+}
+
+/** A HELPER FUNCTION
+ * Allocates a trie node whose edge is the len chars of label, with no elements.
+ * @return A pointer to the node, or NULL if the allocation failed.
+ */
+static TrieNode* TrieNode_alloc(const char* label, size_t len) {
+    TrieNode* node = (TrieNode*)malloc(TrieNode_size(len));
+    if (node == NULL) {
+        return NULL;
+    }
+    STATS_BYTES(TrieNode_size(len));
+    memcpy(node->label, label, len);
+    node->labelLen = (uint32_t)len;
+    node->nchildren = 0;
+    node->cap = 0;
+    node->children = NULL;
+    node->count = 0;
+    node->here = 0;
+    return node;
+}
+
+/** A HELPER FUNCTION
+ * Finds the child of a trie node whose edge starts with c (binary search, the children
+ * are in the order of the first chars of their edges).
+ * @param slot Set to the index of the child, or of the place it would take.
+ * @return The child, or NULL if there is none.
+ */
+static TrieNode* Trie_child(const TrieNode* node, unsigned char c, uint32_t* slot) {
+    uint32_t lo = 0, hi = node->nchildren;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        unsigned char first = (unsigned char)node->children[mid]->label[0];
+        if (first == c) {
+            *slot = mid;
+            return node->children[mid];
+        }
+        if (first < c) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    *slot = lo;
+    return NULL;
+}
+
+/** A HELPER FUNCTION
+ * Inserts a child in a trie node at slot.
+ * @return 1 on success, 0 if the children array could not grow.
+ */
+static int Trie_insertChild(TrieNode* node, uint32_t slot, TrieNode* child) {
+    if (node->nchildren == node->cap) {
+        uint32_t cap = node->cap ? node->cap * 2 : 2;
+        TrieNode** children = (TrieNode**)realloc(node->children, cap * sizeof(TrieNode*));
+        if (children == NULL) {
+            return 0;
+        }
+        STATS_BYTES((cap - node->cap) * sizeof(TrieNode*));
+        node->children = children;
+        node->cap = cap;
+    }
+    memmove(&node->children[slot + 1], &node->children[slot], (node->nchildren - slot) * sizeof(TrieNode*));
+    node->children[slot] = child;
+    node->nchildren++;
+    return 1;
+}
+
+/** A HELPER FUNCTION
+ * Adds a line to the prefix index of a list: counts it on the path of its chars,
+ * splitting the edge it leaves in the middle and adding a leaf for the rest of it.
+ * If the index can't grow it is dropped, and the prefix functions go back to scans.
+ */
+static void prefixIndexAdd(StrList* StrList, const char* line, size_t len) {
+    TrieNode* node = StrList->store->prefixIndex;
+    if (node == NULL) {
+        return;
+    }
+    node->count++;
+    size_t i = 0;
+    while (i < len) {
+        uint32_t slot;
+        TrieNode* child = Trie_child(node, (unsigned char)line[i], &slot);
+        if (child == NULL) {
+            TrieNode* leaf = TrieNode_alloc(line + i, len - i);
+            if (leaf == NULL || !Trie_insertChild(node, slot, leaf)) {
+                free(leaf);
+                break;
+            }
+            leaf->count = 1;
+            leaf->here = 1;
+            return;
+        }
+        size_t common = 1;
+        while (common < child->labelLen && i + common < len && child->label[common] == line[i + common]) {
+            common++;
+        }
+        if (common < child->labelLen) {
+            // the line leaves the edge in the middle: it becomes two edges
+            TrieNode* mid = TrieNode_alloc(child->label, common);
+            if (mid == NULL || !Trie_insertChild(mid, 0, child)) {
+                free(mid);
+                break;
+            }
+            mid->count = child->count;
+            child->labelLen -= (uint32_t)common;
+            memmove(child->label, child->label + common, child->labelLen);
+            node->children[slot] = mid;
+            child = mid;
+        }
+        child->count++;
+        node = child;
+        i += common;
+    }
+    if (i == len) {
+        node->here++;
+        return;
+    }
+    // the counts on the path are off by one now
+    Trie_free(StrList->store->prefixIndex);
+    StrList->store->prefixIndex = NULL;
+}
+
+/** A HELPER FUNCTION
+ * Removes a line, which the list holds, from its prefix index. The branches left
+ * with no elements are freed.
+ */
+static void prefixIndexRemove(StrList* StrList, const char* line, size_t len) {
+    TrieNode* node = StrList->store->prefixIndex;
+    if (node == NULL) {
+        return;
+    }
+    node->count--;
+    size_t i = 0;
+    while (i < len) {
+        uint32_t slot;
+        TrieNode* child = Trie_child(node, (unsigned char)line[i], &slot);
+        if (--child->count == 0) {
+            memmove(&node->children[slot], &node->children[slot + 1], (node->nchildren - slot - 1) * sizeof(TrieNode*));
+            node->nchildren--;
+            Trie_free(child);
+            return;
+        }
+        node = child;
+        i += child->labelLen;
+    }
+    node->here--;
+}
+
+/** A HELPER FUNCTION
+ * Finds the subtree of the prefix index holding the lines that start with prefix.
+ * @param start If not NULL, set to the number of chars of prefix before the edge into the subtree.
+ * @return Its root, or NULL if no line starts with prefix.
+ */
+static TrieNode* prefixIndexFind(const TrieNode* root, const char* prefix, size_t len, size_t* start) {
+    TrieNode* node = (TrieNode*)root;
+    size_t i = 0;
+    if (start != NULL) {
+        *start = 0;
+    }
+    while (i < len) {
+        uint32_t slot;
+        TrieNode* child = Trie_child(node, (unsigned char)prefix[i], &slot);
+        if (child == NULL) {
+            return NULL;
+        }
+        size_t n = (child->labelLen < len - i) ? child->labelLen : len - i;
+        if (memcmp(child->label, prefix + i, n) != 0) {
+            return NULL;
+        }
+        if (start != NULL) {
+            *start = i;
+        }
+        node = child;
+        i += n;
+    }
+    return (node->count > 0) ? node : NULL;
+}
+
+/** A HELPER FUNCTION
+ * Returns the number of bytes of a subtree of the prefix index.
+ */
+static size_t Trie_bytes(const TrieNode* node) {
+    size_t bytes = TrieNode_size(node->labelLen) + node->cap * sizeof(TrieNode*);
+    for (uint32_t i = 0; i < node->nchildren; i++) {
+        bytes += Trie_bytes(node->children[i]);
+    }
+    return bytes;
+}
+
+/** A HELPER FUNCTION
+ * Returns the number of list nodes in a subtree of chunks.
+ */
+static size_t totalOf(const Chunk* chunk) {
+    return (chunk == NULL) ? 0 : chunk->total;
+}
+
+/** A HELPER FUNCTION
+ * Recomputes the total of a chunk from its children.
+ */
+static void updateTotal(Chunk* chunk) {
+    chunk->total = chunk->count + totalOf(chunk->left) + totalOf(chunk->right);
+}
+
+/** A HELPER FUNCTION
+ * Adds delta to the total of a chunk and of all its ancestors.
+ */
+static void adjustTotals(Chunk* chunk, long delta) {
+    while (chunk != NULL) {
+        chunk->total += delta;
+        chunk = chunk->parent;
+    }
+}
+
+/** A HELPER FUNCTION
+ * Allocates an empty chunk with a random priority (xorshift32),
+ * and room for its ScanEntry array if the index has them.
+ * @return A pointer to the chunk, or NULL if malloc failed.
+ */
+static Chunk* Chunk_alloc(PosIndex* posIndex) {
+    size_t scanSize = posIndex->withScan ? CHUNK_CAP * sizeof(ScanEntry) : 0;
+    Chunk* chunk = (Chunk*)malloc(sizeof(Chunk) + scanSize);
+    if (chunk == NULL) {
+        return NULL;
+    }
+    STATS_BYTES(sizeof(Chunk) + scanSize);
+    chunk->scan = posIndex->withScan ? (ScanEntry*)(chunk + 1) : NULL;
+    uint32_t x = posIndex->seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    posIndex->seed = x;
+    chunk->priority = x;
+    chunk->left = NULL;
+    chunk->right = NULL;
+    chunk->parent = NULL;
+    chunk->count = 0;
+    chunk->total = 0;
+    return chunk;
+}
+
+/** A HELPER FUNCTION
+ * Returns the chunk following a chunk in list order, or NULL for the last one.
+ */
+static Chunk* chunkNext(Chunk* chunk) {
+    if (chunk->right != NULL) {
+        chunk = chunk->right;
+        while (chunk->left != NULL) {
+            chunk = chunk->left;
+        }
+        return chunk;
+    }
+    while (chunk->parent != NULL && chunk->parent->right == chunk) {
+        chunk = chunk->parent;
+    }
+    return chunk->parent;
+}
+
+/** A HELPER FUNCTION
+ * Returns the chunk preceding a chunk in list order, or NULL for the first one.
+ */
+static Chunk* chunkPrev(Chunk* chunk) {
+    if (chunk->left != NULL) {
+        chunk = chunk->left;
+        while (chunk->right != NULL) {
+            chunk = chunk->right;
+        }
+        return chunk;
+    }
+    while (chunk->parent != NULL && chunk->parent->left == chunk) {
+        chunk = chunk->parent;
+    }
+    return chunk->parent;
+}
+
+/** A HELPER FUNCTION
+ * Rotates a chunk above its parent, keeping the in-order sequence and the totals.
+ */
+static void rotateUp(PosIndex* posIndex, Chunk* chunk) {
+    Chunk* parent = chunk->parent;
+    Chunk* grand = parent->parent;
+    if (parent->left == chunk) {
+        parent->left = chunk->right;
+        if (chunk->right != NULL) chunk->right->parent = parent;
+        chunk->right = parent;
+    } else {
+        parent->right = chunk->left;
+        if (chunk->left != NULL) chunk->left->parent = parent;
+        chunk->left = parent;
+    }
+    parent->parent = chunk;
+    chunk->parent = grand;
+    if (grand == NULL) {
+        posIndex->root = chunk;
+    } else if (grand->left == parent) {
+        grand->left = chunk;
+    } else {
+        grand->right = chunk;
+    }
+    updateTotal(parent);
+    updateTotal(chunk);
+}
+
+/** A HELPER FUNCTION
+ * Links a chunk (already holding its nodes) into the treap right after prev,
+ * or first when prev is NULL, then restores the heap order of the priorities.
+ */
+static void insertChunkAfter(PosIndex* posIndex, Chunk* prev, Chunk* chunk) {
+    Chunk* parent;
+    int asLeft;
+    if (prev == NULL) {
+        parent = posIndex->root;
+        while (parent != NULL && parent->left != NULL) {
+            parent = parent->left;
+        }
+        asLeft = 1;
+    } else if (prev->right == NULL) {
+        parent = prev;
+        asLeft = 0;
+    } else {
+        parent = prev->right;
+        while (parent->left != NULL) {
+            parent = parent->left;
+        }
+        asLeft = 1;
+    }
+    chunk->parent = parent;
+    chunk->total = chunk->count;
+    if (parent == NULL) {
+        posIndex->root = chunk;
+    } else if (asLeft) {
+        parent->left = chunk;
+    } else {
+        parent->right = chunk;
+    }
+    adjustTotals(parent, chunk->count);
+    while (chunk->parent != NULL && chunk->priority > chunk->parent->priority) {
+        rotateUp(posIndex, chunk);
+    }
+    if (prev == posIndex->last) {
+        posIndex->last = chunk;
+    }
+}
+
+/** A HELPER FUNCTION
+ * Unlinks an empty chunk from the treap and frees it.
+ * The chunk is rotated down until it is a leaf, then cut off.
+ */
+static void removeChunk(PosIndex* posIndex, Chunk* chunk) {
+    if (chunk == posIndex->last) {
+        posIndex->last = chunkPrev(chunk);
+    }
+    while (chunk->left != NULL || chunk->right != NULL) {
+        Chunk* child;
+        if (chunk->left == NULL) {
+            child = chunk->right;
+        } else if (chunk->right == NULL) {
+            child = chunk->left;
+        } else {
+            child = (chunk->left->priority > chunk->right->priority) ? chunk->left : chunk->right;
+        }
+        rotateUp(posIndex, child);
+    }
+    if (chunk->parent == NULL) {
+        posIndex->root = NULL;
+    } else if (chunk->parent->left == chunk) {
+        chunk->parent->left = NULL;
+    } else {
+        chunk->parent->right = NULL;
+    }
+    free(chunk);
+}
+
+/** A HELPER FUNCTION
+ * Frees a subtree of chunks.
+ */
+static void freeChunks(Chunk* chunk) {
+    if (chunk == NULL) return;
+    freeChunks(chunk->left);
+    freeChunks(chunk->right);
+    free(chunk);
+}
+
+/** A HELPER FUNCTION
+ * Frees a positional index (the nodes are not touched).
+ */
+static void PosIndex_free(PosIndex* posIndex) {
+    if (posIndex == NULL) return;
+    freeChunks(posIndex->root);
+    free(posIndex);
+}
+
+/** A HELPER FUNCTION
+ * Fills the slot of a chunk of a positional index with a node (and its ScanEntry if
+ * the chunk has them).
+ */
+static void setEntry(const PosIndex* posIndex, Chunk* chunk, int slot, Node* node) {
+    chunk->nodes[slot] = node;
+    if (posIndex->linked) {
+        linksOf(node)->chunk = chunk;
+    }
+    if (chunk->scan != NULL) {
+        chunk->scan[slot].line = node->line;
+        chunk->scan[slot].len = node->len;
+        chunk->scan[slot].hash = node->hash;
+    }
+}
+
+/** A HELPER FUNCTION
+ * Moves n entries from slot from of src to slot to of dst, chunks of a positional
+ * index (possibly the same chunk, overlapping ranges are fine). The moved nodes
+ * with NodeLinks point to dst afterwards.
+ */
+static void moveEntries(const PosIndex* posIndex, Chunk* dst, int to, Chunk* src, int from, int n) {
+    memmove(dst->nodes + to, src->nodes + from, n * sizeof(Node*));
+    if (dst->scan != NULL) {
+        memmove(dst->scan + to, src->scan + from, n * sizeof(ScanEntry));
+    }
+    if (dst != src && posIndex->linked) {
+        for (int i = to; i < to + n; i++) {
+            linksOf(dst->nodes[i])->chunk = dst;
+        }
+    }
+}
+
+/** A HELPER FUNCTION
+ * Builds the positional index of a list, filling the chunks to 3/4 so that
+ * the first inserts don't split them right away.
+ * @return The index, or NULL if an allocation failed.
+ */
+static PosIndex* PosIndex_build(const StrList* StrList) {
+    PosIndex* posIndex = (PosIndex*)malloc(sizeof(PosIndex));
+    if (posIndex == NULL) {
+        return NULL;
+    }
+    STATS_BYTES(sizeof(PosIndex));
+    STATS_NODES(StrList->store->size);
+    posIndex->root = NULL;
+    posIndex->last = NULL;
+    posIndex->seed = 2463534242u;
+    posIndex->withScan = (StrList->store->flags & STRLIST_CHUNKED) != 0;
+    posIndex->linked = (StrList->store->flags & STRLIST_HASH_INDEX) != 0;
+    Chunk* chunk = NULL;
+    for (Node* curr = StrList->store->head; curr != NULL; curr = curr->next) {
+        if (chunk == NULL || chunk->count == CHUNK_CAP * 3 / 4) {
+            if (chunk != NULL) {
+                insertChunkAfter(posIndex, posIndex->last, chunk);
+            }
+            chunk = Chunk_alloc(posIndex);
+            if (chunk == NULL) {
+                freeChunks(posIndex->root);
+                free(posIndex);
+                return NULL;
+            }
+        }
+        setEntry(posIndex, chunk, chunk->count++, curr);
+    }
+    if (chunk != NULL) {
+        insertChunkAfter(posIndex, posIndex->last, chunk);
+    }
+    return posIndex;
+}
+
+/** A HELPER FUNCTION
+ * Drops the positional index and the finger of a list after a change of the
+ * order of its nodes. A STRLIST_CHUNKED, STRLIST_CONCURRENT or STRLIST_SORTED list
+ * gets a fresh index right away.
+ */
+static void dropPosIndex(StrList* StrList) {
+    PosIndex_free(StrList->store->posIndex);
+    StrList->store->posIndex = NULL;
+    StrList->store->finger = NULL;
+    if (StrList->store->flags & EAGER_POS_INDEX) {
+        StrList->store->posIndex = PosIndex_build(StrList);
+    }
+}
+
+/**
+ * A position in the ScanEntry arrays of a STRLIST_CHUNKED list.
+ */
+typedef struct ScanPos {
+    Chunk* chunk;
+    int slot;
+} ScanPos;
+
+/** A HELPER FUNCTION
+ * Starts a scan over the ScanEntry arrays of a list.
+ * @return 1 if the list can be scanned that way, 0 if it has no chunks with
+ * ScanEntry arrays (not STRLIST_CHUNKED, or the index couldn't be built) and the scan must walk the nodes.
+ */
+static int scanBegin(const StrList* StrList, ScanPos* pos) {
+    if (!(StrList->store->flags & STRLIST_CHUNKED) || StrList->store->posIndex == NULL) {
+        return 0;
+    }
+    Chunk* chunk = StrList->store->posIndex->root;
+    while (chunk != NULL && chunk->left != NULL) {
+        chunk = chunk->left;
+    }
+    pos->chunk = chunk;
+    pos->slot = 0;
+    return 1;
+}
+
+/** A HELPER FUNCTION
+ * Returns the ScanEntry at pos and moves pos to the next one,
+ * or returns NULL at the end of the list.
+ */
+static const ScanEntry* scanNext(ScanPos* pos) {
+    while (pos->chunk != NULL && pos->slot == pos->chunk->count) {
+        pos->chunk = chunkNext(pos->chunk);
+        pos->slot = 0;
+    }
+    if (pos->chunk == NULL) {
+        return NULL;
+    }
+    return &pos->chunk->scan[pos->slot++];
+}
+
+/** A HELPER FUNCTION
+ * Finds the chunk holding the node at a given position.
+ * @param posIndex The index to search.
+ * @param pos The position, smaller than the size of the list. On return, the slot of the node in the chunk.
+ * @return The chunk.
+ */
+static Chunk* findChunk(const PosIndex* posIndex, size_t* pos) {
+    Chunk* chunk = posIndex->root;
+    size_t i = *pos;
+    while (1) {
+        size_t leftTotal = totalOf(chunk->left);
+        if (i < leftTotal) {
+            chunk = chunk->left;
+        } else if (i < leftTotal + chunk->count) {
+            *pos = i - leftTotal;
+            return chunk;
+        } else {
+            i -= leftTotal + chunk->count;
+            chunk = chunk->right;
+        }
+    }
+}
+
+/** A HELPER FUNCTION
+ * Records in the positional index that node was inserted at position pos
+ * (pos == size - 1 for an insert at the end).
+ * A full chunk is split in two halves. If that fails the index is dropped, and
+ * rebuilt from the list in the modes that always have one (see dropPosIndex).
+ * @return 0 if the index was dropped, 1 otherwise.
+ */
+static int posIndexInsert(StrList* StrList, Node* node, size_t pos) {
+    PosIndex* posIndex = StrList->store->posIndex;
+    if (posIndex == NULL) {
+        return 1;
+    }
+    Chunk* chunk;
+    size_t slot = pos;
+    if (posIndex->last == NULL) {
+        chunk = Chunk_alloc(posIndex);
+        if (chunk == NULL) {
+            dropPosIndex(StrList);
+            return 0;
+        }
+        insertChunkAfter(posIndex, NULL, chunk);
+        slot = 0;
+    } else if (pos == posIndex->root->total) {
+        chunk = posIndex->last;
+        slot = chunk->count;
+    } else {
+        chunk = findChunk(posIndex, &slot);
+    }
+
+    if (chunk->count == CHUNK_CAP) {
+        Chunk* half = Chunk_alloc(posIndex);
+        if (half == NULL) {
+            dropPosIndex(StrList);
+            return 0;
+        }
+        // an append starts a new chunk, otherwise the upper half moves out
+        int keep = (slot == CHUNK_CAP) ? CHUNK_CAP : CHUNK_CAP / 2;
+        half->count = CHUNK_CAP - keep;
+        moveEntries(posIndex, half, 0, chunk, keep, half->count);
+        chunk->count = keep;
+        adjustTotals(chunk, -(long)half->count);
+        insertChunkAfter(posIndex, chunk, half);
+        if (slot >= (size_t)keep) {
+            chunk = half;
+            slot -= keep;
+        }
+    }
+    moveEntries(posIndex, chunk, slot + 1, chunk, slot, chunk->count - slot);
+    setEntry(posIndex, chunk, slot, node);
+    chunk->count++;
+    adjustTotals(chunk, 1);
+    return 1;
+}
+
+/** A HELPER FUNCTION
+ * Removes a node from the positional index, found at its position, or through its
+ * NodeLinks in STRLIST_HASH_INDEX mode.
+ * A chunk left less than a quarter full is merged into its successor when they fit in half a chunk,
+ * an empty one is freed.
+ * @param pos The position of the node (from the head), or SIZE_MAX if it is not known,
+ *            which only a list with NodeLinks may pass.
+ */
+static void posIndexRemove(StrList* StrList, Node* node, size_t pos) {
+    if (StrList->store->posIndex == NULL) {
+        return;
+    }
+    PosIndex* posIndex = StrList->store->posIndex;
+    Chunk* chunk;
+    int slot = 0;
+    if (posIndex->linked) {
+        chunk = linksOf(node)->chunk;
+        while (chunk->nodes[slot] != node) {
+            slot++;
+        }
+    } else {
+        size_t found = pos;
+        chunk = findChunk(posIndex, &found);
+        slot = (int)found;
+    }
+    chunk->count--;
+    moveEntries(posIndex, chunk, slot, chunk, slot + 1, chunk->count - slot);
+    adjustTotals(chunk, -1);
+
+    if (chunk->count < CHUNK_CAP / 4) {
+        Chunk* next = chunkNext(chunk);
+        if (next != NULL && chunk->count + next->count <= CHUNK_CAP / 2) {
+            moveEntries(posIndex, next, chunk->count, next, 0, next->count);
+            moveEntries(posIndex, next, 0, chunk, 0, chunk->count);
+            next->count += chunk->count;
+            adjustTotals(next, chunk->count);
+            adjustTotals(chunk, -(long)chunk->count);
+            chunk->count = 0;
+        }
+    }
+    if (chunk->count == 0) {
+        removeChunk(posIndex, chunk);
+    }
+}
+
+/** A HELPER FUNCTION
+ * Detaches a node from the list, fixing its neighbours, head, tail, size, chars, order counts
+ * and prefix index. The node itself is not freed. The finger is dropped, as the position of the node is not known here.
+ */
+static void unlinkNode(StrList* StrList, Node* node) {
+    prefixIndexRemove(StrList, node->line, node->len);
+    countPair(StrList->store, node->prev, node, -1);
+    countPair(StrList->store, node, node->next, -1);
+    countPair(StrList->store, node->prev, node->next, 1);
+    if (node->prev != NULL) {
+        node->prev->next = node->next;
+    } else {
+        StrList->store->head = node->next;
+    }
+    if (node->next != NULL) {
+        node->next->prev = node->prev;
+    } else {
+        StrList->store->tail = node->prev;
+    }
+    StrList->store->size--;
+    StrList->store->chars -= node->len;
+    StrList->store->fingerprintValid = 0;
+    StrList->store->finger = NULL;
+}
+
+/** A HELPER FUNCTION
+ * Links a chain of n new nodes (first..last, already linked to each other) into the list
+ * right before the node before, which is at position pos, or at the end if before is NULL.
+ * Then records the nodes in the size, chars, order counts, fingerprint and indexes of the list,
+ * and moves the position of the finger past them if it was at pos or after.
+ */
+static void spliceChain(StrList* StrList, Node* first, Node* last, size_t n, Node* before, size_t pos) {
+    if (StrList->store->finger != NULL && StrList->store->fingerPos >= pos) {
+        StrList->store->fingerPos += n;
+    }
+    Node* after = (before != NULL) ? before->prev : StrList->store->tail;
+    countPair(StrList->store, after, before, -1);
+    first->prev = after;
+    last->next = before;
+    if (after != NULL) {
+        after->next = first;
+    } else {
+        StrList->store->head = first;
+    }
+    if (before != NULL) {
+        before->prev = last;
+    } else {
+        StrList->store->tail = last;
+    }
+
+    StrList->store->size += n;
+    int posIndexed = 1; // until the positional index is dropped: rebuilt, it holds the whole chain
+    for (Node* curr = first; curr != before; curr = curr->next) {
+        countPair(StrList->store, curr->prev, curr, 1);
+        StrList->store->chars += curr->len;
+        if (before == NULL) {
+            StrList->store->fingerprint = fingerprintStep(StrList->store->fingerprint, curr->hash);
+        }
+        indexAdd(StrList, curr);
+        prefixIndexAdd(StrList, curr->line, curr->len);
+        posIndexed = posIndexed && posIndexInsert(StrList, curr, pos++);
+    }
+    countPair(StrList->store, last, before, 1);
+    if (before != NULL) {
+        StrList->store->fingerprintValid = 0;
+    }
+}
+
+/** A HELPER FUNCTION
+ * Removes the node at position pos from the list and its indexes, and frees it.
+ * The finger moves to the node that takes its position (the new last node at the end).
+ */
+static void removeNodeAt(StrList* StrList, Node* node, size_t pos) {
+    Node* next = node->next;
+    Node* prev = node->prev;
+    indexRemove(StrList, node);
+    posIndexRemove(StrList, node, pos);
+    unlinkNode(StrList, node);
+    Node_free(StrList, node);
+    if (next != NULL) {
+        StrList->store->finger = next;
+        StrList->store->fingerPos = pos;
+    } else if (prev != NULL) {
+        StrList->store->finger = prev;
+        StrList->store->fingerPos = pos - 1;
+    }
+}
+
+/** A HELPER FUNCTION
+ * Tells whether the line of a node goes before data, of length len, in a sorted list:
+ * it is smaller, or equal when equalFirst is 0.
+ */
+static int goesBefore(const Node* node, const char* data, size_t len, int equalFirst) {
+    int cmp = (STATS_COMPARE(), StrKernels_compare(node->line, node->len, data, len));
+    return equalFirst ? cmp < 0 : cmp <= 0;
+}
+
+/** A HELPER FUNCTION
+ * Finds the first node of a sorted list whose line doesn't go before data (see goesBefore).
+ * Descends the treap of the positional index comparing data with the first and last
+ * node of each chunk on the way, then binary searches the chunk holding the bound,
+ * in O(log n) compares. A list without a positional index (its build failed) is walked.
+ * @param len The length of data.
+ * @param pos Set to the position of the node (the size of the list if there is none).
+ * @return The node, or NULL if all the lines go before data.
+ */
+static Node* findSorted(const StrList* StrList, const char* data, size_t len, int equalFirst, size_t* pos) {
+    Store* store = StrList->store;
+    if (store->posIndex == NULL) {
+        size_t i = 0;
+        Node* node = store->head;
+        for (; node != NULL && goesBefore(node, data, len, equalFirst); node = node->next) {
+            i++;
+        }
+        STATS_NODES(i);
+        *pos = i;
+        return node;
+    }
+    Node* found = NULL;
+    *pos = store->size;
+    size_t base = 0;
+    Chunk* chunk = store->posIndex->root;
+    while (chunk != NULL) {
+        size_t leftTotal = totalOf(chunk->left);
+        if (!goesBefore(chunk->nodes[0], data, len, equalFirst)) {
+            found = chunk->nodes[0];
+            *pos = base + leftTotal;
+            chunk = chunk->left;
+        } else if (goesBefore(chunk->nodes[chunk->count - 1], data, len, equalFirst)) {
+            base += leftTotal + chunk->count;
+            chunk = chunk->right;
+        } else {
+            // nodes[0] goes before data and nodes[high] doesn't
+            int low = 0;
+            int high = chunk->count - 1;
+            while (high - low > 1) {
+                int mid = low + (high - low) / 2;
+                if (goesBefore(chunk->nodes[mid], data, len, equalFirst)) {
+                    low = mid;
+                } else {
+                    high = mid;
+                }
+            }
+            *pos = base + leftTotal + (size_t)high;
+            return chunk->nodes[high];
+        }
+    }
+    return found;
+}
+
+/** A HELPER FUNCTION
+ * Turns a chain of new nodes (whose last node has no next) around, in place.
+ */
+static void reverseChain(Node** first, Node** last) {
+    Node* curr = *first;
+    Node* prev = NULL;
+    while (curr != NULL) {
+        Node* next = curr->next;
+        curr->next = prev;
+        curr->prev = next;
+        prev = curr;
+        curr = next;
+    }
+    *last = *first;
+    *first = prev;
+}
+
+/** A HELPER FUNCTION
+ * Links a chain of n new nodes (whose last node has no next) into the list, so that
+ * they read in order from index, with spliceChain. In a reversed list the chain is
+ * turned around first and linked before the node at gapPos. In STRLIST_SORTED mode
+ * each node goes to its sorted position (after the equal lines) instead.
+ * @return The index of the last node linked.
+ */
+static size_t insertChain(StrList* StrList, Node* first, Node* last, size_t n, size_t index) {
+    size_t pos = 0;
+    if (StrList->store->flags & STRLIST_SORTED) {
+        while (first != NULL) {
+            Node* next = first->next;
+            Node* before = findSorted(StrList, first->line, first->len, 0, &pos);
+            spliceChain(StrList, first, first, 1, before, pos);
+            first = next;
+        }
+        return pos;
+    }
+    pos = gapPos(StrList, index);
+    if (StrList->reversed) {
+        reverseChain(&first, &last);
+    }
+    Node* before = (pos < StrList->store->size) ? getNodeAt(StrList, (int)pos) : NULL;
+    spliceChain(StrList, first, last, n, before, pos);
+    return index + n - 1;
+}
+
+/** A HELPER FUNCTION
+ * Allocates and links together the nodes of n strings, without adding them to the list.
+ * In arena mode the lengths are measured first and all the nodes are carved out of a
+ * single arena piece, otherwise each one is malloc'ed.
+ * @param StrList The list the nodes will belong to.
+ * @param words The strings (each one is copied, unless inPlace is set).
+ * @param n The number of strings, at least 1.
+ * @param inPlace Whether the nodes point to the strings instead of copying them, which must then
+ *                outlive the nodes (ignored in STRLIST_INTERN mode, where the nodes point to the pool).
+ * @param lastOut Set to the last node of the chain.
+ * @return The first node of the chain, or NULL if an allocation failed or a string is longer
+ *         than LINE_MAX_LEN (nothing is left allocated then).
+ */
+static Node* buildChain(StrList* StrList, const char* const* words, size_t n, int inPlace, Node** lastOut) {
+    Store* store = StrList->store;
+    inPlace = inPlace && !(store->flags & STRLIST_INTERN);
+    char* piece = NULL;
+    if (store->arena != NULL) {
+        size_t total = 0;
+        for (size_t i = 0; i < n; i++) {
+            size_t len = strlen(words[i]);
+            if (len > LINE_MAX_LEN) {
+                return NULL;
+            }
+            total += Arena_pieceSize(inPlace ? nodeHead(store) : nodeSize(store, len));
+        }
+        piece = (char*)Arena_new(store->arena, total);
+        if (piece == NULL) {
+            return NULL;
+        }
+        STATS_BYTES(total);
+    }
+    Node* first = NULL;
+    Node* last = NULL;
+    for (size_t i = 0; i < n; i++) {
+        size_t len = strlen(words[i]);
+        size_t size = inPlace ? nodeHead(store) : nodeSize(store, len);
+        Node* node;
+        if (len > LINE_MAX_LEN) {
+            node = NULL; // only without an arena, whose sizes were checked above
+        } else if (piece != NULL) {
+            node = (Node*)piece;
+            piece += Arena_pieceSize(size);
+        } else {
+            node = (Node*)malloc(size);
+            STATS_BYTES(size);
+        }
+        if (node != NULL && inPlace) {
+            node->line = (char*)words[i];
+            node->len = (uint32_t)len;
+            node->hash = hashLine(words[i], len);
+        } else if (node == NULL || !Node_init(StrList, node, words[i], len)) {
+            // give back the nodes built so far, then the pieces of the others
+            while (first != NULL) {
+                Node* next = first->next;
+                Node_free(StrList, first);
+                first = next;
+            }
+            if (piece != NULL) {
+                for (char* rest = (char*)node; i < n; i++) {
+                    size = inPlace ? nodeHead(store) : nodeSize(store, strlen(words[i]));
+                    Arena_release(store->arena, rest, size);
+                    rest += Arena_pieceSize(size);
+                }
+            } else {
+                free(node);
+            }
+            return NULL;
+        }
+        node->prev = last;
+        node->next = NULL;
+        if (last != NULL) {
+            last->next = node;
+        } else {
+            first = node;
+        }
+        last = node;
+    }
+    *lastOut = last;
+    return first;
+}
+
+/**
+ * Allocates memory for a new StringList and initializes its fields.
+ * @return A pointer to the newly allocated StringList, or NULL if allocation failed.
+ */
+StrList* StrList_alloc() {
+    return StrList_allocWith(0);
+}
+
+/** A HELPER FUNCTION
+ * Allocates an empty Store in the mode given by flags, referenced once.
+ * With STRLIST_ARENA the store gets its own arena for its Nodes and lines,
+ * with STRLIST_HASH_INDEX its own hash index,
+ * with STRLIST_CHUNKED, STRLIST_CONCURRENT or STRLIST_SORTED its positional index right away (see struct Store).
+ * @return A pointer to the new Store, or NULL if allocation failed.
+ */
+static Store* Store_alloc(int flags) {
+    Store* store = (Store*)malloc(sizeof(Store));
+    if (store == NULL) {
+        return NULL; // in case malloc failed
+    }
+    STATS_BYTES(sizeof(Store));
+    store->head = NULL;
+    store->tail = NULL;
+    store->size = 0;
+    store->chars = 0;
+    store->fingerprint = 0;
+    store->fingerprintValid = 1;
+    store->flags = flags;
+    store->arena = NULL;
+    store->index = NULL;
+    store->posIndex = NULL;
+    store->prefixIndex = NULL;
+    store->finger = NULL;
+    store->fingerPos = 0;
+    store->map = NULL;
+    store->unbuilt = 0;
+    store->ascents = 0;
+    store->descents = 0;
+    atomic_init(&store->refs, 1);
+    if (pthread_mutex_init(&store->cacheLock, NULL) != 0) {
+        free(store);
+        return NULL;
+    }
+    if (flags & STRLIST_ARENA) {
+        store->arena = Arena_alloc();
+        if (store->arena == NULL) {
+            pthread_mutex_destroy(&store->cacheLock);
+            free(store);
+            return NULL;
+        }
+    }
+    if (flags & STRLIST_HASH_INDEX) {
+        store->index = HashIndex_alloc();
+        if (store->index == NULL) {
+            Arena_free(store->arena);
+            pthread_mutex_destroy(&store->cacheLock);
+            free(store);
+            return NULL;
+        }
+    }
+    if (flags & STRLIST_PREFIX_INDEX) {
+        store->prefixIndex = TrieNode_alloc("", 0);
+        if (store->prefixIndex == NULL) {
+            HashIndex_free(store->index);
+            Arena_free(store->arena);
+            pthread_mutex_destroy(&store->cacheLock);
+            free(store);
+            return NULL;
+        }
+    }
+    if (flags & EAGER_POS_INDEX) {
+        StrList handle = {store, NULL, 0};
+        store->posIndex = PosIndex_build(&handle);
+    }
+    return store;
+}
+
+/** A HELPER FUNCTION
+ * Frees the Nodes of a Store (one by one, unless the arena owns them),
+ * without touching its other fields. Interned lines are released either way.
+ */
+static void Store_freeNodes(Store* store) {
+    if (store->arena != NULL) {
+        if (store->flags & STRLIST_INTERN) {
+            for (Node* node = store->head; node != NULL; node = node->next) {
+                Intern_release(node->line);
+            }
+        }
+        Arena_reset(store->arena);
+        return;
+    }
+    StrList handle = {store, NULL, 0};
+    Node* currNode = store->head;
+    Node* nextNode;
+    while(currNode) {
+        nextNode = currNode;
+        currNode = currNode-> next;
+        Node_free(&handle, nextNode);
+    }
+}
+
+/** A HELPER FUNCTION
+ * Unmaps the snapshot of a Store, if it has one. Its Nodes must be freed first.
+ */
+static void Store_unmap(Store* store) {
+    if (store->map != NULL) {
+        munmap(store->map->addr, store->map->len);
+        free(store->map);
+        store->map = NULL;
+    }
+    store->unbuilt = 0;
+}
+
+/** A HELPER FUNCTION
+ * Drops one reference to a Store, and frees it with its Nodes when it was the last one.
+ */
+static void Store_release(Store* store) {
+    if (atomic_fetch_sub_explicit(&store->refs, 1, memory_order_acq_rel) != 1) {
+        return;
+    }
+    Store_freeNodes(store);
+    Store_unmap(store);
+    Arena_free(store->arena);
+    HashIndex_free(store->index);
+    PosIndex_free(store->posIndex);
+    Trie_free(store->prefixIndex);
+    pthread_mutex_destroy(&store->cacheLock);
+    free(store);
+}
+
+/** A HELPER FUNCTION
+ * Takes the cacheLock of a Store before a read function fills or reads its caches,
+ * when clones share it: they may be read on several threads at once. A private
+ * Store is only used by its own list, and its refs only grow when that list is
+ * cloned, so it needs no lock.
+ * @return 1 if the lock was taken, to be handed to Store_unlockCaches.
+ */
+static int Store_lockCaches(Store* store) {
+    if (atomic_load_explicit(&store->refs, memory_order_acquire) == 1) {
+        return 0;
+    }
+    pthread_mutex_lock(&store->cacheLock);
+    return 1;
+}
+
+/** A HELPER FUNCTION
+ * Releases the cacheLock taken by Store_lockCaches, if it was.
+ */
+static void Store_unlockCaches(Store* store, int locked) {
+    if (locked) {
+        pthread_mutex_unlock(&store->cacheLock);
+    }
+}
+
+/** A HELPER FUNCTION
+ * Gives a list whose Store is shared with clones a copy of it: the Nodes are copied
+ * into a new Store of the same mode (the clones keep the old one), in batches of
+ * CLONE_BATCH lines, from the mapped lines if the Store has no Nodes yet.
+ * @return 1 on success, 0 if the copy could not be allocated (the list still shares its Store).
+ */
+static int unshare(StrList* StrList) {
+    Store* shared = StrList->store;
+    Store* store = Store_alloc(shared->flags);
+    if (store == NULL) {
+        return 0;
+    }
+    StrList->store = store;
+    const char* lines[CLONE_BATCH];
+    Node* curr = shared->head;
+    size_t i = 0;
+    while (shared->unbuilt ? i < shared->size : curr != NULL) {
+        size_t n = 0;
+        if (shared->unbuilt) {
+            for (; i < shared->size && n < CLONE_BATCH; i++) {
+                size_t len;
+                lines[n++] = mappedLine(shared->map, i, &len);
+            }
+        }
+        for (; curr != NULL && n < CLONE_BATCH; curr = curr->next) {
+            lines[n++] = curr->line;
+        }
+        Node* last;
+        Node* first = buildChain(StrList, lines, n, 0, &last);
+        if (first == NULL) {
+            Store_release(store);
+            StrList->store = shared;
+            return 0;
+        }
+        spliceChain(StrList, first, last, n, NULL, store->size);
+    }
+    STATS_NODES(shared->size);
+    Store_release(shared);
+    return 1;
+}
+
+/** A HELPER FUNCTION
+ * Creates the Nodes of a list loaded from a snapshot (see StrList_load), pointing to
+ * the lines of the mapping, in batches of CLONE_BATCH lines. Does nothing if it has them.
+ * A Store shared with clones, which may be reading it on other threads, is left
+ * unbuilt: the list gets a copy with Nodes of its own instead (see unshare; the
+ * handle is the caller's, hence the cast of the const list).
+ * @return 1 if the list has its Nodes, 0 if they could not be allocated (the list stays unbuilt).
+ */
+static int buildNodes(const StrList* StrList) {
+    Store* store = StrList->store;
+    if (!store->unbuilt) {
+        return 1;
+    }
+    if (atomic_load_explicit(&store->refs, memory_order_acquire) != 1) {
+        return unshare((struct _StrList*)StrList);
+    }
+    struct _StrList handle = {store, NULL, 0};
+    const char* lines[CLONE_BATCH];
+    Node* first = NULL;
+    Node* last = NULL;
+    for (size_t i = 0; i < store->size;) {
+        size_t n = 0;
+        for (; i < store->size && n < CLONE_BATCH; i++) {
+            size_t len;
+            lines[n++] = mappedLine(store->map, i, &len);
+        }
+        Node* batchLast;
+        Node* batch = buildChain(&handle, lines, n, 1, &batchLast);
+        if (batch == NULL) {
+            while (first != NULL) {
+                Node* next = first->next;
+                Node_free(&handle, first);
+                first = next;
+            }
+            return 0;
+        }
+        if (last != NULL) {
+            last->next = batch;
+            batch->prev = last;
+        } else {
+            first = batch;
+        }
+        last = batchLast;
+    }
+    size_t size = store->size;
+    store->unbuilt = 0;
+    store->size = 0;
+    store->chars = 0;
+    store->ascents = 0;
+    store->descents = 0;
+    store->fingerprint = 0;
+    store->fingerprintValid = 1;
+    if (first != NULL) {
+        spliceChain(&handle, first, last, size, NULL, 0);
+    }
+    STATS_NODES(size);
+    return 1;
+}
+
+/** A HELPER FUNCTION
+ * Gives a list a private Store before it is changed.
+ * If its Store is shared with clones, it gets a copy (see unshare).
+ * A private Store loaded from a snapshot gets its Nodes (see buildNodes).
+ * @return 1 if the list can be changed, 0 if the copy could not be allocated
+ *         (the list still shares its Store and must not be changed).
+ */
+static int detach(StrList* StrList) {
+    if (atomic_load_explicit(&StrList->store->refs, memory_order_acquire) == 1) {
+        return buildNodes(StrList);
+    }
+    return unshare(StrList);
+}
+
+/** A HELPER FUNCTION
+ * Frees a chain of nodes appended to a STRLIST_CONCURRENT list without its lock.
+ * They were malloc'ed whatever the mode of the list (see appendPending).
+ */
+static void freePending(StrList* StrList, Node* node) {
+    Store shape;
+    shape.flags = StrList->sync->flags;
+    shape.arena = NULL;
+    struct _StrList handle = {&shape, NULL, 0};
+    while (node != NULL) {
+        Node* next = node->next;
+        Node_free(&handle, node);
+        node = next;
+    }
+}
+
+/** A HELPER FUNCTION
+ * Frees the nodes appended to a STRLIST_CONCURRENT list without its lock, unlinked:
+ * for a list being freed or cleared, which need not detach its Store to drop them.
+ */
+static void discardPending(StrList* StrList) {
+    freePending(StrList, atomic_exchange_explicit(&StrList->sync->pending, NULL, memory_order_acquire));
+}
+
+/** A HELPER FUNCTION
+ * Links the nodes appended to a STRLIST_CONCURRENT list without its lock into the list,
+ * in the order of their appends. The caller holds the lock exclusively.
+ */
+static void drainPending(StrList* StrList) {
+    Node* node = atomic_exchange_explicit(&StrList->sync->pending, NULL, memory_order_acquire);
+    if (node == NULL) {
+        return;
+    }
+    // the stack is newest first: relink it the other way round
+    Node* first = NULL;
+    Node* last = node;
+    size_t n = 0;
+    while (node != NULL) {
+        Node* next = node->next;
+        node->next = first;
+        if (first != NULL) {
+            first->prev = node;
+        }
+        first = node;
+        node = next;
+        n++;
+    }
+    first->prev = NULL;
+    if (!detach(StrList)) {
+        freePending(StrList, first);
+        return; // malloc failed
+    }
+    insertChain(StrList, first, last, n, StrList->store->size);
+}
+
+/**
+ * A lock held on a list by a public function, released when the function returns
+ * (LOCK_READ and LOCK_WRITE rely on the cleanup attribute of gcc and clang, as STATS_OP does).
+ * sync is NULL when there is nothing to release: the list is NULL or not STRLIST_CONCURRENT.
+ * store is the Store of the list before its pending appends were linked in, which
+ * detaches it if clones share it (see cursorDetach).
+ */
+typedef struct Guard {
+    Sync* sync;
+    Store* store;
+} Guard;
+
+/** A HELPER FUNCTION
+ * Takes the lock of a STRLIST_CONCURRENT list shared, after linking in its pending
+ * appends (under the exclusive lock), so the caller sees every append that returned.
+ */
+static Guard Guard_read(const StrList* StrList) {
+    Guard guard = {(StrList != NULL) ? StrList->sync : NULL, NULL};
+    if (guard.sync == NULL) {
+        return guard;
+    }
+    if (atomic_load_explicit(&guard.sync->pending, memory_order_acquire) != NULL) {
+        pthread_rwlock_wrlock(&guard.sync->lock);
+        drainPending((struct _StrList*)StrList);
+        pthread_rwlock_unlock(&guard.sync->lock);
+    }
+    pthread_rwlock_rdlock(&guard.sync->lock);
+    return guard;
+}
+
+/** A HELPER FUNCTION
+ * Takes the lock of a STRLIST_CONCURRENT list exclusively and links in its pending appends.
+ */
+static Guard Guard_write(StrList* StrList) {
+    Guard guard = {(StrList != NULL) ? StrList->sync : NULL, NULL};
+    if (guard.sync == NULL) {
+        guard.store = (StrList != NULL) ? StrList->store : NULL;
+        return guard;
+    }
+    pthread_rwlock_wrlock(&guard.sync->lock);
+    guard.store = StrList->store;
+    drainPending(StrList);
+    return guard;
+}
+
+/** A HELPER FUNCTION
+ * Takes the lock of a STRLIST_CONCURRENT list exclusively and drops its pending appends,
+ * for a function that empties the list anyway.
+ */
+static Guard Guard_discard(StrList* StrList) {
+    Guard guard = {(StrList != NULL) ? StrList->sync : NULL, NULL};
+    if (guard.sync == NULL) {
+        guard.store = (StrList != NULL) ? StrList->store : NULL;
+        return guard;
+    }
+    pthread_rwlock_wrlock(&guard.sync->lock);
+    guard.store = StrList->store;
+    discardPending(StrList);
+    return guard;
+}
+
+/** A HELPER FUNCTION
+ * Releases the lock taken by Guard_read, Guard_write or Guard_discard.
+ */
+static void Guard_release(Guard* guard) {
+    if (guard->sync != NULL) {
+        pthread_rwlock_unlock(&guard->sync->lock);
+    }
+}
+
+#define LOCK_READ(list) Guard guard __attribute__((cleanup(Guard_release))) = Guard_read(list)
+#define LOCK_WRITE(list) Guard guard __attribute__((cleanup(Guard_release))) = Guard_write(list)
+#define LOCK_DISCARD(list) Guard guard __attribute__((cleanup(Guard_release))) = Guard_discard(list)
+
+/** A HELPER FUNCTION
+ * Allocates the synchronization of a STRLIST_CONCURRENT list of the given flags.
+ * The lock prefers writers: once a writer waits, new readers wait behind it, so a
+ * stream of overlapping readers can't hold it off (glibc prefers readers by default;
+ * the library never takes the lock of a list twice in one thread, which the
+ * nonrecursive kind requires).
+ * @return The Sync, or NULL if the allocation failed.
+ */
+static Sync* Sync_alloc(int flags) {
+    Sync* sync = (Sync*)malloc(sizeof(Sync));
+    if (sync == NULL) {
+        return NULL;
+    }
+    STATS_BYTES(sizeof(Sync));
+    pthread_rwlockattr_t attr;
+    if (pthread_rwlockattr_init(&attr) != 0) {
+        free(sync);
+        return NULL;
+    }
+#ifdef __GLIBC__
+    pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+    int failed = pthread_rwlock_init(&sync->lock, &attr) != 0;
+    pthread_rwlockattr_destroy(&attr);
+    if (failed) {
+        free(sync);
+        return NULL;
+    }
+    atomic_init(&sync->pending, NULL);
+    sync->flags = flags;
+    return sync;
+}
+
+/** A HELPER FUNCTION
+ * Frees the synchronization of a list (its pending appends must have been discarded).
+ */
+static void Sync_free(Sync* sync) {
+    if (sync == NULL) {
+        return;
+    }
+    pthread_rwlock_destroy(&sync->lock);
+    free(sync);
+}
+
+/**
+ * Allocates memory for a new StringList in the mode given by flags (see Store_alloc).
+ * @param flags A combination of the STRLIST_ flags.
+ * @return A pointer to the newly allocated StringList, or NULL if allocation failed.
+ */
+StrList* StrList_allocWith(int flags) {
+    STATS_OP(STATS_OP_ALLOC);
+    if ((flags & STRLIST_PREFIX_INDEX) && !(flags & STRLIST_SORTED)) {
+        flags |= STRLIST_HASH_INDEX; // StrList_removePrefix finds the lines of the trie through it
+    }
+    StrList* list = (StrList*)malloc(sizeof(StrList));
+    if (list == NULL) {
+        return NULL; // in case malloc failed
+    }
+    STATS_BYTES(sizeof(StrList));
+    list->store = Store_alloc(flags);
+    list->sync = NULL;
+    list->reversed = 0;
+    if (list->store == NULL) {
+        free(list);
+        return NULL;
+    }
+    if (flags & STRLIST_CONCURRENT) {
+        list->sync = Sync_alloc(flags);
+        if (list->sync == NULL) {
+            Store_release(list->store);
+            free(list);
+            return NULL;
+        }
+    }
+    return list;
+}
+
+/**
+ * Frees a StringList. Its Store, with all its Nodes, is freed along with it
+ * unless clones still share it.
+ * No other thread may use the list once it is being freed.
+ * @param list The StringList to free.
+ */
+void StrList_free(StrList* StrList) {
+    STATS_OP(STATS_OP_FREE);
+    if (StrList == NULL) return;
+    if (StrList->sync != NULL) {
+        discardPending(StrList);
+        Sync_free(StrList->sync);
+    }
+    Store_release(StrList->store);
+    free(StrList);
+}
+
+/**
+ * Removes all the Nodes of a StringList, leaving it empty.
+ * In arena mode the whole arena is reset at once, without visiting the Nodes.
+ * Otherwise the function frees the Nodes one by one.
+ * The hash index, if any, is emptied, and the snapshot a list was loaded from is unmapped.
+ * A list sharing its Store with clones gets a new empty Store instead.
+ * The appends a STRLIST_CONCURRENT list took without its lock are dropped unlinked.
+ *
+ * @param list The StringList to clear.
+ */
+void StrList_clear(StrList* StrList) {
+    STATS_OP(STATS_OP_CLEAR);
+    LOCK_DISCARD(StrList);
+    if (StrList == NULL) return;
+    if (atomic_load_explicit(&StrList->store->refs, memory_order_acquire) != 1) {
+        Store* store = Store_alloc(StrList->store->flags);
+        if (store == NULL) {
+            return;
+        }
+        Store_release(StrList->store);
+        StrList->store = store;
+        return;
+    }
+    Store_freeNodes(StrList->store);
+    Store_unmap(StrList->store);
+    if (StrList->store->index != NULL) {
+        memset(StrList->store->index->slots, 0, StrList->store->index->cap * sizeof(HashSlot));
+        StrList->store->index->used = 0;
+    }
+    if (StrList->store->flags & STRLIST_PREFIX_INDEX) {
+        Trie_free(StrList->store->prefixIndex);
+        StrList->store->prefixIndex = TrieNode_alloc("", 0);
+    }
+    StrList->store->head = NULL;
+    StrList->store->tail = NULL;
+    StrList->store->size = 0;
+    StrList->store->chars = 0;
+    StrList->store->ascents = 0;
+    StrList->store->descents = 0;
+    StrList->store->fingerprint = 0;
+    StrList->store->fingerprintValid = 1;
+    dropPosIndex(StrList);
+}
+
+
+/** A HELPER FUNCTION
+ * Appends a line to a STRLIST_CONCURRENT list without taking its lock: the node is
+ * malloc'ed (an arena is not thread safe) and pushed on the pending stack with a
+ * compare and swap, to be linked in by the next function that takes the lock.
+ */
+static void appendPending(StrList* StrList, const char* data) {
+    Store shape; // the fields Node_alloc reads; the Store of the list may change meanwhile
+    shape.flags = StrList->sync->flags;
+    shape.arena = NULL;
+    struct _StrList handle = {&shape, NULL, 0};
+    Node* node = Node_alloc(&handle, data, NULL, NULL);
+    if (node == NULL) {
+        return; // malloc failed
+    }
+    Node* top = atomic_load_explicit(&StrList->sync->pending, memory_order_relaxed);
+    do {
+        node->next = top;
+    } while (!atomic_compare_exchange_weak_explicit(&StrList->sync->pending, &top, node,
+            memory_order_release, memory_order_relaxed));
+}
+
+size_t StrList_size(const StrList* StrList) {
+    STATS_OP(STATS_OP_SIZE);
+    LOCK_READ(StrList);
+    if (StrList == NULL) return 0;
+    return StrList->store->size;
+}
+
+void StrList_insertLast(StrList* StrList, const char* data) {
+    STATS_OP(STATS_OP_INSERT_LAST);
+    if (StrList->sync != NULL && !(StrList->sync->flags & (STRLIST_ARENA | STRLIST_SORTED))) {
+        appendPending(StrList, data);
+        return;
+    }
+    LOCK_WRITE(StrList);
+    if (!detach(StrList)) {
+        return;
+    }
+    Node* newNode = Node_alloc(StrList,data,NULL,NULL);
+    if(newNode == NULL) {
+        return; // malloc failed
+    }
+    insertChain(StrList, newNode, newNode, 1, StrList->store->size);
+}
+
+/**
+ * Inserts the n strings of words at the end of the list, in order.
+ * All the nodes are allocated in one pass (see buildChain), then linked to the
+ * tail at once (in STRLIST_SORTED mode each one goes to its sorted position, see insertChain).
+ * @param StrList The list to insert into.
+ * @param words The strings to insert (each one is copied).
+ * @param n The number of strings.
+ */
+void StrList_appendArray(StrList* StrList, const char* const* words, size_t n) {
+    STATS_OP(STATS_OP_APPEND_ARRAY);
+    LOCK_WRITE(StrList);
+    if (StrList == NULL || n == 0 || !detach(StrList)) {
+        return;
+    }
+    Node* last;
+    Node* first = buildChain(StrList, words, n, 0, &last);
+    if (first == NULL) {
+        return; // malloc failed
+    }
+    insertChain(StrList, first, last, n, StrList->store->size);
+}
+
+/**
+ * Inserts the n strings of words at the given index of the list, in order
+ * (the first one ends up at index). If the index is out of range, the function does nothing.
+ * All the nodes are allocated in one pass (see buildChain), then linked in at once
+ * (in STRLIST_SORTED mode each one goes to its sorted position, see insertChain).
+ * @param StrList The list to insert into.
+ * @param words The strings to insert (each one is copied).
+ * @param n The number of strings.
+ * @param index The index to insert the first string at.
+ */
+void StrList_insertMany(StrList* StrList, const char* const* words, size_t n, int index) {
+    STATS_OP(STATS_OP_INSERT_MANY);
+    LOCK_WRITE(StrList);
+    if (StrList == NULL || n == 0 || index < 0 || (size_t)index > StrList->store->size || !detach(StrList)) {
+        return;
+    }
+    Node* last;
+    Node* first = buildChain(StrList, words, n, 0, &last);
+    if (first == NULL) {
+        return; // malloc failed
+    }
+    insertChain(StrList, first, last, n, (size_t)index);
+}
+
+/**
+ * Inserts a new Node at the given index in the list.
+ * If the index is out of range, the function does nothing.
+ * If the index is 0, the function inserts the new Node at the beginning of the list.
+ * If the index is the size of the list, the function inserts the new Node at the end of the list.
+ * Otherwise, the function finds the Node at the given index with getNodeAt and inserts the new Node before it
+ * (after it in a reversed list, see insertChain).
+ * In STRLIST_SORTED mode the new Node goes to its sorted position instead (see insertChain).
+ * @param list The list to insert into.
+ * @param data The line of text to store in the new Node.
+ * @param index The index to insert the new Node at.
+
+*/
+void StrList_insertAt(StrList* StrList, const char* data, int index) {
+    STATS_OP(STATS_OP_INSERT_AT);
+    LOCK_WRITE(StrList);
+    if(index < 0 || (size_t)index > StrList->store->size || !detach(StrList)) {
+        return;
+    }
+    Node* newNode = Node_alloc(StrList,data,NULL,NULL);
+    if (newNode == NULL) {
+        return;
+    }
+    insertChain(StrList, newNode, newNode, 1, (size_t)index);
+}
+
+/**
+ * Returns the data of the first node in the StrList.
+ * If the list is empty, the function returns NULL.
+ * @param StrList The list to get the data from.
+ * @return The data of the first node in the list.
+ */
+char* StrList_firstData(const StrList* StrList) {
+    STATS_OP(STATS_OP_FIRST_DATA);
+    LOCK_READ(StrList);
+    if( StrList == NULL || StrList->store->size == 0) {
+        return NULL;
+    }
+    if (StrList->store->unbuilt) {
+        size_t len;
+        return (char*)mappedLine(StrList->store->map, nodePos(StrList, 0), &len);
+    }
+    return firstNode(StrList)->line;
+}
+
+/** A HELPER FUNCTION
+ * Returns a pointer to the node at a given index in the StrList.
+ * If the list is NULL, the index is negative, or the index is greater than or equal to the size of the list, the function returns NULL.
+ * The node is reached by walking from the closest of the head, the tail and the finger
+ * (the node found by the previous call), so that runs of nearby indices cost O(1) each.
+ * When all three are more than FINGER_WALK_MAX nodes away, lists of POS_INDEX_MIN nodes or
+ * more are searched through their positional index, which is built on the first such call.
+ * The node found becomes the finger (these are caches, hence the cast of the const list),
+ * under the cacheLock of a Store shared with clones.
+ * STRLIST_CONCURRENT lists, read by several threads at once, use the finger and the
+ * index kept by their writers but don't update them here, nor do the modes whose
+ * positional index is kept by the writers (EAGER_POS_INDEX) build it.
+ * A list loaded from a snapshot gets its Nodes first (see buildNodes).
+ * @param StrList The list to get the node from.
+ * @param index The index of the node to get.
+ * @return A pointer to the node at the specified index in the list, or NULL if the index is out of bounds.
+ */
+Node* getNodeAt(const StrList* StrList, int index) {
+    if (StrList == NULL || index < 0 || (size_t)index >= StrList->store->size) {
+        return NULL;
+    }
+    if (!buildNodes(StrList)) {
+        return NULL;
+    }
+    Store* store = StrList->store;
+    int locked = Store_lockCaches(store);
+    size_t pos = (size_t)index;
+    Node* node = store->head;
+    size_t nodePos = 0;
+    size_t distance = pos;
+    if (store->size - 1 - pos < distance) {
+        node = store->tail;
+        nodePos = store->size - 1;
+        distance = store->size - 1 - pos;
+    }
+    if (store->finger != NULL) {
+        size_t fingerDistance = (pos > store->fingerPos) ? pos - store->fingerPos : store->fingerPos - pos;
+        if (fingerDistance < distance) {
+            node = store->finger;
+            nodePos = store->fingerPos;
+            distance = fingerDistance;
+        }
+    }
+    int cache = !(store->flags & STRLIST_CONCURRENT);
+    if (cache && distance > FINGER_WALK_MAX && store->posIndex == NULL && store->size >= POS_INDEX_MIN
+            && !(store->flags & EAGER_POS_INDEX)) {
+        store->posIndex = PosIndex_build(StrList);
+    }
+    if (distance > FINGER_WALK_MAX && store->posIndex != NULL) {
+        size_t slot = pos;
+        Chunk* chunk = findChunk(store->posIndex, &slot);
+        node = chunk->nodes[slot];
+    } else {
+        for (; nodePos < pos; nodePos++) {
+            node = node->next;
+        }
+        for (; nodePos > pos; nodePos--) {
+            node = node->prev;
+        }
+        STATS_NODES(distance);
+    }
+    if (cache) {
+        store->finger = node;
+        store->fingerPos = pos;
+    }
+    Store_unlockCaches(store, locked);
+    return node;
+}
+
+/**
+ * An output buffer for the print functions.
+ * The lines are copied into buf and handed to the FILE or the file descriptor
+ * PRINT_BUFFER bytes at a time, lines that don't fit in buf are written directly.
+ */
+typedef struct OutBuf {
+    char buf[PRINT_BUFFER];
+    size_t len;
+    FILE* file; // NULL when writing to fd
+    int fd;
+    int failed;
+} OutBuf;
+
+/** A HELPER FUNCTION
+ * Writes len bytes to the destination of out, retrying short writes.
+ */
+static void OutBuf_write(OutBuf* out, const char* data, size_t len) {
+    if (out->failed) {
+        return;
+    }
+    if (out->file != NULL) {
+        if (fwrite(data, 1, len, out->file) != len) {
+            out->failed = 1;
+        }
+        return;
+    }
+    while (len > 0) {
+        ssize_t written = write(out->fd, data, len);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            out->failed = 1;
+            return;
+        }
+        data += written;
+        len -= (size_t)written;
+    }
+}
+
+/** A HELPER FUNCTION
+ * Writes what is in the buffer and empties it.
+ */
+static void OutBuf_flush(OutBuf* out) {
+    OutBuf_write(out, out->buf, out->len);
+    out->len = 0;
+}
+
+/** A HELPER FUNCTION
+ * Appends len bytes to the buffer, flushing it first if they don't fit.
+ */
+static void OutBuf_put(OutBuf* out, const char* data, size_t len) {
+    if (out->len + len > PRINT_BUFFER) {
+        OutBuf_flush(out);
+        if (len > PRINT_BUFFER) {
+            OutBuf_write(out, data, len);
+            return;
+        }
+    }
+    memcpy(out->buf + out->len, data, len);
+    out->len += len;
+}
+
+/** A HELPER FUNCTION
+ * Puts all the lines of the list in the buffer, separated by spaces and ended by
+ * a newline, and flushes it.
+ * Iterates through the ScanEntry arrays of a chunked list that isn't reversed, through
+ * the mapped lines of a list loaded from a snapshot that has no Nodes yet, or through
+ * the nodes otherwise, in the direction of the list.
+ * @return 0 on success, -1 if a write failed.
+ */
+static int printList(const StrList* StrList, OutBuf* out) {
+    out->len = 0;
+    out->failed = 0;
+    STATS_NODES(StrList != NULL ? StrList->store->size : 0);
+    ScanPos pos;
+    if (StrList == NULL || StrList->store->size == 0) {
+        OutBuf_put(out, "\n", 1); // an empty list prints just the newline
+    } else if (StrList->store->unbuilt) {
+        for (size_t i = 0; i < StrList->store->size; i++) {
+            size_t len;
+            const char* line = mappedLine(StrList->store->map, nodePos(StrList, i), &len);
+            if (i > 0) {
+                OutBuf_put(out, " ", 1);
+            }
+            OutBuf_put(out, line, len);
+        }
+        OutBuf_put(out, "\n", 1);
+    } else if (!StrList->reversed && scanBegin(StrList, &pos)) {
+        const ScanEntry* entry = scanNext(&pos);
+        OutBuf_put(out, entry->line, entry->len);
+        while ((entry = scanNext(&pos)) != NULL) {
+            OutBuf_put(out, " ", 1);
+            OutBuf_put(out, entry->line, entry->len);
+        }
+        OutBuf_put(out, "\n", 1);
+    } else {
+        Node* currNode = firstNode(StrList);
+        OutBuf_put(out, currNode->line, currNode->len);
+        for (currNode = stepNode(StrList, currNode); currNode != NULL; currNode = stepNode(StrList, currNode)) {
+            OutBuf_put(out, " ", 1);
+            OutBuf_put(out, currNode->line, currNode->len);
+        }
+        OutBuf_put(out, "\n", 1);
+    }
+    OutBuf_flush(out);
+    return out->failed ? -1 : 0;
+}
+
+/*
+ * Prints all the lines of the list to the standard output, see StrList_printTo.
+ */
+void StrList_print(const StrList* StrList) {
+    STATS_OP(STATS_OP_PRINT);
+    StrList_printTo(StrList, stdout);
+}
+
+/**
+ * Prints all the lines of the list to a stream, separated by spaces and ended by a newline.
+ * The output is assembled in PRINT_BUFFER sized blocks, each one handed to the stream
+ * with a single fwrite, instead of formatting every line with printf.
+ * @param StrList The list to print.
+ * @param file The stream to print to.
+ * @return 0 on success, -1 if a write to the stream failed.
+ */
+int StrList_printTo(const StrList* StrList, FILE* file) {
+    STATS_OP(STATS_OP_PRINT);
+    LOCK_READ(StrList);
+    OutBuf* out = (OutBuf*)malloc(sizeof(OutBuf));
+    if (out == NULL) {
+        return -1;
+    }
+    out->file = file;
+    out->fd = -1;
+    int result = printList(StrList, out);
+    free(out);
+    return result;
+}
+
+/**
+ * Prints all the lines of the list to a file descriptor, like StrList_printTo,
+ * with a single write call per PRINT_BUFFER bytes of output and no stdio in between.
+ * Short writes and interrupted writes are retried.
+ * @param StrList The list to print.
+ * @param fd The file descriptor to write to.
+ * @return 0 on success, -1 if a write failed.
+ */
+int StrList_printToFd(const StrList* StrList, int fd) {
+    STATS_OP(STATS_OP_PRINT);
+    LOCK_READ(StrList);
+    OutBuf* out = (OutBuf*)malloc(sizeof(OutBuf));
+    if (out == NULL) {
+        return -1;
+    }
+    out->file = NULL;
+    out->fd = fd;
+    int result = printList(StrList, out);
+    free(out);
+    return result;
+}
+
+/**
+ * Prints the data of the node at a given index in the StrList to the standard output.
+ * If the index is out of bounds, the function does nothing.
+ * @param StrList The list to print the data from.
+ * @param index The index of the node to print.
+ */
+void StrList_printAt(const StrList* StrList, int index) {
+    STATS_OP(STATS_OP_PRINT_AT);
+    LOCK_READ(StrList);
+    if (StrList==NULL || StrList->store->size == 0) {
+        return;
+    }
+    if (StrList->store->size < (size_t)index || index < 0) {
+        return;
+    }
+    if (StrList->store->unbuilt) {
+        if ((size_t)index < StrList->store->size) {
+            size_t len;
+            printf("%s\n", mappedLine(StrList->store->map, nodePos(StrList, (size_t)index), &len));
+        }
+        return;
+    }
+    if ((size_t)index == StrList->store->size) {
+        return;
+    }
+
+    Node* currNode = getNodeAt(StrList, (int)nodePos(StrList, (size_t)index));
+    if(currNode == NULL) {
+        return;
+    }
+    printf("%s\n",currNode->line);
+}
+
+/**
+ * Returns the amount of characters in the list, kept up to date by every change of the list.
+ * If the list is empty, the function returns 0.
+ * @param StrList The list to count the characters in.
+ * @return The amount of characters in the list (INT_MAX if it doesn't fit in an int).
+ */
+int StrList_printLen(const StrList* StrList) {
+    STATS_OP(STATS_OP_PRINT_LEN);
+    LOCK_READ(StrList);
+    if (StrList == NULL){
+        return 0;
+    }
+    if (StrList->store->chars > INT_MAX) {
+        return INT_MAX;
+    } else {
+        return (int)StrList->store->chars;
+    }
+}
+
+/**
+ * The settings of the parallel scans (see StrList_setParallelScan), and the
+ * threads that run them and the parallel sorts, locked by the one using them
+ * (see scanPoolAcquire).
+ */
+static atomic_size_t parallelScanMin = PARALLEL_SCAN_MIN;
+static atomic_int parallelScanThreads = 0;
+static pthread_mutex_t scanPoolLock = PTHREAD_MUTEX_INITIALIZER;
+static ThreadPool* scanPool = NULL;
+
+/**
+ * Sets when count, isEqual and isSorted scan a list on several threads.
+ * @param minSize The size from which lists are scanned in parallel, 0 to always scan them serially.
+ * @param nthreads The number of threads of a parallel scan, or 0 (or less) for one per online processor.
+ */
+void StrList_setParallelScan(size_t minSize, int nthreads) {
+    atomic_store(&parallelScanMin, minSize);
+    atomic_store(&parallelScanThreads, nthreads);
+}
+
+/**
+ * Where a range of a parallel scan starts in one list: its ScanEntry when the
+ * list is chunked (scan set), its node otherwise.
+ */
+typedef struct ScanCursor {
+    ScanPos pos;
+    Node* node;
+    int scan;
+} ScanCursor;
+
+/**
+ * The state shared by the tasks of a parallel scan.
+ * Range i covers the positions from ranges[i] to ranges[i + 1] (from the head)
+ * of list, and of other for StrList_isEqual; starts1[i] and starts2[i] are where
+ * it starts in each. The scans of count write counts[i], those of isEqual
+ * fingerprints[i]; the first range of isEqual or isSorted that finds a
+ * difference sets stop, which the other ranges check every SCAN_STOP_CHECK lines.
+ */
+typedef struct ScanJob {
+    const StrList* list;
+    const StrList* other;
+    size_t* ranges;
+    ScanCursor* starts1;
+    ScanCursor* starts2;
+    const char* data;
+    size_t len;
+    uint32_t hash;
+    const char* interned;
+    int internedLines;
+    size_t* counts;
+    uint64_t* fingerprints;
+    atomic_int stop;
+    int nranges;
+} ScanJob;
+
+/** A HELPER FUNCTION
+ * Tells on how many threads a list should be scanned: 1 (a serial scan) under
+ * the size set by StrList_setParallelScan or when one thread is asked for.
+ */
+static int scanThreads(const StrList* StrList) {
+    size_t minSize = atomic_load(&parallelScanMin);
+    if (minSize == 0 || StrList->store->size < minSize) {
+        return 1;
+    }
+    int nthreads = atomic_load(&parallelScanThreads);
+    return (nthreads > 0) ? nthreads : ThreadPool_cpuCount();
+}
+
+/** A HELPER FUNCTION
+ * Returns the positional index of a list, which a clone may be building meanwhile
+ * (see getNodeAt), or NULL if it has none.
+ */
+static PosIndex* scanIndexOf(const StrList* StrList) {
+    int locked = Store_lockCaches(StrList->store);
+    PosIndex* posIndex = StrList->store->posIndex;
+    Store_unlockCaches(StrList->store, locked);
+    return posIndex;
+}
+
+/** A HELPER FUNCTION
+ * Places the cursors of the ranges of a scan at their starts, found in the positional
+ * index of the list in O(log n) each: in its ScanEntry arrays if it is chunked, at
+ * its nodes otherwise.
+ * @param ranges The positions (from the head) where the nranges ranges start, and where the last one ends.
+ */
+static void scanCursorsAt(const PosIndex* posIndex, const size_t* ranges, int nranges, ScanCursor* cursors) {
+    for (int i = 0; i < nranges; i++) {
+        cursors[i].scan = 0;
+        cursors[i].node = NULL;
+        if (ranges[i] == ranges[i + 1]) {
+            continue; // an empty range, of a list shorter than the number of ranges
+        }
+        size_t slot = ranges[i];
+        Chunk* chunk = findChunk(posIndex, &slot);
+        cursors[i].scan = posIndex->withScan;
+        cursors[i].pos.chunk = chunk;
+        cursors[i].pos.slot = (int)slot;
+        cursors[i].node = chunk->nodes[slot];
+    }
+}
+
+/** A HELPER FUNCTION
+ * Returns the line at a cursor, with its length and hash, and moves the cursor to the next one.
+ */
+static inline const char* scanCursorNext(ScanCursor* cursor, uint32_t* len, uint32_t* hash) {
+    if (cursor->scan) {
+        const ScanEntry* entry = scanNext(&cursor->pos);
+        *len = entry->len;
+        *hash = entry->hash;
+        return entry->line;
+    }
+    Node* node = cursor->node;
+    cursor->node = node->next;
+    *len = node->len;
+    *hash = node->hash;
+    return node->line;
+}
+
+/** A HELPER FUNCTION
+ * Cuts a scan into ranges, 4 per thread so that the threads finishing first take
+ * more, and places the cursors of list and other (if not NULL) at their starts.
+ * Lists with no Nodes yet (scanned through their mapped lines) need no cursors.
+ * Lists with Nodes need a positional index to find them: without one, the starts
+ * could only be found by walking from the head, a walk as long as the scan itself
+ * (and building the index for it would cost a walk too), so they are scanned serially.
+ * @return 1 on success, 0 if the memory could not be allocated or a list has no
+ * positional index (the caller scans serially).
+ */
+static int scanJobInit(ScanJob* job, const StrList* list, const StrList* other, int nthreads) {
+    memset(job, 0, sizeof(*job));
+    job->list = list;
+    job->other = other;
+    job->nranges = nthreads * 4;
+    int cursors = !list->store->unbuilt;
+    PosIndex* index1 = cursors ? scanIndexOf(list) : NULL;
+    PosIndex* index2 = (cursors && other != NULL) ? scanIndexOf(other) : NULL;
+    if (cursors && (index1 == NULL || (other != NULL && index2 == NULL))) {
+        return 0;
+    }
+    job->ranges = (size_t*)malloc((job->nranges + 1) * sizeof(size_t));
+    job->counts = (size_t*)calloc(job->nranges, sizeof(size_t));
+    job->fingerprints = (uint64_t*)calloc(job->nranges, sizeof(uint64_t));
+    job->starts1 = cursors ? (ScanCursor*)malloc(job->nranges * sizeof(ScanCursor)) : NULL;
+    job->starts2 = (cursors && other != NULL) ? (ScanCursor*)malloc(job->nranges * sizeof(ScanCursor)) : NULL;
+    STATS_BYTES(job->nranges * (2 * sizeof(size_t) + sizeof(uint64_t) + 2 * sizeof(ScanCursor)));
+    if (job->ranges == NULL || job->counts == NULL || job->fingerprints == NULL
+            || (cursors && job->starts1 == NULL) || (cursors && other != NULL && job->starts2 == NULL)) {
+        return 0;
+    }
+    atomic_init(&job->stop, 0);
+    size_t size = list->store->size;
+    for (int i = 0; i <= job->nranges; i++) {
+        job->ranges[i] = size / job->nranges * i + size % job->nranges * i / job->nranges;
+    }
+    if (cursors) {
+        scanCursorsAt(index1, job->ranges, job->nranges, job->starts1);
+        if (other != NULL) {
+            scanCursorsAt(index2, job->ranges, job->nranges, job->starts2);
+        }
+    }
+    return 1;
+}
+
+/** A HELPER FUNCTION
+ * Frees the arrays of a scan job.
+ */
+static void scanJobFree(ScanJob* job) {
+    free(job->ranges);
+    free(job->counts);
+    free(job->fingerprints);
+    free(job->starts1);
+    free(job->starts2);
+}
+
+/** A HELPER FUNCTION
+ * Takes the threads of the parallel scans and sorts, scanPool, for nthreads threads.
+ * The pool is created by the first parallel scan or sort of the process and kept
+ * for the next ones (recreated when one asks for another number of threads, e.g.
+ * after StrList_setParallelScan). A caller that finds the pool busy with another
+ * thread doesn't wait for it: it runs serially instead.
+ * @return The pool, to give back with scanPoolRelease, or NULL if the threads
+ *         could not be started or are busy.
+ */
+static ThreadPool* scanPoolAcquire(int nthreads) {
+    if (pthread_mutex_trylock(&scanPoolLock) != 0) {
+        return NULL;
+    }
+    if (scanPool != NULL && ThreadPool_size(scanPool) != nthreads) {
+        ThreadPool_free(scanPool);
+        scanPool = NULL;
+    }
+    if (scanPool == NULL) {
+        scanPool = ThreadPool_alloc(nthreads);
+    }
+    if (scanPool == NULL) {
+        pthread_mutex_unlock(&scanPoolLock);
+    }
+    return scanPool;
+}
+
+/** A HELPER FUNCTION
+ * Gives back the pool taken by scanPoolAcquire.
+ */
+static void scanPoolRelease(void) {
+    pthread_mutex_unlock(&scanPoolLock);
+}
+
+/** A HELPER FUNCTION
+ * Runs task on every range of a scan job, on nthreads threads (see scanPoolAcquire).
+ * @return 1 on success, 0 if the threads could not be started or are busy.
+ */
+static int scanJobRun(ScanJob* job, int nthreads, void (*task)(void* ctx, int i)) {
+    ThreadPool* pool = scanPoolAcquire(nthreads);
+    if (pool == NULL) {
+        return 0;
+    }
+    ThreadPool_parallelFor(pool, job->nranges, task, job);
+    scanPoolRelease();
+    return 1;
+}
+
+/** A HELPER FUNCTION
+ * Task of a parallel count: counts the lines of range i equal to the string of the job.
+ */
+static void countRangeTask(void* ctx, int i) {
+    ScanJob* job = (ScanJob*)ctx;
+    size_t from = job->ranges[i], to = job->ranges[i + 1];
+    size_t count = 0;
+    if (job->list->store->unbuilt) {
+        for (size_t k = from; k < to; k++) {
+            size_t lineLen;
+            const char* line = mappedLine(job->list->store->map, k, &lineLen);
+            if (lineLen == job->len && (STATS_COMPARE(), StrKernels_equal(line, job->data, job->len))) {
+                count++;
+            }
+        }
+    } else {
+        ScanCursor cursor = job->starts1[i];
+        for (size_t k = from; k < to; k++) {
+            uint32_t len, hash;
+            const char* line = scanCursorNext(&cursor, &len, &hash);
+            if (job->interned != NULL ? line == job->interned
+                    : hash == job->hash && len == job->len && (STATS_COMPARE(), StrKernels_equal(line, job->data, len))) {
+                count++;
+            }
+        }
+    }
+    job->counts[i] = count;
+    STATS_NODES(to - from);
+    STATS_FLUSH(); // the workers run no operation that would add their counts
+}
+
+/** A HELPER FUNCTION
+ * Task of a parallel isEqual: compares range i of the two lists and computes its
+ * fingerprint, as if the range were a list of its own.
+ */
+static void equalRangeTask(void* ctx, int i) {
+    ScanJob* job = (ScanJob*)ctx;
+    size_t from = job->ranges[i], to = job->ranges[i + 1];
+    ScanCursor cursor1 = job->starts1[i];
+    ScanCursor cursor2 = job->starts2[i];
+    uint64_t fingerprint = 0;
+    for (size_t k = from; k < to; k++) {
+        if ((k - from) % SCAN_STOP_CHECK == 0 && atomic_load_explicit(&job->stop, memory_order_relaxed)) {
+            break;
+        }
+        uint32_t len1, hash1, len2, hash2;
+        const char* line1 = scanCursorNext(&cursor1, &len1, &hash1);
+        const char* line2 = scanCursorNext(&cursor2, &len2, &hash2);
+        if (job->internedLines ? line1 != line2
+                : hash1 != hash2 || len1 != len2 || (STATS_COMPARE(), !StrKernels_equal(line1, line2, len1))) {
+            atomic_store_explicit(&job->stop, 1, memory_order_relaxed);
+            break;
+        }
+        fingerprint = fingerprintStep(fingerprint, hash1);
+        STATS_NODES(2);
+    }
+    job->fingerprints[i] = fingerprint;
+    STATS_FLUSH();
+}
+
+/** A HELPER FUNCTION
+ * Task of a parallel isSorted of a list with no Nodes yet: looks for a descent
+ * between the lines of range i and the line before each of them.
+ */
+static void sortedRangeTask(void* ctx, int i) {
+    ScanJob* job = (ScanJob*)ctx;
+    size_t from = job->ranges[i], to = job->ranges[i + 1];
+    // the lines of a reversed list are in order when they descend from the head
+    int direction = job->list->reversed ? -1 : 1;
+    for (size_t k = (from > 0) ? from : 1; k < to; k++) {
+        if ((k - from) % SCAN_STOP_CHECK == 0 && atomic_load_explicit(&job->stop, memory_order_relaxed)) {
+            break;
+        }
+        size_t prevLen, len;
+        const char* prev = mappedLine(job->list->store->map, k - 1, &prevLen);
+        const char* line = mappedLine(job->list->store->map, k, &len);
+        STATS_NODES(1);
+        if ((STATS_COMPARE(), StrKernels_compare(prev, prevLen, line, len)) * direction > 0) {
+            atomic_store_explicit(&job->stop, 1, memory_order_relaxed);
+            break;
+        }
+    }
+    STATS_FLUSH();
+}
+
+/** A HELPER FUNCTION
+ * Raises the fingerprint multiplier to the power n: the fingerprint of the lines
+ * A then B is the fingerprint of A times that power for n lines in B, plus the fingerprint of B.
+ */
+static uint64_t fingerprintShift(size_t n) {
+    uint64_t result = 1;
+    uint64_t base = 1099511628211u;
+    for (; n > 0; n >>= 1) {
+        if (n & 1) {
+            result *= base;
+        }
+        base *= base;
+    }
+    return result;
+}
+
+/** A HELPER FUNCTION
+ * Counts the lines of a list equal to data on several threads (see StrList_count).
+ * @param count Set to the number of lines found.
+ * @return 1 on success, 0 if the list is too short for it or the scan could not be started,
+ * and the caller must scan it serially.
+ */
+static int countParallel(const StrList* StrList, const char* data, size_t len, uint32_t hash,
+        const char* interned, size_t* count) {
+    int nthreads = scanThreads(StrList);
+    ScanJob job;
+    if (nthreads <= 1) {
+        return 0;
+    }
+    if (!scanJobInit(&job, StrList, NULL, nthreads)) {
+        scanJobFree(&job);
+        return 0;
+    }
+    job.data = data;
+    job.len = len;
+    job.hash = hash;
+    job.interned = interned;
+    int ran = scanJobRun(&job, nthreads, countRangeTask);
+    *count = 0;
+    for (int i = 0; ran && i < job.nranges; i++) {
+        *count += job.counts[i];
+    }
+    scanJobFree(&job);
+    return ran;
+}
+
+/** A HELPER FUNCTION
+ * Compares two lists of the same size and direction, with Nodes, on several threads
+ * (see StrList_isEqual). Every range stops as soon as one of them finds a difference.
+ * @param internedLines 1 if the lines of both lists are interned, and compared by pointer.
+ * @param equal Set to 1 if the lists are equal, 0 otherwise.
+ * @param fingerprint Set to the fingerprint of the lists when they are equal.
+ * @return 1 on success, 0 if the lists are too short for it or the scan could not be started,
+ * and the caller must compare them serially.
+ */
+static int equalParallel(const StrList* StrList1, const StrList* StrList2, int internedLines,
+        int* equal, uint64_t* fingerprint) {
+    int nthreads = scanThreads(StrList1);
+    ScanJob job;
+    if (nthreads <= 1) {
+        return 0;
+    }
+    if (!scanJobInit(&job, StrList1, StrList2, nthreads)) {
+        scanJobFree(&job);
+        return 0;
+    }
+    job.internedLines = internedLines;
+    int ran = scanJobRun(&job, nthreads, equalRangeTask);
+    *equal = !atomic_load(&job.stop);
+    *fingerprint = 0;
+    for (int i = 0; i < job.nranges; i++) {
+        *fingerprint = *fingerprint * fingerprintShift(job.ranges[i + 1] - job.ranges[i]) + job.fingerprints[i];
+    }
+    scanJobFree(&job);
+    return ran;
+}
+
+/** A HELPER FUNCTION
+ * Tells on several threads whether a list with no Nodes yet is sorted (see StrList_isSorted).
+ * Every range stops as soon as one of them finds a descent.
+ * @param sorted Set to 1 if the list is sorted, 0 otherwise.
+ * @return 1 on success, 0 if the list is too short for it or the scan could not be started,
+ * and the caller must scan it serially.
+ */
+static int isSortedParallel(const StrList* StrList, int* sorted) {
+    int nthreads = scanThreads(StrList);
+    ScanJob job;
+    if (nthreads <= 1) {
+        return 0;
+    }
+    if (!scanJobInit(&job, StrList, NULL, nthreads)) {
+        scanJobFree(&job);
+        return 0;
+    }
+    int ran = scanJobRun(&job, nthreads, sortedRangeTask);
+    *sorted = !atomic_load(&job.stop);
+    scanJobFree(&job);
+    return ran;
+}
+
+/**
+ * Returns the number of nodes holding the given string.
+ * With a hash index this is a single lookup, otherwise the function scans the list
+ * (through its ScanEntry arrays if it is chunked, through the mapped lines if it was
+ * loaded from a snapshot and has no Nodes yet; a hash index gets them built).
+ * A STRLIST_SORTED list without a hash index finds the first one by binary search. Only the nodes with the same
+ * hash and length as data get their string compared, and in intern mode none do:
+ * the lines are compared by pointer to the interned copy of data.
+ * The scan of a long list is split into ranges counted on several threads (see
+ * StrList_setParallelScan), that start from the positional index of the list: a list
+ * without one (after a sort, say) is scanned serially rather than walked to find them.
+ * @param StrList The list to search.
+ * @param data The string to count.
+ * @return The number of occurrences of data in the list.
+ */
+int StrList_count(StrList* StrList, const char* data) {
+    STATS_OP(STATS_OP_COUNT);
+    LOCK_READ(StrList);
+    if (StrList == NULL || data == NULL) {
+        return 0; // nothing to check
+    }
+    size_t len = strlen(data);
+    int count = 0;
+    size_t found;
+    if (StrList->store->unbuilt && (StrList->store->index == NULL || !buildNodes(StrList))) {
+        if (countParallel(StrList, data, len, 0, NULL, &found)) {
+            return (int)found;
+        }
+        STATS_NODES(StrList->store->size);
+        for (size_t i = 0; i < StrList->store->size; i++) {
+            size_t lineLen;
+            const char* line = mappedLine(StrList->store->map, i, &lineLen);
+            if (lineLen == len && (STATS_COMPARE(), StrKernels_equal(line, data, len))) {
+                count++;
+            }
+        }
+        return count;
+    }
+    uint32_t hash = hashLine(data, len);
+    if (StrList->store->index != NULL) {
+        HashSlot* slot = HashIndex_find(StrList->store->index, data, len, hash);
+        return (int)slot->count;
+    }
+    if (StrList->store->flags & STRLIST_SORTED) {
+        size_t pos;
+        Node* node = findSorted(StrList, data, len, 1, &pos);
+        for (; node != NULL && nodeHolds(node, data, len, hash); node = node->next) {
+            count++;
+        }
+        STATS_NODES(count);
+        return count;
+    }
+    const char* interned = NULL;
+    if (StrList->store->flags & STRLIST_INTERN) {
+        interned = Intern_find(data, len, hash);
+        if (interned == NULL) {
+            return 0; // no list holds data
+        }
+    }
+
+    if (countParallel(StrList, data, len, hash, interned, &found)) {
+        return (int)found;
+    }
+    STATS_NODES(StrList->store->size);
+    ScanPos pos;
+    if (scanBegin(StrList, &pos)) {
+        const ScanEntry* entry;
+        while ((entry = scanNext(&pos)) != NULL) {
+            if (interned != NULL ? entry->line == interned
+                    : entry->hash == hash && entry->len == len && (STATS_COMPARE(), StrKernels_equal(entry->line, data, len))) {
+                count++;
+            }
+        }
+        return count;
+    }
+    Node *current = StrList->store->head;
+    while(current != NULL){
+        if(interned != NULL ? current->line == interned : nodeHolds(current, data, len, hash)){
+            count++;
+        }
+        current = current->next;
+    }
+
+    return count;
+}
+
+/** A HELPER FUNCTION
+ * Removes the nodes holding a line without scanning the list: the chain of the line
+ * in the hash index, or its run found by binary search in STRLIST_SORTED mode.
+ * @return 1 if the list could find them that way, 0 if it has to be scanned.
+ */
+static int removeFound(StrList* StrList, const char* data, size_t len, uint32_t hash) {
+    if (StrList->store->index != NULL) {
+        HashSlot* slot = HashIndex_find(StrList->store->index, data, len, hash);
+        Node* currNode = slot->nodes;
+        if (currNode == NULL) {
+            return 1;
+        }
+        STATS_NODES(slot->count); // before the erase, which reuses the slot
+        HashIndex_erase(StrList->store->index, slot);
+        while (currNode != NULL) {
+            Node* tempNode = currNode;
+            currNode = linksOf(currNode)->hashNext;
+            posIndexRemove(StrList, tempNode, SIZE_MAX);
+            unlinkNode(StrList, tempNode);
+            Node_free(StrList, tempNode);
+        }
+        return 1;
+    }
+    if (StrList->store->flags & STRLIST_SORTED) {
+        size_t pos;
+        Node* currNode = findSorted(StrList, data, len, 1, &pos);
+        while (currNode != NULL && nodeHolds(currNode, data, len, hash)) {
+            Node* tempNode = currNode;
+            currNode = currNode->next;
+            posIndexRemove(StrList, tempNode, pos); // the next one takes its position
+            unlinkNode(StrList, tempNode);
+            Node_free(StrList, tempNode);
+        }
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @param StrList: A pointer to the StrList.
+ * @param data: The string to match with node's line.
+ * With a hash index the function goes straight to the chain of nodes holding data,
+ * so it only visits the k removed nodes, and a STRLIST_SORTED list finds the first one
+ * by binary search and removes the run that follows. Otherwise it iterates over the StrList,
+ * and every node whose line matches the input string (the interned copy of it, compared
+ * by pointer, in intern mode) is removed and its memory freed.
+ * Either way head, tail, the prev pointers and the size are kept up to date.
+ */
+void StrList_remove(StrList* StrList, const char* data) {
+    STATS_OP(STATS_OP_REMOVE);
+    LOCK_WRITE(StrList);
+    if (StrList == NULL || StrList->store->size == 0 || data == NULL || !detach(StrList)) {
+        return;
+    }
+
+    size_t len = strlen(data);
+    uint32_t hash = hashLine(data, len);
+    if (removeFound(StrList, data, len, hash)) {
+        return;
+    }
+
+    const char* interned = NULL;
+    if (StrList->store->flags & STRLIST_INTERN) {
+        interned = Intern_find(data, len, hash);
+        if (interned == NULL) {
+            return; // no list holds data
+        }
+    }
+    STATS_NODES(StrList->store->size);
+    Node* currNode = StrList->store->head;
+    size_t pos = 0;
+    while(currNode != NULL) {
+        Node* tempNode = currNode;
+        currNode = currNode->next;
+        if(interned != NULL ? tempNode->line == interned : nodeHolds(tempNode, data, len, hash)) {
+            posIndexRemove(StrList, tempNode, pos);
+            unlinkNode(StrList, tempNode);
+            Node_free(StrList, tempNode);
+        } else {
+            pos++;
+        }
+    }
+}
+
+/**
+ * A set of lines for StrList_removeAll: an open addressing table of cap entries
+ * (a power of 2, at least twice the number of lines), an empty one has line NULL.
+ */
+typedef struct LineSet {
+    const char** lines;
+    uint32_t* lens;
+    uint32_t* hashes;
+    size_t cap;
+} LineSet;
+
+/** A HELPER FUNCTION
+ * Tells whether a set holds a line. Lines in intern mode are compared by pointer.
+ */
+static int LineSet_holds(const LineSet* set, const char* line, uint32_t len, uint32_t hash, int interned) {
+    size_t mask = set->cap - 1;
+    for (size_t i = hash & mask; set->lines[i] != NULL; i = (i + 1) & mask) {
+        if (interned ? set->lines[i] == line
+                : set->hashes[i] == hash && set->lens[i] == len
+                && (STATS_COMPARE(), StrKernels_equal(set->lines[i], line, len))) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/** A HELPER FUNCTION
+ * Builds the set of the given words, or of their interned copies in intern mode
+ * (words no list holds are left out, no node can be equal to them).
+ * @return 1 on success, 0 if the memory could not be allocated.
+ */
+static int LineSet_build(LineSet* set, const char* const* words, size_t count, int interned) {
+    set->cap = 16;
+    while (set->cap < 2 * count) {
+        set->cap *= 2;
+    }
+    set->lines = (const char**)calloc(set->cap, sizeof(const char*));
+    set->lens = (uint32_t*)malloc(set->cap * sizeof(uint32_t));
+    set->hashes = (uint32_t*)malloc(set->cap * sizeof(uint32_t));
+    STATS_BYTES(set->cap * (sizeof(const char*) + 2 * sizeof(uint32_t)));
+    if (set->lines == NULL || set->lens == NULL || set->hashes == NULL) {
+        return 0;
+    }
+    size_t mask = set->cap - 1;
+    for (size_t w = 0; w < count; w++) {
+        if (words[w] == NULL) {
+            continue;
+        }
+        size_t len = strlen(words[w]);
+        if (len > LINE_MAX_LEN) {
+            continue;
+        }
+        uint32_t hash = hashLine(words[w], len);
+        const char* line = interned ? Intern_find(words[w], len, hash) : words[w];
+        if (line == NULL || LineSet_holds(set, line, (uint32_t)len, hash, interned)) {
+            continue;
+        }
+        size_t i = hash & mask;
+        while (set->lines[i] != NULL) {
+            i = (i + 1) & mask;
+        }
+        set->lines[i] = line;
+        set->lens[i] = (uint32_t)len;
+        set->hashes[i] = hash;
+    }
+    return 1;
+}
+
+/** A HELPER FUNCTION
+ * Frees the tables of a set.
+ */
+static void LineSet_free(LineSet* set) {
+    free(set->lines);
+    free(set->lens);
+    free(set->hashes);
+}
+
+/**
+ * The test of a removal sweep: a LineSet, or a predicate of the user.
+ */
+typedef struct Sweep {
+    const LineSet* set;
+    int interned;
+    int (*predicate)(const char* line, void* ctx);
+    void* ctx;
+} Sweep;
+
+/** A HELPER FUNCTION
+ * Removes, in one walk of the list in its order, every node the sweep selects.
+ * The positional index is dropped at the first removal and built again once at the
+ * end (see dropPosIndex) rather than updated for every node, the hash index and
+ * the counters of the list are updated node by node.
+ */
+static void sweepList(StrList* StrList, const Sweep* sweep) {
+    STATS_NODES(StrList->store->size);
+    int removed = 0;
+    Node* node = firstNode(StrList);
+    while (node != NULL) {
+        Node* next = stepNode(StrList, node);
+        if (sweep->set != NULL ? LineSet_holds(sweep->set, node->line, node->len, node->hash, sweep->interned)
+                : sweep->predicate(node->line, sweep->ctx)) {
+            if (!removed && StrList->store->posIndex != NULL) {
+                PosIndex_free(StrList->store->posIndex);
+                StrList->store->posIndex = NULL;
+            }
+            removed = 1;
+            indexRemove(StrList, node);
+            unlinkNode(StrList, node);
+            Node_free(StrList, node);
+        }
+        node = next;
+    }
+    if (removed) {
+        dropPosIndex(StrList);
+    }
+}
+
+/**
+ * Removes every node holding one of the given words, the same as a StrList_remove
+ * of each word but in a single pass: the words go into a hash set built once, and
+ * the list is swept once, at O(n + count) rather than O(n * count).
+ * A list with a hash index, or in STRLIST_SORTED mode, doesn't need the sweep:
+ * every word has its nodes found as StrList_remove finds them, in O(count + removed)
+ * (O(count * log n + removed) when sorted).
+ * @param StrList The list to remove the words from.
+ * @param words The words, NULL ones are skipped.
+ * @param count The number of words.
+ */
+void StrList_removeAll(StrList* StrList, const char* const* words, size_t count) {
+    STATS_OP(STATS_OP_REMOVE_ALL);
+    LOCK_WRITE(StrList);
+    if (StrList == NULL || StrList->store->size == 0 || words == NULL || count == 0 || !detach(StrList)) {
+        return;
+    }
+    if (StrList->store->index != NULL || (StrList->store->flags & STRLIST_SORTED)) {
+        for (size_t w = 0; w < count && StrList->store->size > 0; w++) {
+            if (words[w] != NULL) {
+                size_t len = strlen(words[w]);
+                removeFound(StrList, words[w], len, hashLine(words[w], len));
+            }
+        }
+        return;
+    }
+    LineSet set;
+    Sweep sweep = {&set, (StrList->store->flags & STRLIST_INTERN) != 0, NULL, NULL};
+    if (LineSet_build(&set, words, count, sweep.interned)) {
+        sweepList(StrList, &sweep);
+    }
+    LineSet_free(&set);
+}
+
+/**
+ * Removes every node whose line the predicate accepts, in one pass over the list.
+ * The predicate is called once per node, in the order of the list, and must not use the list.
+ * @param StrList The list to remove the lines from.
+ * @param predicate Returns non-zero for the lines to remove, given each line and ctx.
+ * @param ctx Passed to the predicate.
+ */
+void StrList_removeIf(StrList* StrList, int (*predicate)(const char* line, void* ctx), void* ctx) {
+    STATS_OP(STATS_OP_REMOVE_IF);
+    LOCK_WRITE(StrList);
+    if (StrList == NULL || StrList->store->size == 0 || predicate == NULL || !detach(StrList)) {
+        return;
+    }
+    Sweep sweep = {NULL, 0, predicate, ctx};
+    sweepList(StrList, &sweep);
+}
+
+/** A HELPER FUNCTION
+ * Tells whether the prefix functions can use the prefix index of a list. Only
+ * STRLIST_PREFIX_INDEX lists have one; if it was dropped because it couldn't grow
+ * it is rebuilt from the lines, except by the read functions of STRLIST_CONCURRENT
+ * lists, which run in parallel.
+ * @param writing Whether the caller holds the list to change it.
+ * @return 1 if the list has its prefix index, 0 if it must be scanned instead.
+ */
+static int prefixIndexReady(StrList* StrList, int writing) {
+    if (!(StrList->store->flags & STRLIST_PREFIX_INDEX) || !buildNodes(StrList)) {
+        return 0;
+    }
+    Store* store = StrList->store;
+    int locked = Store_lockCaches(store);
+    if (store->prefixIndex == NULL && (writing || !(store->flags & STRLIST_CONCURRENT))) {
+        store->prefixIndex = TrieNode_alloc("", 0);
+        for (Node* node = store->head; node != NULL && store->prefixIndex != NULL; node = node->next) {
+            prefixIndexAdd(StrList, node->line, node->len);
+        }
+        STATS_NODES(store->size);
+    }
+    int ready = store->prefixIndex != NULL;
+    Store_unlockCaches(store, locked);
+    return ready;
+}
+
+/** A HELPER FUNCTION
+ * Tells whether a line of lineLen chars starts with the len chars of prefix.
+ */
+static int startsWith(const char* line, size_t lineLen, const char* prefix, size_t len) {
+    return lineLen >= len && (STATS_COMPARE(), StrKernels_equal(line, prefix, len));
+}
+
+/**
+ * Returns the number of elements of a list that start with the given prefix.
+ * With its prefix index (STRLIST_PREFIX_INDEX mode) this is a walk down the path of
+ * the prefix, in O(|prefix|): every node of the trie counts the elements below it.
+ * Otherwise the list is scanned.
+ * @param StrList The list to search.
+ * @param prefix The prefix ("" for all the elements).
+ * @return The number of elements starting with prefix.
+ */
+int StrList_countPrefix(StrList* StrList, const char* prefix) {
+    STATS_OP(STATS_OP_COUNT_PREFIX);
+    LOCK_READ(StrList);
+    if (StrList == NULL || prefix == NULL) {
+        return 0;
+    }
+    size_t len = strlen(prefix);
+    if (prefixIndexReady(StrList, 0)) {
+        TrieNode* node = prefixIndexFind(StrList->store->prefixIndex, prefix, len, NULL);
+        return (node != NULL) ? (int)node->count : 0;
+    }
+    int count = 0;
+    STATS_NODES(StrList->store->size);
+    if (StrList->store->unbuilt) {
+        for (size_t i = 0; i < StrList->store->size; i++) {
+            size_t lineLen;
+            const char* line = mappedLine(StrList->store->map, i, &lineLen);
+            count += startsWith(line, lineLen, prefix, len);
+        }
+        return count;
+    }
+    for (Node* node = StrList->store->head; node != NULL; node = node->next) {
+        count += startsWith(node->line, node->len, prefix, len);
+    }
+    return count;
+}
+
+/**
+ * The lines visited by a walk of the prefix index (see prefixIndexWalk): path holds
+ * the chars of the current node, visit gets the lines (at most left more of them).
+ * For StrList_removePrefix, lines collects them instead, one after the other with their '\0'.
+ */
+typedef struct TrieWalk {
+    char* path;
+    size_t cap;
+    size_t left;
+    void (*visit)(const char* word, size_t count, void* ctx);
+    void* ctx;
+    char* lines;
+    size_t used;
+    size_t size;
+    int failed;
+} TrieWalk;
+
+/** A HELPER FUNCTION
+ * Appends len chars to a growing buffer.
+ * @return 1 on success, 0 if the buffer could not grow.
+ */
+static int appendChars(char** buf, size_t* cap, size_t used, const char* chars, size_t len) {
+    if (len == 0) {
+        return 1;
+    }
+    if (used + len > *cap) {
+        size_t newCap = (*cap > 0) ? *cap : 64;
+        while (newCap < used + len) {
+            newCap *= 2;
+        }
+        char* grown = (char*)realloc(*buf, newCap);
+        if (grown == NULL) {
+            return 0;
+        }
+        STATS_BYTES(newCap - *cap);
+        *buf = grown;
+        *cap = newCap;
+    }
+    memcpy(*buf + used, chars, len);
+    return 1;
+}
+
+/** A HELPER FUNCTION
+ * Visits the distinct lines of a subtree of the prefix index in strcmp order (a line
+ * before the longer ones it starts, the children in the order of their edges), until
+ * walk->left is 0. The path of node, len chars, is in walk->path.
+ */
+static void prefixIndexWalk(const TrieNode* node, TrieWalk* walk, size_t len) {
+    if (walk->left == 0 || walk->failed) {
+        return;
+    }
+    if (node->here > 0) {
+        if (!appendChars(&walk->path, &walk->cap, len, "", 1)) {
+            walk->failed = 1;
+            return;
+        }
+        if (walk->visit != NULL) {
+            walk->visit(walk->path, node->here, walk->ctx);
+        } else if (!appendChars(&walk->lines, &walk->size, walk->used, walk->path, len + 1)) {
+            walk->failed = 1;
+            return;
+        } else {
+            walk->used += len + 1;
+        }
+        walk->left--;
+    }
+    for (uint32_t i = 0; i < node->nchildren && walk->left > 0; i++) {
+        const TrieNode* child = node->children[i];
+        if (!appendChars(&walk->path, &walk->cap, len, child->label, child->labelLen)) {
+            walk->failed = 1;
+            return;
+        }
+        prefixIndexWalk(child, walk, len + child->labelLen);
+    }
+}
+
+/** A HELPER FUNCTION
+ * Walks the subtree of the prefix index holding the lines that start with prefix
+ * (see prefixIndexWalk). Its path is the start of prefix and the edge into its root.
+ */
+static void prefixIndexVisit(const TrieNode* root, const char* prefix, size_t len, TrieWalk* walk) {
+    size_t start;
+    const TrieNode* node = prefixIndexFind(root, prefix, len, &start);
+    if (node == NULL) {
+        return;
+    }
+    if (!appendChars(&walk->path, &walk->cap, 0, prefix, start)
+            || !appendChars(&walk->path, &walk->cap, start, node->label, node->labelLen)) {
+        walk->failed = 1;
+        return;
+    }
+    prefixIndexWalk(node, walk, start + node->labelLen);
+}
+
+/**
+ * The prefix of a StrList_removePrefix sweep.
+ */
+typedef struct PrefixMatch {
+    const char* prefix;
+    size_t len;
+} PrefixMatch;
+
+/** A HELPER FUNCTION
+ * The predicate of a StrList_removePrefix sweep.
+ */
+static int matchesPrefix(const char* line, void* ctx) {
+    const PrefixMatch* match = (const PrefixMatch*)ctx;
+    return strncmp(line, match->prefix, match->len) == 0;
+}
+
+/**
+ * Removes every element of a list that starts with the given prefix.
+ * With its prefix index (STRLIST_PREFIX_INDEX mode, which brings a hash index
+ * outside STRLIST_SORTED mode) the distinct lines below the prefix are read from the
+ * trie and their nodes found as StrList_remove finds them, in O(|prefix| + removed).
+ * Otherwise the list is swept once (see sweepList), or not at all if its prefix
+ * index has no line starting with prefix.
+ * The prefix index is kept up to date node by node either way.
+ * @param StrList The list to remove the elements from.
+ * @param prefix The prefix ("" for all the elements).
+ */
+void StrList_removePrefix(StrList* StrList, const char* prefix) {
+    STATS_OP(STATS_OP_REMOVE_PREFIX);
+    LOCK_WRITE(StrList);
+    if (StrList == NULL || StrList->store->size == 0 || prefix == NULL || !detach(StrList)) {
+        return;
+    }
+    size_t len = strlen(prefix);
+    int indexed = prefixIndexReady(StrList, 1);
+    if (indexed && prefixIndexFind(StrList->store->prefixIndex, prefix, len, NULL) == NULL) {
+        return; // no element starts with prefix
+    }
+    if (indexed && (StrList->store->index != NULL || (StrList->store->flags & STRLIST_SORTED))) {
+        // the lines are collected first: removing them changes the trie
+        TrieWalk walk;
+        memset(&walk, 0, sizeof(walk));
+        walk.left = SIZE_MAX;
+        prefixIndexVisit(StrList->store->prefixIndex, prefix, len, &walk);
+        for (size_t i = 0; !walk.failed && i < walk.used; ) {
+            size_t lineLen = strlen(walk.lines + i);
+            removeFound(StrList, walk.lines + i, lineLen, hashLine(walk.lines + i, lineLen));
+            i += lineLen + 1;
+        }
+        free(walk.path);
+        free(walk.lines);
+        if (!walk.failed) {
+            return;
+        }
+    }
+    PrefixMatch match = {prefix, len};
+    Sweep sweep = {NULL, 0, matchesPrefix, &match};
+    sweepList(StrList, &sweep);
+}
+
+/** A HELPER FUNCTION
+ * Compares two lines given by pointers to them, for qsort.
+ */
+static int compareLinePtrs(const void* a, const void* b) {
+    return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+/** A HELPER FUNCTION
+ * Lists the lines of a list that start with prefix without its prefix index (see
+ * StrList_listPrefix): they are gathered in an array, sorted and visited by runs of equal ones.
+ * @return The number of distinct lines visited.
+ */
+static size_t listPrefixScan(StrList* StrList, const char* prefix, size_t len, size_t n,
+        void (*visit)(const char* word, size_t count, void* ctx), void* ctx) {
+    Store* store = StrList->store;
+    size_t found = 0;
+    const char** lines = (const char**)malloc((store->size > 0 ? store->size : 1) * sizeof(const char*));
+    if (lines == NULL) {
+        return 0;
+    }
+    STATS_BYTES(store->size * sizeof(const char*));
+    STATS_NODES(store->size);
+    if (store->unbuilt) {
+        for (size_t i = 0; i < store->size; i++) {
+            size_t lineLen;
+            const char* line = mappedLine(store->map, i, &lineLen);
+            if (startsWith(line, lineLen, prefix, len)) {
+                lines[found++] = line;
+            }
+        }
+    } else {
+        for (Node* node = store->head; node != NULL; node = node->next) {
+            if (startsWith(node->line, node->len, prefix, len)) {
+                lines[found++] = node->line;
+            }
+        }
+    }
+    qsort(lines, found, sizeof(const char*), compareLinePtrs);
+    size_t visited = 0;
+    for (size_t i = 0; i < found && visited < n; visited++) {
+        size_t j = i + 1;
+        while (j < found && strcmp(lines[j], lines[i]) == 0) {
+            j++;
+        }
+        visit(lines[i], j - i, ctx);
+        i = j;
+    }
+    free(lines);
+    return visited;
+}
+
+/**
+ * Lists the distinct elements of a list that start with the given prefix, in strcmp
+ * order, up to n of them: the completions of prefix, first ones first.
+ * With the prefix index this walks down the path of the prefix then the subtree
+ * below it, in O(|prefix| + the chars of the lines visited), without looking at the
+ * elements that are not listed. Otherwise the matching elements are gathered and sorted.
+ * @param StrList The list to search.
+ * @param prefix The prefix ("" for all the elements).
+ * @param n The most lines to visit.
+ * @param visit Called with each line (valid during the call only), the number of
+ *              elements holding it and ctx. It must not use the list.
+ * @param ctx Passed to visit.
+ * @return The number of lines visited.
+ */
+size_t StrList_listPrefix(StrList* StrList, const char* prefix, size_t n,
+        void (*visit)(const char* word, size_t count, void* ctx), void* ctx) {
+    STATS_OP(STATS_OP_LIST_PREFIX);
+    LOCK_READ(StrList);
+    if (StrList == NULL || prefix == NULL || visit == NULL || n == 0) {
+        return 0;
+    }
+    size_t len = strlen(prefix);
+    if (!prefixIndexReady(StrList, 0)) {
+        return listPrefixScan(StrList, prefix, len, n, visit, ctx);
+    }
+    TrieWalk walk;
+    memset(&walk, 0, sizeof(walk));
+    walk.left = n;
+    walk.visit = visit;
+    walk.ctx = ctx;
+    prefixIndexVisit(StrList->store->prefixIndex, prefix, len, &walk);
+    free(walk.path);
+    return n - walk.left;
+}
+
+void StrList_removeAt(StrList* StrList, int index) {
+    STATS_OP(STATS_OP_REMOVE_AT);
+    LOCK_WRITE(StrList);
+    if (StrList == NULL || index < 0 || (size_t)index >= StrList->store->size || !detach(StrList)) {
+        return;
+    }
+    size_t pos = nodePos(StrList, (size_t)index);
+    Node* current = getNodeAt(StrList, (int)pos);
+    if (current == NULL) {
+        return; // Invalid input or index out of bounds
+    }
+    removeNodeAt(StrList, current, pos);
+}
+
+/** A HELPER FUNCTION
+ * Records the fingerprint of a list computed by a full walk (it is a cache, hence the cast of the const list),
+ * unless the list is STRLIST_CONCURRENT.
+ */
+static void setFingerprint(const StrList* StrList, uint64_t fingerprint) {
+    if (StrList->store->flags & STRLIST_CONCURRENT) {
+        return; // concurrent readers don't write
+    }
+    int locked = Store_lockCaches(StrList->store);
+    StrList->store->fingerprint = fingerprint;
+    StrList->store->fingerprintValid = 1;
+    Store_unlockCaches(StrList->store, locked);
+}
+
+/** A HELPER FUNCTION
+ * Reads the fingerprint recorded for a list, if it is up to date.
+ * @return 1 if it is, 0 if the list must be walked to know it.
+ */
+static int getFingerprint(const StrList* StrList, uint64_t* fingerprint) {
+    int locked = Store_lockCaches(StrList->store);
+    int valid = StrList->store->fingerprintValid;
+    *fingerprint = StrList->store->fingerprint;
+    Store_unlockCaches(StrList->store, locked);
+    return valid;
+}
+
+/**
+ * This function compares two StrLists. 
+ * It first checks for NULL lists, unequal sizes, unequal total lengths and (when both are
+ * up to date) unequal fingerprints, returning 0 if any condition is met. 
+ * It treats two NULL lists as equal and returns 1.
+ * Then, it iterates through both lists simultaneously (through the ScanEntry arrays of two chunked lists),
+ * comparing the cached hashes and lengths of each pair, and the strings only when those match
+ * (two lists in intern mode compare the pointers to their interned lines instead).
+ * If any pair is unequal, it returns 0 immediately.
+ * Long lists are compared on several threads (see StrList_setParallelScan), a range
+ * each, and every thread stops once one of them finds a difference.
+ * If it completes the iteration without finding unequal pairs, it returns 1, and both lists
+ * get the fingerprint computed along the way.
+ * The fingerprints and the ScanEntry arrays follow the Nodes, not the direction of the lists,
+ * so a list compared with a list of the other direction is walked node by node and keeps them.
+ * @param StrList1 A pointer to the first StrList.
+ * @param StrList2 A pointer to the second StrList.
+ * @return Returns 1 if the two StrLists are equal, and 0 otherwise.
+ */
+int StrList_isEqual(const StrList* StrList1, const StrList* StrList2) {
+    STATS_OP(STATS_OP_IS_EQUAL);
+    // two locks are always taken in address order, so that two isEqual can't deadlock
+    const StrList* lower = ((uintptr_t)StrList1 < (uintptr_t)StrList2) ? StrList1 : StrList2;
+    const StrList* upper = (lower == StrList1) ? StrList2 : StrList1;
+    Guard guard1 __attribute__((cleanup(Guard_release))) = Guard_read(lower);
+    Guard guard2 __attribute__((cleanup(Guard_release))) = Guard_read(upper != lower ? upper : NULL);
+    if (StrList1 == NULL && StrList2 == NULL) {
+        return 1;
+    }
+
+    if ((StrList1 == NULL && StrList2 != NULL) || (StrList1 != NULL && StrList2 == NULL) || (StrList1->store->size != StrList2->store->size)) {
+        return 0;
+    }
+    int sameDirection = StrList1->reversed == StrList2->reversed;
+    if (StrList1->store == StrList2->store && sameDirection) {
+        return 1; // a list and its clones, before any change
+    }
+    if (StrList1->store->chars != StrList2->store->chars) {
+        return 0;
+    }
+    uint64_t fingerprint1, fingerprint2;
+    if (sameDirection && getFingerprint(StrList1, &fingerprint1) && getFingerprint(StrList2, &fingerprint2)) {
+        if (fingerprint1 != fingerprint2) {
+            return 0;
+        }
+    }
+    if (!buildNodes(StrList1) || !buildNodes(StrList2)) {
+        return 0; // a list loaded from a snapshot could not get its Nodes
+    }
+
+    // equal interned lines are the same pointer
+    int interned = (StrList1->store->flags & StrList2->store->flags & STRLIST_INTERN) != 0;
+    uint64_t fingerprint = 0;
+    ScanPos pos1, pos2;
+    if (!sameDirection) {
+        Node* current1 = firstNode(StrList1);
+        Node* current2 = firstNode(StrList2);
+        for (; current1 != NULL && current2 != NULL; current1 = stepNode(StrList1, current1), current2 = stepNode(StrList2, current2)) {
+            STATS_NODES(2);
+            if (interned ? current1->line != current2->line
+                    : !nodeHolds(current1, current2->line, current2->len, current2->hash)) {
+                return 0;
+            }
+        }
+        return 1;
+    }
+    int equal;
+    if (equalParallel(StrList1, StrList2, interned, &equal, &fingerprint)) {
+        if (!equal) {
+            return 0;
+        }
+    } else if (scanBegin(StrList1, &pos1) && scanBegin(StrList2, &pos2)) {
+        const ScanEntry* entry1;
+        const ScanEntry* entry2;
+        while ((entry1 = scanNext(&pos1)) != NULL && (entry2 = scanNext(&pos2)) != NULL) {
+            STATS_NODES(2);
+            if (interned ? entry1->line != entry2->line
+                    : entry1->hash != entry2->hash || entry1->len != entry2->len
+                    || (STATS_COMPARE(), !StrKernels_equal(entry1->line, entry2->line, entry1->len))) {
+                return 0;
+            }
+            fingerprint = fingerprintStep(fingerprint, entry1->hash);
+        }
+    } else {
+        Node *current1 = StrList1->store->head;
+        Node *current2 = StrList2->store->head;
+
+        while (current1 != NULL && current2 != NULL) {
+            STATS_NODES(2);
+            // If any pair of elements is unequal, the lists are not equal
+            if (interned ? current1->line != current2->line
+                    : !nodeHolds(current1, current2->line, current2->len, current2->hash)) {
+                return 0;
+            }
+            fingerprint = fingerprintStep(fingerprint, current1->hash);
+            current1 = current1->next;
+            current2 = current2->next;
+        }
+    }
+
+    setFingerprint(StrList1, fingerprint);
+    setFingerprint(StrList2, fingerprint);
+    return 1;
+}
+
+
+/**
+ * This function clones a given StrList in O(1).
+ * The clone shares the Store of the given StrList, whose reference count goes up;
+ * the Nodes are only copied when one of the lists sharing them is changed
+ * (see detach), so clones that are only read cost no memory.
+ * @param StrList A pointer to the StrList to clone.
+ * @return A pointer to the newly allocated StrList, or NULL if the allocation failed.
+ */
+StrList* StrList_clone(const StrList* StrList) {
+    STATS_OP(STATS_OP_CLONE);
+    LOCK_READ(StrList);
+    if(StrList == NULL){
+        return NULL;
+    }
+    struct _StrList* clone = (struct _StrList*)malloc(sizeof(struct _StrList));
+    if (clone == NULL) {
+        return NULL; // Return NULL if memory allocation failed
+    }
+    STATS_BYTES(sizeof(struct _StrList));
+    clone->sync = NULL;
+    if (StrList->sync != NULL) {
+        clone->sync = Sync_alloc(StrList->sync->flags);
+        if (clone->sync == NULL) {
+            free(clone);
+            return NULL;
+        }
+    }
+    atomic_fetch_add_explicit(&StrList->store->refs, 1, memory_order_relaxed);
+    clone->store = StrList->store;
+    clone->reversed = StrList->reversed;
+    return clone;
+}
+
+/**
+ * This function reverses the order of nodes in a given StrList, in O(1).
+ * It first checks if the StrList is NULL or has less than two nodes.
+ * If so, it returns immediately as there's nothing to reverse.
+ * Otherwise it flips the direction of the list: the Nodes, which may be shared with
+ * clones, stay as they are and every function walks them from the tail through the
+ * prev pointers instead. StrList_sort is the only one to put them back in order.
+ * A STRLIST_SORTED list is left as it is.
+ * @param StrList A pointer to the StrList to be reversed.
+ */
+void StrList_reverse(StrList* StrList) {
+    STATS_OP(STATS_OP_REVERSE);
+    LOCK_WRITE(StrList);
+    if (StrList == NULL || StrList->store->size < 2 || (StrList->store->flags & STRLIST_SORTED)) {
+        return; // Nothing to reverse
+    }
+    StrList->reversed = !StrList->reversed;
+}
+/** A HELPER FUNCTION
+ * Sorts a chain of nodes with a bottom-up merge sort.
+ * The chain is split into runs of 1, 2, 4... nodes and every pair of neighbouring
+ * runs is merged by relinking the next pointers, so no memory is allocated.
+ * Equal lines keep their order (the sort is stable).
+ * Only the next pointers are valid on return, the caller fixes prev and tail.
+ * @param head The first node of a NULL terminated chain.
+ * @return The first node of the sorted chain.
+ */
+static Node* mergeSortNodes(Node* head) {
+    size_t runLen = 1;
+    while (1) {
+        Node* p = head;
+        Node* last = NULL;
+        size_t merges = 0;
+        head = NULL;
+        while (p != NULL) {
+            merges++;
+            // q starts runLen nodes after p
+            Node* q = p;
+            size_t pLen = 0;
+            while (pLen < runLen && q != NULL) {
+                q = q->next;
+                pLen++;
+            }
+            size_t qLen = runLen;
+            while (pLen > 0 || (qLen > 0 && q != NULL)) {
+                Node* next;
+                if (pLen == 0) {
+                    next = q; q = q->next; qLen--;
+                } else if (qLen == 0 || q == NULL || (STATS_COMPARE(), StrKernels_compare(p->line, p->len, q->line, q->len)) <= 0) {
+                    next = p; p = p->next; pLen--;
+                } else {
+                    next = q; q = q->next; qLen--;
+                }
+                if (last == NULL) {
+                    head = next;
+                } else {
+                    last->next = next;
+                }
+                last = next;
+            }
+            p = q;
+        }
+        last->next = NULL;
+        if (merges <= 1) {
+            return head;
+        }
+        runLen *= 2;
+    }
+}
+
+/** A HELPER FUNCTION
+ * Returns the char of node's line at depth, or 0 past its end.
+ * Only called with depth <= strlen(line), the strings before it being equal.
+ */
+static int charAt(const Node* node, size_t depth) {
+    return (unsigned char)node->line[depth];
+}
+
+/** A HELPER FUNCTION
+ * Sorts small ranges with insertion sort, comparing from depth on
+ * (all the lines in the range share their first depth chars).
+ */
+static void insertionSortNodes(Node** nodes, size_t n, size_t depth) {
+    for (size_t i = 1; i < n; i++) {
+        Node* curr = nodes[i];
+        size_t j = i;
+        while (j > 0 && (STATS_COMPARE(), StrKernels_compare(nodes[j - 1]->line + depth, nodes[j - 1]->len - depth,
+                                                             curr->line + depth, curr->len - depth)) > 0) {
+            nodes[j] = nodes[j - 1];
+            j--;
+        }
+        nodes[j] = curr;
+    }
+}
+
+/** A HELPER FUNCTION
+ * Returns how many chars, from depth on, all the lines of a range share: each line
+ * is compared with the first one by the mismatch kernel, so a long shared prefix
+ * costs one pass over the range instead of one partition per char.
+ * Never goes past the end of a line.
+ */
+static size_t commonPrefixFrom(Node** nodes, size_t n, size_t depth) {
+    const Node* first = nodes[0];
+    size_t common = first->len - depth;
+    for (size_t i = 1; i < n && common > 0; i++) {
+        size_t len = nodes[i]->len - depth;
+        STATS_COMPARE();
+        common = StrKernels_mismatch(first->line + depth, nodes[i]->line + depth, (len < common) ? len : common);
+    }
+    return common;
+}
+
+/** A HELPER FUNCTION
+ * Sorts an array of nodes with multikey quicksort (Bentley & Sedgewick),
+ * the MSD radix flavour of quicksort.
+ * Each pass partitions the range on a single char at depth into <, = and >
+ * parts, so shared prefixes are looked at once instead of in every comparison.
+ * When a pass leaves the whole range in the = part, the prefix the range shares
+ * is skipped at once (see commonPrefixFrom).
+ * @param nodes The nodes to sort.
+ * @param n The number of nodes.
+ * @param depth The length of the prefix that all the lines in the range share.
+ */
+static void multikeySortNodes(Node** nodes, size_t n, size_t depth) {
+    while (n > SORT_INSERTION_LIMIT) {
+        // median of three pivot, moved to the front
+        size_t mid = n / 2;
+        int a = charAt(nodes[0], depth), b = charAt(nodes[mid], depth), c = charAt(nodes[n - 1], depth);
+        size_t pivotAt = (a < b) ? ((b < c) ? mid : ((a < c) ? n - 1 : 0))
+                                 : ((a < c) ? 0 : ((b < c) ? n - 1 : mid));
+        Node* tmp = nodes[0]; nodes[0] = nodes[pivotAt]; nodes[pivotAt] = tmp;
+        int pivot = charAt(nodes[0], depth);
+
+        // three way partition: [0,lt) < pivot, [lt,gt) == pivot, [gt,n) > pivot
+        size_t lt = 0, i = 1, gt = n;
+        while (i < gt) {
+            int ch = charAt(nodes[i], depth);
+            if (ch < pivot) {
+                tmp = nodes[lt]; nodes[lt] = nodes[i]; nodes[i] = tmp;
+                lt++; i++;
+            } else if (ch > pivot) {
+                gt--;
+                tmp = nodes[gt]; nodes[gt] = nodes[i]; nodes[i] = tmp;
+            } else {
+                i++;
+            }
+        }
+        multikeySortNodes(nodes, lt, depth);
+        multikeySortNodes(nodes + gt, n - gt, depth);
+        // the equal part goes one char deeper, unless the lines ended there
+        if (pivot == 0) {
+            return;
+        }
+        int allEqual = (lt == 0 && gt == n);
+        nodes += lt;
+        n = gt - lt;
+        depth++;
+        // a pass that split nothing is likely the start of a shared prefix: skip all of it
+        if (allEqual && n > SORT_INSERTION_LIMIT) {
+            depth += commonPrefixFrom(nodes, n, depth);
+        }
+    }
+    insertionSortNodes(nodes, n, depth);
+}
+
+/** A HELPER FUNCTION
+ * Sorts a chain of n nodes by gathering them in an array, sorting the array
+ * with multikey quicksort and relinking the nodes in the new order.
+ * Only the next pointers are valid on return.
+ * @return The first node of the sorted chain, or NULL if the array could not be allocated
+ * (the chain is untouched then).
+ */
+static Node* radixSortNodes(Node* head, size_t n) {
+    Node** nodes = (Node**)malloc(n * sizeof(Node*));
+    if (nodes == NULL) {
+        return NULL;
+    }
+    STATS_BYTES(n * sizeof(Node*));
+    size_t count = 0;
+    for (Node* curr = head; curr != NULL; curr = curr->next) {
+        nodes[count++] = curr;
+    }
+    multikeySortNodes(nodes, count, 0);
+    for (size_t i = 0; i < count; i++) {
+        nodes[i]->next = (i + 1 < count) ? nodes[i + 1] : NULL;
+    }
+    head = nodes[0];
+    free(nodes);
+    return head;
+}
+
+/** A HELPER FUNCTION
+ * Sorts a NULL terminated chain of n nodes, picking the algorithm by size:
+ * chains of SORT_RADIX_THRESHOLD nodes or more go through multikey quicksort,
+ * shorter ones (or when its array can't be allocated) through the merge sort.
+ * Only the next pointers are valid on return.
+ * @return The first node of the sorted chain.
+ */
+static Node* sortNodes(Node* head, size_t n) {
+    if (n >= SORT_RADIX_THRESHOLD) {
+        Node* sorted = radixSortNodes(head, n);
+        if (sorted != NULL) {
+            return sorted;
+        }
+    }
+    return mergeSortNodes(head);
+}
+
+/** A HELPER FUNCTION
+ * Merges two sorted chains into one by relinking their next pointers.
+ * On equal lines the nodes of a come first.
+ * @return The first node of the merged chain.
+ */
+static Node* mergeNodes(Node* a, Node* b) {
+    Node dummy;
+    Node* last = &dummy;
+    while (a != NULL && b != NULL) {
+        if ((STATS_COMPARE(), StrKernels_compare(a->line, a->len, b->line, b->len)) <= 0) {
+            last->next = a;
+            a = a->next;
+        } else {
+            last->next = b;
+            b = b->next;
+        }
+        last = last->next;
+    }
+    last->next = (a != NULL) ? a : b;
+    return dummy.next;
+}
+
+/** A HELPER FUNCTION
+ * Rebuilds the prev pointers, the tail and the order counts of a list just sorted
+ * from its next pointers: it has no descents, and an ascent between any two
+ * neighbours that are not equal.
+ */
+static void relinkPrev(StrList* StrList) {
+    Node* prev = NULL;
+    size_t ascents = 0;
+    for (Node* curr = StrList->store->head; curr != NULL; curr = curr->next) {
+        curr->prev = prev;
+        if (prev != NULL && prev->line != curr->line && !nodeHolds(prev, curr->line, curr->len, curr->hash)) {
+            ascents++;
+        }
+        prev = curr;
+    }
+    StrList->store->tail = prev;
+    StrList->store->ascents = ascents;
+    StrList->store->descents = 0;
+    StrList->reversed = 0;
+}
+
+/** A HELPER FUNCTION
+ * Tells whether sorting a list that has Nodes would leave it as it is.
+ * The Nodes of a reversed list that are in order only need the list to be turned
+ * back (equal strings can't tell their order apart), which is done here.
+ * @return 1 if the list is sorted now, 0 if it needs sorting (or has no Nodes yet).
+ */
+static int sortedAlready(StrList* StrList) {
+    if (StrList->store->unbuilt) {
+        return 0;
+    }
+    if (StrList->store->descents == 0) {
+        StrList->reversed = 0;
+        return 1;
+    }
+    return StrList->reversed && StrList->store->ascents == 0;
+}
+
+/** A HELPER FUNCTION
+ * Sorts the nodes of a private Store of two nodes or more, see StrList_sort.
+ */
+static void sortList(StrList* StrList) {
+    STATS_NODES(StrList->store->size);
+    StrList->store->head = sortNodes(StrList->store->head, StrList->store->size);
+    relinkPrev(StrList);
+    StrList->store->fingerprintValid = 0;
+    dropPosIndex(StrList);
+}
+
+/**
+ * Sorts a StrList in ascending (strcmp) order.
+ * @param StrList: The list to be sorted. If StrList is NULL or has less than two nodes,
+ * the function returns immediately.
+ * Small lists are sorted in place with a stable bottom-up merge sort that relinks the nodes.
+ * Lists of SORT_RADIX_THRESHOLD nodes or more are sorted with multikey quicksort
+ * over an array of the nodes, which inspects each char of a shared prefix once
+ * instead of in every comparison (it falls back to the merge sort if the array can't be allocated).
+ * Lines are compared with the vectorized kernels of StrKernels.h, on their cached lengths.
+ * Either way the prev pointers and the tail are fixed in a last pass, and a reversed list
+ * gets its direction back.
+ * A list that is sorted already (no descents, always the case in STRLIST_SORTED mode)
+ * is left as it is, without being copied or walked.
+ */
+void StrList_sort(StrList* StrList) {
+    STATS_OP(STATS_OP_SORT);
+    LOCK_WRITE(StrList);
+    if (StrList == NULL || StrList->store->size < 2 || sortedAlready(StrList)
+            || !detach(StrList) || sortedAlready(StrList)) {
+        return; // Nothing to sort
     }
-    free(StrList);
+    sortList(StrList);
 }
 
+/**
+ * The state shared by the tasks of StrList_sortParallel.
+ * runs[i] is the first node of the i-th chain, lens[i] its length.
+ * A merge round merges runs[i] with runs[i + step] for every i multiple of 2*step.
+ */
+typedef struct SortJob {
+    Node** runs;
+    size_t* lens;
+    int nruns;
+    int step;
+} SortJob;
 
-size_t StrList_size(const StrList* StrList) {
-    if (StrList == NULL) return 0;
-    return StrList->size;
+/** A HELPER FUNCTION
+ * Task of the first phase: sorts run i.
+ */
+static void sortRunTask(void* ctx, int i) {
+    SortJob* job = (SortJob*)ctx;
+    job->runs[i] = sortNodes(job->runs[i], job->lens[i]);
+    STATS_FLUSH(); // the workers run no operation that would add their counts
 }
 
-void StrList_insertLast(StrList* StrList, const char* data) {
-    Node* newNode = Node_alloc(data,NULL,NULL);
-    if(newNode == NULL) {
-        return; // malloc failed
-    }
-    // if list was empty, insert in the beginning
-    if (StrList->head == NULL) {
-        StrList->head = newNode;
-        StrList->tail = newNode;
-    }
-        // if list was not empty, insert at the end
-    else {
-        newNode->prev = StrList->tail;
-        StrList->tail->next = newNode;
-        StrList->tail = newNode;
+/** A HELPER FUNCTION
+ * Task of a merge round: merges the i-th pair of runs of the round.
+ */
+static void mergeRunsTask(void* ctx, int i) {
+    SortJob* job = (SortJob*)ctx;
+    int left = i * 2 * job->step;
+    int right = left + job->step;
+    if (right < job->nruns) {
+        job->runs[left] = mergeNodes(job->runs[left], job->runs[right]);
     }
-    StrList->size++;
+    STATS_FLUSH();
 }
 
 /**
- * Inserts a new Node at the given index in the list.
- * If the index is out of range, the function does nothing.
- * If the index is 0, the function inserts the new Node at the beginning of the list.
- * If the index is the size of the list, the function inserts the new Node at the end of the list.
- * Otherwise, the function traverses the list to find the Node at the given index and inserts the new Node after it.
- * @param list The list to insert into.
- * @param data The line of text to store in the new Node.
- * @param index The index to insert the new Node at.
-
-*/
-void StrList_insertAt(StrList* StrList, const char* data, int index) {
-    if(index < 0 || (size_t)index > StrList->size) {
+ * Sorts a StrList in ascending (strcmp) order on nthreads threads.
+ * The list is cut into one chain per thread, the chains are sorted concurrently
+ * with the serial sort engine, then merged pairwise in log2(nthreads) rounds
+ * that also run concurrently, on the threads of the parallel scans (see scanPoolAcquire).
+ * No node is copied, the merges only relink them.
+ * Lists shorter than PARALLEL_SORT_MIN nodes, a single thread, a failure to start
+ * the threads or finding them busy with another list fall back to the serial sort.
+ * @param StrList The list to sort.
+ * @param nthreads The number of threads to use, or 0 (or less) for one per online processor.
+ */
+void StrList_sortParallel(StrList* StrList, int nthreads) {
+    STATS_OP(STATS_OP_SORT_PARALLEL);
+    LOCK_WRITE(StrList);
+    if (StrList == NULL || StrList->store->size < 2 || sortedAlready(StrList)
+            || !detach(StrList) || sortedAlready(StrList)) {
+        return; // Nothing to sort
+    }
+    if (nthreads <= 0) {
+        nthreads = ThreadPool_cpuCount();
+    }
+    if ((size_t)nthreads > StrList->store->size / PARALLEL_SORT_MIN) {
+        nthreads = (int)(StrList->store->size / PARALLEL_SORT_MIN);
+    }
+    if (nthreads <= 1) {
+        sortList(StrList);
         return;
     }
-    Node* newNode = Node_alloc(data,NULL,NULL);
-    if (newNode == NULL) {
+
+    SortJob job;
+    job.runs = (Node**)malloc(nthreads * sizeof(Node*));
+    job.lens = (size_t*)malloc(nthreads * sizeof(size_t));
+    STATS_BYTES(nthreads * (sizeof(Node*) + sizeof(size_t)));
+    STATS_NODES(StrList->store->size);
+    ThreadPool* pool = (job.runs != NULL && job.lens != NULL) ? scanPoolAcquire(nthreads) : NULL;
+    if (pool == NULL) {
+        free(job.runs);
+        free(job.lens);
+        sortList(StrList);
         return;
     }
 
-    // if list was empty or index = 0, insert in the beginning
-    if (StrList->head == NULL || index == 0){
-        newNode->next = StrList->head;
-        if (StrList->head != NULL) {
-            StrList->head->prev = newNode;
+    // cut the list into nthreads chains of nearly equal length
+    job.nruns = nthreads;
+    Node* curr = StrList->store->head;
+    for (int i = 0; i < nthreads; i++) {
+        size_t len = StrList->store->size / nthreads + ((size_t)i < StrList->store->size % nthreads);
+        job.runs[i] = curr;
+        job.lens[i] = len;
+        for (size_t j = 1; j < len; j++) {
+            curr = curr->next;
         }
-        StrList->head = newNode;
-        // in case list was empty
-        if (StrList->tail == NULL) {
-            StrList->tail = newNode;
-        }
-    } else {
+        Node* next = curr->next;
+        curr->next = NULL;
+        curr = next;
+    }
 
-        Node* currNode = StrList->head;
-        for ( int i=0; i<index - 1 ; i++) {
-            currNode = currNode->next;
-        }
-        newNode->next = currNode->next;
-        newNode->prev = currNode;
-        if(currNode->next != NULL) {
-            currNode->next->prev = newNode;
-        }
-        currNode->next = newNode;
-        if(newNode->next == NULL){
-            StrList->tail = newNode;
+    ThreadPool_parallelFor(pool, job.nruns, sortRunTask, &job);
+    for (job.step = 1; job.step < job.nruns; job.step *= 2) {
+        int pairs = (job.nruns + 2 * job.step - 1) / (2 * job.step);
+        ThreadPool_parallelFor(pool, pairs, mergeRunsTask, &job);
+    }
+    scanPoolRelease();
+
+    StrList->store->head = job.runs[0];
+    relinkPrev(StrList);
+    StrList->store->fingerprintValid = 0;
+    dropPosIndex(StrList);
+    free(job.runs);
+    free(job.lens);
+}
+
+/**
+ * Tells whether a list is sorted, in O(1): it is when no two neighbours are in
+ * reverse order (see the descents of struct Store, or its ascents when the list is reversed).
+ * A list loaded from a snapshot that has no Nodes yet is scanned instead, on several
+ * threads if it is long (see StrList_setParallelScan).
+ * @param StrList The list to check.
+ * @return 1 if the list is sorted, 0 otherwise.
+ */
+int StrList_isSorted(StrList* StrList) {
+    STATS_OP(STATS_OP_IS_SORTED);
+    LOCK_READ(StrList);
+    if (StrList == NULL || StrList->store->size < 2) {
+        return 1; // Empty or single-element list is considered sorted
+    }
+    int sorted;
+    if (StrList->store->unbuilt && isSortedParallel(StrList, &sorted)) {
+        return sorted;
+    }
+    if (StrList->store->unbuilt) {
+        size_t prevLen, len;
+        const char* prev = mappedLine(StrList->store->map, nodePos(StrList, 0), &prevLen);
+        for (size_t i = 1; i < StrList->store->size; i++) {
+            const char* line = mappedLine(StrList->store->map, nodePos(StrList, i), &len);
+            STATS_NODES(1);
+            if ((STATS_COMPARE(), StrKernels_compare(prev, prevLen, line, len)) > 0) {
+                return 0;
+            }
+            prev = line;
+            prevLen = len;
         }
+        return 1;
     }
+    // the ascents of the Nodes are the descents of a reversed list
+    return (StrList->reversed ? StrList->store->ascents : StrList->store->descents) == 0;
+}
 
-    StrList->size++;
+/**
+ * Places a cursor at the first node of a list (at its end, node NULL, if it is empty).
+ * A list loaded from a snapshot gets its Nodes first (see buildNodes).
+ * @param StrList The list to walk.
+ * @param cursor The cursor to place.
+ * @return The line of the first node, or NULL if the list is empty.
+ */
+const char* StrList_begin(StrList* StrList, StrListCursor* cursor) {
+    STATS_OP(STATS_OP_BEGIN);
+    LOCK_READ(StrList);
+    cursor->list = StrList;
+    cursor->node = (StrList != NULL && buildNodes(StrList)) ? firstNode(StrList) : NULL;
+    cursor->index = 0;
+    return StrList_here(cursor);
 }
 
 /**
- * Returns the data of the first node in the StrList.
- * If the list is empty, the function returns NULL.
- * @param StrList The list to get the data from.
- * @return The data of the first node in the list.
+ * Moves a cursor to the next node, following its next pointer (prev in a reversed list).
+ * @param cursor The cursor to move.
+ * @return The line of the next node, or NULL at the end of the list.
  */
-char* StrList_firstData(const StrList* StrList) {
-    if( StrList == NULL || StrList->head == NULL) {
+const char* StrList_next(StrListCursor* cursor) {
+    Node* node = (Node*)cursor->node;
+    if (node == NULL) {
         return NULL;
     }
-    return StrList->head->line;
+    cursor->node = stepNode(cursor->list, node);
+    cursor->index++;
+    return StrList_here(cursor);
 }
 
-/** A HELPER FUNCTION
- * Returns a pointer to the node at a given index in the StrList.
- * If the list is NULL, the index is negative, or the index is greater than or equal to the size of the list, the function returns NULL.
- * Otherwise, the function traverses the list until it reaches the specified index and returns a pointer to the node at that index.
- * @param StrList The list to get the node from.
- * @param index The index of the node to get.
- * @return A pointer to the node at the specified index in the list, or NULL if the index is out of bounds.
+/**
+ * Moves a cursor to the previous node, following its prev pointer
+ * (from the end of the list, to its tail), or the other way round in a reversed list.
+ * @param cursor The cursor to move.
+ * @return The line of the previous node, or NULL if the cursor is at the first one.
  */
-Node* getNodeAt(const StrList* StrList, int index) {
-    if (StrList == NULL || index < 0 || (size_t)index >= StrList->size) {
+const char* StrList_prev(StrListCursor* cursor) {
+    if (cursor->list == NULL || cursor->index == 0) {
         return NULL;
     }
-    Node* currNode = StrList->head;
-    for (int i = 0; i < index; i++) {
-        currNode = currNode->next;
+    Node* node = (Node*)cursor->node;
+    if (cursor->list->reversed) {
+        cursor->node = (node != NULL) ? node->next : cursor->list->store->head;
+    } else {
+        cursor->node = (node != NULL) ? node->prev : cursor->list->store->tail;
     }
-    return currNode;
+    cursor->index--;
+    return StrList_here(cursor);
 }
 
-/*
- * iterates through all nodes and prints their data.
+/**
+ * Moves a cursor to a given index, finding its node with getNodeAt
+ * (so seeking near the previous position is O(1)).
+ * @param cursor The cursor to move.
+ * @param index The index to move to, the size of the list for its end.
+ * @return The line at index, or NULL at the end or if index is out of range (the cursor is left as it was then).
  */
-void StrList_print(const StrList* StrList) {
-    if( StrList == NULL || StrList->head == NULL) {
-        printf("\n");
-        return;
+const char* StrList_seek(StrListCursor* cursor, int index) {
+    STATS_OP(STATS_OP_SEEK);
+    LOCK_READ(cursor->list);
+    if (cursor->list == NULL || index < 0 || (size_t)index > cursor->list->store->size
+            || !buildNodes(cursor->list)) {
+        return NULL;
     }
-    Node* currNode = StrList->head;
-    printf("%s", currNode->line);
-    currNode = currNode->next;
+    size_t size = cursor->list->store->size;
+    cursor->node = ((size_t)index < size) ? getNodeAt(cursor->list, (int)nodePos(cursor->list, (size_t)index)) : NULL;
+    cursor->index = (size_t)index;
+    return StrList_here(cursor);
+}
 
-    while (currNode){
-        printf(" %s", currNode->line);
-        currNode = currNode->next;
-    }
-    printf("\n");
+const char* StrList_here(const StrListCursor* cursor) {
+    return (cursor->node != NULL) ? ((Node*)cursor->node)->line : NULL;
 }
 
-/**
- * Prints the data of the node at a given index in the StrList to the standard output.
- * If the index is out of bounds, the function does nothing.
- * @param StrList The list to print the data from.
- * @param index The index of the node to print.
+size_t StrList_cursorIndex(const StrListCursor* cursor) {
+    return cursor->index;
+}
+
+/** A HELPER FUNCTION
+ * Gives the list of a cursor a private Store before the cursor changes it,
+ * finding the node of the cursor again by index if the nodes were copied, by
+ * this or by the linking of the pending appends when the lock was taken.
+ * @param shared The Store of the list when the cursor function was called (guard.store).
+ * @return 1 if the list can be changed, 0 if the copy could not be allocated.
  */
-void StrList_printAt(const StrList* StrList, int index) {
-    if (StrList==NULL || StrList->head == NULL) {
-        return;
-    }
-    if (StrList->size < (size_t)index || index < 0) {
-        return;
+static int cursorDetach(StrListCursor* cursor, Store* shared) {
+    if (!detach(cursor->list)) {
+        return 0;
     }
-
-    Node* currNode = getNodeAt(StrList,index);
-    if(currNode == NULL) {
-        return;
+    if (cursor->list->store != shared) {
+        cursor->node = getNodeAt(cursor->list, (int)nodePos(cursor->list, cursor->index));
     }
-    printf("%s\n",currNode->line);
+    return 1;
 }
 
 /**
- * Returns the amount of characters in the list.
- * If the list is empty, the function returns 0.
- * @param StrList The list to count the characters in.
- * @return The amount of characters in the list.
+ * Inserts a new Node before the node of a cursor, or at the end of the list
+ * if the cursor is at its end. The cursor keeps its node, one index further.
+ * In STRLIST_SORTED mode the new Node goes to its sorted position instead, and the
+ * index of the cursor only grows if that is before its node.
+ * @param cursor The cursor to insert at.
+ * @param data The line of text to store in the new Node.
  */
-int StrList_printLen(const StrList* StrList) {
-    if (StrList == NULL || StrList->head == NULL){
-        return 0;
+void StrList_insertHere(StrListCursor* cursor, const char* data) {
+    STATS_OP(STATS_OP_INSERT_HERE);
+    LOCK_WRITE(cursor->list);
+    if (cursor->list == NULL || !cursorDetach(cursor, guard.store)) {
+        return;
     }
-    int charLenCounter = 0;
-    Node* currNode = StrList->head;
-    while(currNode!= NULL){
-        charLenCounter += strlen(currNode->line);
-        currNode = currNode->next;
+    Node* newNode = Node_alloc(cursor->list, data, NULL, NULL);
+    if (newNode == NULL) {
+        return; // malloc failed
     }
-
-    if (charLenCounter > INT_MAX) {
-        return INT_MAX;
+    StrList* list = cursor->list;
+    Node* node = (Node*)cursor->node;
+    if (list->store->flags & STRLIST_SORTED) {
+        size_t pos = insertChain(list, newNode, newNode, 1, 0);
+        if (node == NULL || pos <= cursor->index) {
+            cursor->index++;
+        }
+        return;
+    }
+    if (list->reversed) {
+        spliceChain(list, newNode, newNode, 1, (node != NULL) ? node->next : list->store->head,
+                gapPos(list, cursor->index));
     } else {
-        return (int)charLenCounter;
+        spliceChain(list, newNode, newNode, 1, node, cursor->index);
     }
+    cursor->index++;
 }
 
-int StrList_count(StrList* StrList, const char* data) {
-    if (StrList == NULL || data == NULL) {
-        return 0; // nothing to check
-    }
-
-    int count = 0;
-    Node *current = StrList->head;
-    while(current != NULL){
-        if(strcmp(current->line,data) == 0){
-            count++;
-        }
-        current = current->next;
+/**
+ * Removes the node of a cursor, which moves to the next node (same index).
+ * Does nothing at the end of the list.
+ * @param cursor The cursor to remove at.
+ * @return The line of the next node, or NULL at the end of the list.
+ */
+const char* StrList_removeHere(StrListCursor* cursor) {
+    STATS_OP(STATS_OP_REMOVE_HERE);
+    LOCK_WRITE(cursor->list);
+    if (cursor->list == NULL || cursor->node == NULL || !cursorDetach(cursor, guard.store)) {
+        return NULL;
     }
-
-    return count;
+    Node* node = (Node*)cursor->node;
+    cursor->node = stepNode(cursor->list, node);
+    removeNodeAt(cursor->list, node, nodePos(cursor->list, cursor->index));
+    return StrList_here(cursor);
 }
 
-/**
- * @param StrList: A pointer to the StrList.
- * @param data: The string to match with node's line.
- * The function iterates over the StrList. If a node's line matches the input string,
- * the node is removed and its memory is freed. If not, the function moves to the next node.
+/** A HELPER FUNCTION
+ * Puts the offsets table (when blob is 0) or the blob (when blob is 1) of a snapshot
+ * of the list in the buffer: a list that has no Nodes yet copies those of its mapping,
+ * a chunked list reads its ScanEntry arrays, and the others walk their nodes.
+ * A reversed list is written in its own direction, line by line.
  */
-void StrList_remove(StrList* StrList, const char* data) {
-    if (StrList == NULL || StrList->head == NULL || data == NULL) {
+static void putSnapshotPart(const StrList* StrList, OutBuf* out, int blob) {
+    Store* store = StrList->store;
+    if (store->unbuilt && !StrList->reversed) {
+        const Mapping* map = store->map;
+        if (blob) {
+            OutBuf_put(out, map->blob, (size_t)map->offsets[store->size]);
+        } else {
+            OutBuf_put(out, (const char*)map->offsets, (store->size + 1) * sizeof(uint64_t));
+        }
         return;
     }
-
-    Node* currNode = StrList->head;
-    Node* prevNode = NULL;
-    while(currNode != NULL) {
-        if(strcmp(currNode->line, data) == 0) {
-            if(prevNode == NULL) {
-                // if the node to remove is the first node
-                StrList->head = currNode->next;
+    uint64_t offset = 0;
+    ScanPos pos;
+    if (store->unbuilt) {
+        for (size_t i = 0; i < store->size; i++) {
+            size_t len;
+            const char* line = mappedLine(store->map, nodePos(StrList, i), &len);
+            if (blob) {
+                OutBuf_put(out, line, len + 1);
             } else {
-                // if the node to remove is not the first node
-                prevNode->next = currNode->next;
+                OutBuf_put(out, (const char*)&offset, sizeof(offset));
+                offset += (uint64_t)len + 1;
+            }
+        }
+    } else if (!StrList->reversed && scanBegin(StrList, &pos)) {
+        const ScanEntry* entry;
+        while ((entry = scanNext(&pos)) != NULL) {
+            if (blob) {
+                OutBuf_put(out, entry->line, (size_t)entry->len + 1);
+            } else {
+                OutBuf_put(out, (const char*)&offset, sizeof(offset));
+                offset += (uint64_t)entry->len + 1;
+            }
+        }
+    } else {
+        for (Node* node = firstNode(StrList); node != NULL; node = stepNode(StrList, node)) {
+            if (blob) {
+                OutBuf_put(out, node->line, (size_t)node->len + 1);
+            } else {
+                OutBuf_put(out, (const char*)&offset, sizeof(offset));
+                offset += (uint64_t)node->len + 1;
             }
-            Node* tempNode = currNode;
-            currNode = currNode->next;
-            free(tempNode->line);
-            free(tempNode);
-        } else {
-            prevNode = currNode;
-            currNode = currNode->next;
         }
     }
+    if (!blob) {
+        OutBuf_put(out, (const char*)&offset, sizeof(offset));
+    }
+    STATS_NODES(store->size);
 }
 
-void StrList_removeAt(StrList* StrList, int index) {
-    if (StrList == NULL || index < 0 || (size_t)index >= StrList->size) {
-        return; // Invalid input or index out of bounds
-    }
-    Node* current = StrList->head;
-    Node* prev = NULL;
-    int i = 0;
-    // Traverse the list to find the node at the given index
-    while(current != NULL && i < index){
-        prev = current;
-        current = current -> next;
-        i++;
+/** A HELPER FUNCTION
+ * Moves the Nodes of a list (with their inline lines) into new memory, one after the
+ * other in the order of the list from its head: into a single piece of arena when
+ * it is not NULL, otherwise into a malloc per node. Interned lines and the lines of
+ * a snapshot stay where they are.
+ * While the copies are made, the prev pointer of each old node forwards to its copy,
+ * through which the copies get their hash chain pointers and the hash index its slots.
+ * @return 1 on success, 0 if the memory could not be allocated (the list is unchanged).
+ */
+static int relocateNodes(StrList* StrList, Arena* arena) {
+    Store* store = StrList->store;
+    char* piece = NULL;
+    if (arena != NULL) {
+        size_t total = 0;
+        for (Node* node = store->head; node != NULL; node = node->next) {
+            total += Arena_pieceSize(nodeBytes(store, node));
+        }
+        piece = (char*)Arena_new(arena, total);
+        if (piece == NULL) {
+            return 0;
+        }
+        STATS_BYTES(total);
     }
-    // If the node was found, remove it
-    if(current != NULL){
-        if(prev != NULL){
-            // If the node to remove is not the first node
-            prev -> next = current -> next;
-            if(current -> next == NULL) {
-                // If the node to remove is the last node
-                StrList -> tail = prev;
+    Node* last = NULL;
+    for (Node* node = store->head; node != NULL; node = node->next) {
+        size_t size = nodeBytes(store, node);
+        Node* copy;
+        if (piece != NULL) {
+            copy = (Node*)piece;
+            piece += Arena_pieceSize(size);
+        } else if ((copy = (Node*)malloc(size)) == NULL) {
+            // free the copies made so far, and point the old nodes back to each other
+            Node* prev = NULL;
+            for (Node* old = store->head; old != node; old = old->next) {
+                free(old->prev);
+                old->prev = prev;
+                prev = old;
             }
-        }else{
-            // If the node to remove is the first node
-            StrList -> head = current -> next;
-            if(StrList -> head == NULL) {
-                // If the node to remove is the only node
-                StrList -> tail = NULL;
+            node->prev = prev;
+            return 0;
+        } else {
+            STATS_BYTES(size);
+        }
+        memcpy(copy, node, size);
+        if (node->line == nodeText(store, node)) {
+            copy->line = nodeText(store, copy);
+        }
+        copy->prev = last;
+        copy->next = NULL;
+        if (last != NULL) {
+            last->next = copy;
+        }
+        last = copy;
+        node->prev = copy;
+    }
+    STATS_NODES(2 * store->size);
+    Node* head = store->head->prev;
+    if (store->index != NULL) {
+        for (Node* copy = head; copy != NULL; copy = copy->next) {
+            NodeLinks* links = linksOf(copy);
+            links->hashNext = (links->hashNext != NULL) ? links->hashNext->prev : NULL;
+            links->hashPrev = (links->hashPrev != NULL) ? links->hashPrev->prev : NULL;
+        }
+        for (size_t i = 0; i < store->index->cap; i++) {
+            if (store->index->slots[i].nodes != NULL) {
+                store->index->slots[i].nodes = store->index->slots[i].nodes->prev;
             }
         }
-
-        free(current->line);
-        free(current);
-        StrList->size--;
     }
+    if (store->arena == NULL) {
+        Node* node = store->head;
+        while (node != NULL) {
+            Node* next = node->next;
+            free(node);
+            node = next;
+        }
+    }
+    store->head = head;
+    store->tail = last;
+    return 1;
 }
 
 /**
- * This function compares two StrLists. 
- * It first checks for NULL lists and unequal sizes, returning 0 if either condition is met. 
- * It treats two NULL lists as equal and returns 1.
- * Then, it iterates through both lists simultaneously, comparing each pair of strings with strcmp. 
- * If any pair is unequal, it returns 0 immediately.
- * If it completes the iteration without finding unequal pairs, it returns 1.
- * @param StrList1 A pointer to the first StrList.
- * @param StrList2 A pointer to the second StrList.
- * @return Returns 1 if the two StrLists are equal, and 0 otherwise.
+ * Compacts a list: its Nodes and their lines are moved, in the order of the list,
+ * into new memory, and the old memory is freed. In STRLIST_ARENA mode they go into
+ * one contiguous piece of a new arena and the old arena is freed: after a long run
+ * of insertions and removals the nodes are spread over blocks that the freed nodes
+ * leave mostly empty; compacted, they take no more memory than the lines need, and
+ * a scan reads them in address order. The other lists stay in their mode: their
+ * nodes are malloc'ed again one after the other, in the order of the list, and the
+ * old ones freed; how close together the copies land is up to malloc.
+ * A list sharing its Nodes with clones gets a copy of its own, which is compact
+ * already (see detach). A list loaded from a snapshot that has no Nodes yet has
+ * nothing to compact. The positional index is rebuilt, the hash index kept.
+ * @param StrList The list to compact.
+ * @return 0 on success, -1 if the memory could not be allocated (the list is unchanged).
  */
-int StrList_isEqual(const StrList* StrList1, const StrList* StrList2) {
-
-    if (StrList1 == NULL && StrList2 == NULL) {
-        return 1;
-    }
-
-    if ((StrList1 == NULL && StrList2 != NULL) || (StrList1 != NULL && StrList2 == NULL) || (StrList1->size != StrList2->size)) {
+int StrList_compact(StrList* StrList) {
+    STATS_OP(STATS_OP_COMPACT);
+    LOCK_WRITE(StrList);
+    if (StrList == NULL || StrList->store->size == 0 || StrList->store->unbuilt) {
         return 0;
     }
-
-    Node *current1 = StrList1->head;
-    Node *current2 = StrList2->head;
-
-    while (current1 != NULL && current2 != NULL) {
-        int cmp = strcmp(current1->line, current2->line);
-        if (cmp != 0) { // If any pair of elements is unequal, the lists are not equal
-            return 0;
+    if (atomic_load_explicit(&StrList->store->refs, memory_order_acquire) > 1) {
+        return detach(StrList) ? 0 : -1;
+    }
+    Store* store = StrList->store;
+    if (store->arena == NULL) {
+        if (!relocateNodes(StrList, NULL)) {
+            return -1;
+        }
+    } else {
+        Arena* arena = Arena_alloc();
+        if (arena == NULL || !relocateNodes(StrList, arena)) {
+            Arena_free(arena);
+            return -1;
         }
-        current1 = current1->next;
-        current2 = current2->next;
+        Arena_free(store->arena);
+        store->arena = arena;
     }
-
-    return 1;
+    dropPosIndex(StrList);
+    return 0;
 }
 
-
 /**
- * This function clones a given StrList. 
- * It allocates memory for a new StrList and iterates through the given StrList, 
- * inserting each string into the new StrList. 
- * It returns a pointer to the new StrList.
- * @param StrList A pointer to the StrList to clone.
- * @return A pointer to the newly allocated StrList, or NULL if the allocation failed.
+ * Reports the memory a list takes (see struct StrListMemory).
+ * The nodes are walked to sum their sizes, the other parts are counted from their
+ * sizes: the arena blocks, the hash index table, the chunks of the positional index,
+ * the nodes of the prefix index (walked too) and the mapping of a snapshot. The pool
+ * of interned lines is shared by all the lists and is not counted, nor is the
+ * bookkeeping of malloc.
+ * @param StrList The list.
+ * @param usage Filled with the figures.
  */
-StrList* StrList_clone(const StrList* StrList) {
-    if(StrList == NULL){
-        return NULL;
+void StrList_memoryUsage(const StrList* StrList, StrListMemory* usage) {
+    STATS_OP(STATS_OP_MEMORY_USAGE);
+    LOCK_READ(StrList);
+    memset(usage, 0, sizeof(*usage));
+    if (StrList == NULL) {
+        return;
     }
-    struct _StrList* clone;
-    clone = StrList_alloc(); // Allocate memory for the new StrList
-    if (clone == NULL) {
-        return NULL; // Return NULL if memory allocation failed
+    Store* store = StrList->store;
+    usage->elements = store->size;
+    usage->chars = store->chars;
+    size_t nodes = 0;
+    for (Node* node = store->unbuilt ? NULL : store->head; node != NULL; node = node->next) {
+        nodes += (store->arena != NULL) ? Arena_pieceSize(nodeBytes(store, node)) : nodeBytes(store, node);
     }
-    Node* current = StrList->head;
-    while(current != NULL){
-        StrList_insertLast(clone, current->line);
-        current = current->next;
+    STATS_NODES(store->unbuilt ? 0 : store->size);
+    usage->usedBytes = sizeof(Store) + nodes;
+    if (store->arena != NULL) {
+        usage->wastedBytes = Arena_bytes(store->arena) - nodes;
+    }
+    if (store->index != NULL) {
+        usage->usedBytes += sizeof(HashIndex) + store->index->cap * sizeof(HashSlot);
+    }
+    int locked = Store_lockCaches(store); // a clone may be building the positional or prefix index
+    if (store->posIndex != NULL) {
+        // the empty slots of the chunks are wasted
+        size_t slotBytes = sizeof(Node*) + (store->posIndex->withScan ? sizeof(ScanEntry) : 0);
+        size_t chunkBytes = sizeof(Chunk) + (store->posIndex->withScan ? CHUNK_CAP * sizeof(ScanEntry) : 0);
+        Chunk* chunk = store->posIndex->root;
+        while (chunk != NULL && chunk->left != NULL) {
+            chunk = chunk->left;
+        }
+        usage->usedBytes += sizeof(PosIndex);
+        for (; chunk != NULL; chunk = chunkNext(chunk)) {
+            size_t empty = (size_t)(CHUNK_CAP - chunk->count) * slotBytes;
+            usage->usedBytes += chunkBytes - empty;
+            usage->wastedBytes += empty;
+        }
+    }
+    if (store->prefixIndex != NULL) {
+        usage->usedBytes += Trie_bytes(store->prefixIndex);
+    }
+    Store_unlockCaches(store, locked);
+    if (store->map != NULL) {
+        usage->usedBytes += sizeof(Mapping) + store->map->len;
+    }
+    if (store->size > 0) {
+        usage->overheadPerElement = ((double)(usage->usedBytes + usage->wastedBytes) - (double)store->chars) / (double)store->size;
     }
-    return clone;
 }
 
 /**
- * This function reverses the order of nodes in a given StrList.
- * It first checks if the StrList is NULL or has less than two nodes.
- * If so, it returns immediately as there's nothing to reverse.
- * Then, it iterates through the list, reversing the next and prev pointers of each node.
- * Finally, it updates the head and tail pointers of the StrList to point to the new head and tail.
- * @param StrList A pointer to the StrList to be reversed.
+ * Saves the lines of a list to a snapshot file: a SnapshotHeader, the offsets table
+ * and the blob (see struct SnapshotHeader), streamed through an OutBuf in two passes
+ * over the list. The file is written as path.tmp and renamed over path, so a mapping
+ * of the file being replaced (a list loaded from path) keeps its old contents.
+ * @param StrList The list to save.
+ * @param path The path of the snapshot file.
+ * @return 0 on success, -1 if the file could not be written.
  */
-void StrList_reverse(StrList* StrList) {
-
-    if (StrList == NULL || StrList->head == NULL || StrList->head->next == NULL) {
-        return; // Nothing to reverse
+int StrList_save(const StrList* StrList, const char* path) {
+    STATS_OP(STATS_OP_SAVE);
+    LOCK_READ(StrList);
+    if (StrList == NULL || path == NULL) {
+        return -1;
+    }
+    size_t pathLen = strlen(path);
+    char* tmpPath = (char*)malloc(pathLen + sizeof(".tmp"));
+    OutBuf* out = (OutBuf*)malloc(sizeof(OutBuf));
+    if (tmpPath == NULL || out == NULL) {
+        free(tmpPath);
+        free(out);
+        return -1;
+    }
+    memcpy(tmpPath, path, pathLen);
+    memcpy(tmpPath + pathLen, ".tmp", sizeof(".tmp"));
+    out->file = NULL;
+    out->len = 0;
+    out->failed = 0;
+    out->fd = open(tmpPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out->fd < 0) {
+        free(tmpPath);
+        free(out);
+        return -1;
     }
 
-    Node *current = StrList->head;
-    Node *prev = NULL;
-    Node *next = NULL;
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.byteOrder = SNAPSHOT_BYTE_ORDER;
+    header.count = StrList->store->size;
+    header.blobSize = StrList->store->chars + StrList->store->size; // a '\0' after each line
+    OutBuf_put(out, (const char*)&header, sizeof(header));
+    putSnapshotPart(StrList, out, 0);
+    putSnapshotPart(StrList, out, 1);
+    OutBuf_flush(out);
 
-    while(current != NULL){
-        next = current->next;
-        current->prev = next;
-        current->next = prev;
-        prev = current;
-        current = next;
+    int failed = out->failed;
+    if (close(out->fd) != 0 || failed || rename(tmpPath, path) != 0) {
+        unlink(tmpPath);
+        failed = 1;
     }
-    StrList->tail = StrList->head;
-    StrList->head = prev;
+    free(tmpPath);
+    free(out);
+    return failed ? -1 : 0;
 }
-/**
- * Sorts a StrList in ascending order using a variant of Bubble Sort.
- * @param StrList: The list to be sorted. If StrList is NULL or has less than two nodes,
- * the function returns immediately.
- * The function iterates over the list, comparing and swapping adjacent nodes if necessary.
- * This process repeats until a pass occurs with no swaps, indicating the list is sorted.
+
+/** A HELPER FUNCTION
+ * Checks that a mapped file is a snapshot this build can read and points map->offsets
+ * and map->blob into it. The sizes must add up to the size of the file, and the offsets
+ * must start at 0, grow and end at the end of the blob. Each line must end with a '\0'
+ * right before the offset of the next one and hold no other: the length a line gets from
+ * the offsets is then the strlen of the C string read from the blob, so the nodes built
+ * from it and the functions reading it in place see the same line.
+ * @return 1 if the file is a valid snapshot, 0 otherwise.
  */
-void StrList_sort(StrList* StrList) {
-    if (StrList == NULL || StrList->head == NULL || StrList->head->next == NULL) {
-        return; // Nothing to sort
+static int checkSnapshot(Mapping* map) {
+    if (map->len < sizeof(SnapshotHeader)) {
+        return 0;
     }
-    Node* end = NULL;
-    int swapped;
-
-    do {
-        swapped = 0;
-        Node* current = StrList->head;
-
-        while (current->next != end) {
-            if (strcmp(current->line, current->next->line) > 0) {
-                char* temp = current->line;
-                current->line = current->next->line;
-                current->next->line = temp;
-                swapped = 1;
-            }
-            current = current->next;
+    const SnapshotHeader* header = (const SnapshotHeader*)map->addr;
+    if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0
+            || header->version != SNAPSHOT_VERSION || header->byteOrder != SNAPSHOT_BYTE_ORDER) {
+        return 0;
+    }
+    size_t room = map->len - sizeof(SnapshotHeader);
+    if (header->count >= room / sizeof(uint64_t)) {
+        return 0; // no room for count + 1 offsets
+    }
+    size_t count = (size_t)header->count;
+    size_t tableSize = (count + 1) * sizeof(uint64_t);
+    if (header->blobSize != room - tableSize) {
+        return 0;
+    }
+    map->offsets = (const uint64_t*)((const char*)map->addr + sizeof(SnapshotHeader));
+    map->blob = (const char*)map->offsets + tableSize;
+    if (map->offsets[0] != 0 || map->offsets[count] != header->blobSize) {
+        return 0;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (map->offsets[i + 1] <= map->offsets[i]) {
+            return 0; // every line takes at least its '\0'
+        }
+        const char* line = map->blob + map->offsets[i];
+        size_t bytes = (size_t)(map->offsets[i + 1] - map->offsets[i]);
+        if (memchr(line, '\0', bytes) != line + bytes - 1) {
+            return 0; // a line without its '\0', or with one inside it
         }
-        end = current;
-    } while (swapped);
+    }
+    return 1;
 }
 
-int StrList_isSorted(StrList* StrList) {
-    if (StrList == NULL || StrList->head == NULL || StrList->head->next == NULL) {
-        return 1; // Empty or single-element list is considered sorted
+/**
+ * Loads a list from a snapshot file written by StrList_save.
+ * The file is mapped read only and private, checked (see checkSnapshot), and handed to
+ * a new list as is: the list is "unbuilt", its size and chars come from the header and
+ * its lines are read from the mapping, so loading costs no more than one read of the file
+ * to check it, and no allocation per line. The Nodes, pointing to the mapped lines,
+ * are created by buildNodes when they are first needed (right away in STRLIST_CHUNKED,
+ * STRLIST_CONCURRENT and STRLIST_SORTED mode, whose positional index must always be
+ * there; a STRLIST_SORTED list is then sorted if the snapshot was not).
+ * In STRLIST_INTERN mode the Nodes point to the pool instead, as usual.
+ * @param path The path of the snapshot file.
+ * @param flags A combination of the STRLIST_ flags.
+ * @return The loaded list, or NULL if the file could not be mapped, is not a valid
+ *         snapshot, or the allocation failed.
+ */
+StrList* StrList_load(const char* path, int flags) {
+    STATS_OP(STATS_OP_LOAD);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
     }
-    Node *current = StrList->head;
-    while(current->next != NULL) {
-        if (strcmp(current->line, current->next->line) > 0) {
-            return 0; // If a pair of elements is out of order, the list is not sorted
-        }
-        current = current->next;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size < (off_t)sizeof(SnapshotHeader)) {
+        close(fd);
+        return NULL;
+    }
+    Mapping* map = (Mapping*)malloc(sizeof(Mapping));
+    if (map == NULL) {
+        close(fd);
+        return NULL;
+    }
+    STATS_BYTES(sizeof(Mapping));
+    map->len = (size_t)st.st_size;
+    map->addr = mmap(NULL, map->len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map->addr == MAP_FAILED) {
+        free(map);
+        return NULL;
     }
-    return 1; // If we've gone through the whole list without finding out-of-order elements, the list is sorted
-}
\ No newline at end of file
+    StrList* list = checkSnapshot(map) ? StrList_allocWith(flags) : NULL;
+    if (list == NULL) {
+        munmap(map->addr, map->len);
+        free(map);
+        return NULL;
+    }
+    const SnapshotHeader* header = (const SnapshotHeader*)map->addr;
+    Store* store = list->store;
+    store->map = map;
+    store->unbuilt = 1;
+    store->size = (size_t)header->count;
+    store->chars = (size_t)(header->blobSize - header->count);
+    store->fingerprintValid = 0;
+    if ((flags & EAGER_POS_INDEX) && !buildNodes(list)) {
+        StrList_free(list);
+        return NULL;
+    }
+    if (store->descents > 0 && (flags & STRLIST_SORTED)) {
+        sortList(list);
+    }
+    return list;
+}
@@ -2,6 +2,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
 
 /********************************************************************************
  *
@@ -20,18 +21,74 @@
 struct _StrList;
 typedef struct _StrList StrList;
 
+/*
+ * Flags for StrList_allocWith.
+ * STRLIST_ARENA      - the elements of the list are carved out of large blocks
+ *                      owned by the list, so clearing and freeing it costs one
+ *                      free per block instead of one per element.
+ * STRLIST_HASH_INDEX - the list keeps a hash index of its strings, so that
+ *                      StrList_count is O(1) and StrList_remove only visits the
+ *                      removed elements.
+ * STRLIST_CHUNKED    - the list also keeps its elements in an unrolled list of
+ *                      chunks holding their strings, lengths and hashes
+ *                      contiguously, which the scans (print, printLen, count,
+ *                      isEqual, isSorted) read instead of visiting each element.
+ * STRLIST_INTERN     - the strings of the list are interned in a pool shared by
+ *                      all the lists of the process, so every distinct string is
+ *                      stored once however many times it occurs, and StrList_count,
+ *                      StrList_remove and StrList_isEqual (of two such lists)
+ *                      compare strings by pointer. The strings returned by
+ *                      StrList_firstData are then shared and must not be changed.
+ * STRLIST_CONCURRENT - the list may be used by several threads at once: the
+ *                      functions that read it run in parallel, the ones that
+ *                      change it one at a time, and StrList_insertLast appends
+ *                      without waiting for a lock (except in STRLIST_ARENA mode).
+ *                      The string returned by StrList_firstData stays valid until
+ *                      the list is changed, and a cursor must not be used while
+ *                      another thread changes its list. StrList_free must not run
+ *                      alongside anything else on the same list.
+ * STRLIST_SORTED     - the list is always sorted: every insert puts its elements at
+ *                      their sorted position (after the equal ones) whatever the
+ *                      index, StrList_reverse and StrList_sort leave it as it is,
+ *                      and StrList_count and StrList_remove find a string by binary
+ *                      search, in O(log n + k) for k occurrences.
+ * STRLIST_PREFIX_INDEX - the list keeps a prefix index of its strings (a trie
+ *                      counting them by prefix), so that StrList_countPrefix,
+ *                      StrList_listPrefix and StrList_removePrefix don't scan it.
+ *                      Every insert and remove updates it, and StrList_memoryUsage
+ *                      counts it. Outside STRLIST_SORTED mode it brings
+ *                      STRLIST_HASH_INDEX along, which StrList_removePrefix needs.
+ */
+#define STRLIST_ARENA 0x1
+#define STRLIST_HASH_INDEX 0x2
+#define STRLIST_CHUNKED 0x4
+#define STRLIST_INTERN 0x8
+#define STRLIST_CONCURRENT 0x10
+#define STRLIST_SORTED 0x20
+#define STRLIST_PREFIX_INDEX 0x40
+
 /*
  * Allocates a new empty StrList.
  * It's the user responsibility to free it with StrList_free.
  */
 StrList* StrList_alloc();
 
+/*
+ * Allocates a new empty StrList in the mode given by flags (STRLIST_ flags).
+ * It's the user responsibility to free it with StrList_free.
+ */
+StrList* StrList_allocWith(int flags);
+
 /*
  * Frees the memory and resources allocated to StrList.
  * If StrList==NULL does nothing (same as free).
  */
 void StrList_free(StrList* StrList);
 
+/*
+ * Removes all the elements of the StrList, leaving it empty.
+ */
+void StrList_clear(StrList* StrList);
 
 /*
  * Returns the number of elements in the StrList.
@@ -44,6 +101,17 @@ size_t StrList_size(const StrList* StrList);
 void StrList_insertLast(StrList* StrList,
 					  const char* data);
 
+/*
+ * Inserts the n strings of words at the end of the StrList, in order.
+ */
+void StrList_appendArray(StrList* StrList, const char* const* words, size_t n);
+
+/*
+ * Inserts the n strings of words at the given index of the StrList, in order
+ * (the first one ends up at index).
+ */
+void StrList_insertMany(StrList* StrList, const char* const* words, size_t n, int index);
+
 /*
 * Inserts an element at given index
 */
@@ -60,6 +128,19 @@ char* StrList_firstData(const StrList* StrList);
  */
 void StrList_print(const StrList* StrList);
 
+/*
+ * Prints the StrList to the given stream, the same way StrList_print does.
+ * Returns 0 on success, -1 if writing failed.
+ */
+int StrList_printTo(const StrList* StrList, FILE* file);
+
+/*
+ * Prints the StrList to the given file descriptor, the same way StrList_print does,
+ * without going through stdio.
+ * Returns 0 on success, -1 if writing failed.
+ */
+int StrList_printToFd(const StrList* StrList, int fd);
+
 /*
  Prints the word at the given index to the standard output.
 */
@@ -85,6 +166,40 @@ void StrList_remove(StrList* StrList, const char* data);
 */
 void StrList_removeAt(StrList* StrList, int index);
 
+/*
+ * Removes all the appearences of each of the count given words, in one pass
+ * over the list instead of one StrList_remove per word.
+ */
+void StrList_removeAll(StrList* StrList, const char* const* words, size_t count);
+
+/*
+ * Removes the strings for which predicate(string, ctx) returns non-zero, in one
+ * pass over the list. The predicate must not use the list.
+ */
+void StrList_removeIf(StrList* StrList, int (*predicate)(const char* line, void* ctx), void* ctx);
+
+/*
+ * Returns the number of strings of the list that start with prefix.
+ * O(|prefix|) in STRLIST_PREFIX_INDEX mode, one pass over the list otherwise.
+ */
+int StrList_countPrefix(StrList* StrList, const char* prefix);
+
+/*
+ * Removes all the strings of the list that start with prefix.
+ * O(|prefix| + removed) in STRLIST_PREFIX_INDEX mode, one pass over the list otherwise.
+ */
+void StrList_removePrefix(StrList* StrList, const char* prefix);
+
+/*
+ * Calls visit(string, count, ctx) for the first n distinct strings of the list
+ * that start with prefix, in lexicographical order, count being the number of times
+ * the string is in the list (autocompletion). The string is only valid during the
+ * call, and visit must not use the list.
+ * Returns the number of strings visited.
+ */
+size_t StrList_listPrefix(StrList* StrList, const char* prefix, size_t n,
+	void (*visit)(const char* word, size_t count, void* ctx), void* ctx);
+
 /*
  * Checks if two StrLists have the same elements
  * returns 0 if not and any other number if yes
@@ -94,11 +209,14 @@ int StrList_isEqual(const StrList* StrList1, const StrList* StrList2);
 /*
  * Clones the given StrList. 
  * It's the user responsibility to free it with StrList_free.
+ * The clone is independent of the list: each of them may be read or changed
+ * on a thread of its own.
  */
 StrList* StrList_clone(const StrList* StrList);
 
 /*
  * Reverces the given StrList. 
+ * O(1): the list only changes direction, its elements are not moved.
  */
 void StrList_reverse( StrList* StrList);
 
@@ -107,9 +225,183 @@ void StrList_reverse( StrList* StrList);
  */
 void StrList_sort( StrList* StrList);
 
+/*
+ * Sort the given list in lexicographical order using nthreads threads
+ * (0 for one per processor). Gives the same result as StrList_sort.
+ * It runs on the threads of the parallel scans (see StrList_setParallelScan), and
+ * sorts serially when another thread is using them.
+ */
+void StrList_sortParallel(StrList* StrList, int nthreads);
+
+/*
+ * Sets when StrList_count, StrList_isEqual and StrList_isSorted scan a list on
+ * nthreads threads (0 for one per processor): from minSize elements (0 never).
+ * By default lists of a million elements and more are scanned on every processor.
+ * A list is split at the threads' starts through its positional index (kept by
+ * the chunked, concurrent and sorted modes, built by the first access by index in
+ * the others): one that has none is scanned serially. The threads are started once
+ * and shared by all the lists of the process, as is this setting.
+ */
+void StrList_setParallelScan(size_t minSize, int nthreads);
+
 /*
  * Checks if the given list is sorted in lexicographical order
  * returns 1 for sorted,   0 otherwise
+ * O(1): every change of the list keeps count of its out of order neighbours.
  */
 int StrList_isSorted(StrList* StrList);
 
+/*
+ * A cursor: a position in a StrList, at one of its elements or at its end
+ * (right after the last element), for walking the list and changing it in place
+ * in O(1) per step. Its fields are private to the library.
+ * A cursor stays valid while the list is only changed through it (clones of the
+ * list may change freely). After any other change of the list, move it with
+ * StrList_seek before using it again.
+ */
+typedef struct StrListCursor {
+    StrList* list;
+    void* node;
+    size_t index;
+} StrListCursor;
+
+/*
+ * Places the cursor at the first element of the StrList (at its end if the list is empty).
+ * Returns the string of that element, or NULL at the end.
+ * A typical walk: for (s = StrList_begin(list, &c); s != NULL; s = StrList_next(&c))
+ */
+const char* StrList_begin(StrList* StrList, StrListCursor* cursor);
+
+/*
+ * Moves the cursor to the next element and returns its string,
+ * or NULL when it reaches the end of the list (where it stays).
+ */
+const char* StrList_next(StrListCursor* cursor);
+
+/*
+ * Moves the cursor to the previous element and returns its string.
+ * At the first element the cursor doesn't move and NULL is returned.
+ */
+const char* StrList_prev(StrListCursor* cursor);
+
+/*
+ * Moves the cursor to the element at index (to the end if index is the size of the list)
+ * and returns its string, or NULL at the end. An index out of range leaves the cursor
+ * where it was and returns NULL.
+ */
+const char* StrList_seek(StrListCursor* cursor, int index);
+
+/*
+ * Returns the string of the element at the cursor, or NULL at the end.
+ */
+const char* StrList_here(const StrListCursor* cursor);
+
+/*
+ * Returns the index of the cursor (the size of the list at the end).
+ */
+size_t StrList_cursorIndex(const StrListCursor* cursor);
+
+/*
+ * Inserts an element before the cursor (at the end of the list when the cursor is at its end).
+ * The cursor stays at the same element, whose index grows by one.
+ */
+void StrList_insertHere(StrListCursor* cursor, const char* data);
+
+/*
+ * Removes the element at the cursor, which moves to the next one.
+ * Returns the string of that next element, or NULL at the end (where removing does nothing).
+ */
+const char* StrList_removeHere(StrListCursor* cursor);
+
+/*
+ * Moves the elements of the list, in order, into new memory and frees the memory
+ * they were scattered over (e.g. after many insertions and removals), so that
+ * walking the list reads memory in order again: one contiguous block in
+ * STRLIST_ARENA mode, one allocation per element otherwise (where the copies land
+ * is up to malloc: a list that needs compacting is best kept in STRLIST_ARENA mode).
+ * The list keeps its mode.
+ * Returns 0 on success, -1 if the memory could not be allocated (the list is left as it was).
+ */
+int StrList_compact(StrList* StrList);
+
+/*
+ * The memory taken by a list (see StrList_memoryUsage).
+ */
+typedef struct StrListMemory {
+    size_t elements;            // elements of the list
+    size_t chars;               // chars of their strings
+    size_t usedBytes;           // bytes of the elements with their strings, and of the indexes (hash, positional, prefix)
+    size_t wastedBytes;         // bytes held for the list but unused: freed elements, unused block ends
+    double overheadPerElement;  // bytes taken per element beyond the chars of its string
+} StrListMemory;
+
+/*
+ * Fills usage with the memory taken by the list.
+ */
+void StrList_memoryUsage(const StrList* StrList, StrListMemory* usage);
+
+/*
+ * Saves the elements of the list to a snapshot file at path, replacing it.
+ * The file is written next to path and renamed over it, so a list loaded from path
+ * may be saved back to it.
+ * Returns 0 on success, -1 on failure (path is left as it was).
+ */
+int StrList_save(const StrList* StrList, const char* path);
+
+/*
+ * Loads a list, in the mode given by flags, from a snapshot file written by StrList_save
+ * on a machine with the same byte order.
+ * The file is mapped in memory and the strings are used in place: loading doesn't copy
+ * or allocate per element, the elements are only created when the list is first changed
+ * or accessed by position. The strings of the list (see StrList_firstData) are read only
+ * until then. STRLIST_CHUNKED, STRLIST_CONCURRENT and STRLIST_SORTED lists create them
+ * right away.
+ * Returns the list, or NULL if the file could not be read, is not a valid snapshot
+ * (the whole file is read once to check it), or the allocation failed.
+ */
+StrList* StrList_load(const char* path, int flags);
+
+/*
+ * Statistics of the StrList library, gathered over all the lists of the process
+ * when it is built with STRLIST_STATS (make STATS=1).
+ * The latency of each operation is kept as a histogram of power of 2 buckets:
+ * histogram[i] counts the calls that took [2^i, 2^(i+1)) ns, and the percentiles
+ * are the upper bounds of their buckets.
+ */
+#define STRLIST_STATS_BUCKETS 40
+#define STRLIST_STATS_MAX_OPS 64
+
+typedef struct StrListOpStats {
+    const char* name;   // the StrList_ function without the prefix, e.g. "sort"
+    uint64_t calls;
+    uint64_t totalNs;
+    uint64_t maxNs;
+    uint64_t p50Ns;
+    uint64_t p90Ns;
+    uint64_t p99Ns;
+    uint64_t histogram[STRLIST_STATS_BUCKETS];
+} StrListOpStats;
+
+typedef struct StrListStats {
+    int enabled;              // 0 when the library was built without STRLIST_STATS
+    int nops;                 // used entries of ops
+    StrListOpStats ops[STRLIST_STATS_MAX_OPS];
+    uint64_t nodesTraversed;  // nodes visited one by one, by scans and positional walks
+    uint64_t bytesAllocated;  // bytes of elements, indexes and scratch arrays allocated
+    uint64_t compares;        // string comparisons
+} StrListStats;
+
+/*
+ * Fills stats with a snapshot of the statistics of the library.
+ */
+void StrList_stats(StrListStats* stats);
+
+/*
+ * Prints a table of the statistics of the library to the given stream.
+ */
+void StrList_printStats(FILE* file);
+
+/*
+ * Zeroes the statistics of the library.
+ */
+void StrList_resetStats();
@@ -0,0 +1,1033 @@
+#define _POSIX_C_SOURCE 200809L
+#include "StrList.h"
+#include "StrKernels.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+
+/********************************************************************************
+ *
+ * Tests of the StrList library: what the command line of Main can't drive
+ * (several threads working on lists at once, the string kernels, corrupt
+ * snapshots), and the behaviour of the modes and functions added to it, each
+ * checked in the modes it depends on.
+ *
+ * Every test prints one line, "ok" or what went wrong, and the program exits
+ * with the number of failed tests. make test runs it as it is and built with
+ * AddressSanitizer and ThreadSanitizer, which report the memory errors and the
+ * data races the tests don't see.
+ *
+ * usage: StrListTests [test...]      (all of them by default)
+ *
+ ********************************************************************************/
+
+#define CLONE_WORDS 5000            // elements of the lists read by testCloneReads
+#define CLONE_ROUNDS 200            // reads made by each thread of testCloneReads
+#define WORD_MAX 24                 // bytes of each word of the tests
+#define READER_THREADS 4            // threads reading the list of testWriterNotStarved
+#define READER_WORDS 100000         // elements of that list
+#define READER_MAX_TIME 6.0         // seconds the readers of testWriterNotStarved read at most
+#define WRITER_MAX_TIME 2.0         // seconds its writer may take, readers included
+#define KERNEL_MAX_LEN 300          // longest strings compared by testKernels
+#define COMPACT_WORDS 20000         // elements of the lists compacted by testCompact
+
+/**
+ * A test: run returns NULL when it passes, or a description of the failure.
+ */
+typedef struct Test
+{
+    const char *name;
+    const char *(*run)(void);
+} Test;
+
+/**
+ * Fills words with n distinct words ("w0", "w1"...), stored in storage.
+ */
+static void makeWords(char **words, char *storage, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        words[i] = storage + i * WORD_MAX;
+        snprintf(words[i], WORD_MAX, "w%zu", i);
+    }
+}
+
+/**
+ * A HELPER FUNCTION
+ * Tells whether a list holds the given elements, in order: expected is their
+ * strings separated by single spaces ("" for none).
+ */
+static int holds(StrList *list, const char *expected)
+{
+    StrListCursor cursor;
+    size_t at = 0;
+    for (const char *line = StrList_begin(list, &cursor); line != NULL; line = StrList_next(&cursor))
+    {
+        size_t len = strlen(line);
+        if (at > 0 && expected[at++] != ' ')
+        {
+            return 0;
+        }
+        if (strncmp(expected + at, line, len) != 0 || (expected[at + len] != ' ' && expected[at + len] != '\0'))
+        {
+            return 0;
+        }
+        at += len;
+    }
+    return expected[at] == '\0';
+}
+
+/**
+ * The work of one thread of testCloneReads: a list of its own, which may share its
+ * Store with the list of the other thread, and the words it should hold.
+ */
+typedef struct CloneReader
+{
+    StrList *list;
+    char **words;
+    size_t n;
+    const char *failure;
+} CloneReader;
+
+/**
+ * A HELPER FUNCTION
+ * Reads a list in every way that fills the caches of its Store: by position
+ * (finger and positional index), isEqual (fingerprint), countPrefix (prefix index),
+ * memoryUsage, and the Nodes of a list loaded from a snapshot.
+ */
+static void *cloneReaderRun(void *arg)
+{
+    CloneReader *reader = (CloneReader *)arg;
+    StrList *expected = StrList_alloc();
+    StrList_appendArray(expected, (const char *const *)reader->words, reader->n);
+    StrListCursor cursor;
+    StrList_begin(reader->list, &cursor);
+    unsigned seed = 1;
+    for (int round = 0; round < CLONE_ROUNDS && reader->failure == NULL; round++)
+    {
+        seed = seed * 1103515245u + 12345u;
+        size_t index = (seed >> 8) % reader->n;
+        const char *line = StrList_seek(&cursor, (int)index);
+        if (line == NULL || strcmp(line, reader->words[index]) != 0)
+        {
+            reader->failure = "seek returned the wrong element";
+        }
+        else if (!StrList_isEqual(reader->list, expected))
+        {
+            reader->failure = "isEqual found the lists different";
+        }
+        else if (StrList_countPrefix(reader->list, "w1") != StrList_countPrefix(expected, "w1"))
+        {
+            reader->failure = "countPrefix returned the wrong count";
+        }
+        StrListMemory usage;
+        StrList_memoryUsage(reader->list, &usage);
+    }
+    StrList_free(expected);
+    return NULL;
+}
+
+/**
+ * A HELPER FUNCTION
+ * Reads list and a clone of it on two threads at once.
+ * @return NULL if both threads read what they should, or the failure of one of them.
+ */
+static const char *readCloneOnTwoThreads(StrList *list, char **words, size_t n)
+{
+    StrList *clone = StrList_clone(list);
+    CloneReader readers[2] = {{list, words, n, NULL}, {clone, words, n, NULL}};
+    pthread_t thread;
+    if (clone == NULL || pthread_create(&thread, NULL, cloneReaderRun, &readers[1]) != 0)
+    {
+        StrList_free(clone);
+        return "could not clone the list or start a thread";
+    }
+    cloneReaderRun(&readers[0]);
+    pthread_join(thread, NULL);
+    StrList_free(clone);
+    return (readers[0].failure != NULL) ? readers[0].failure : readers[1].failure;
+}
+
+/**
+ * A list and its clone share their Store until one of them changes, so reading
+ * them on two threads fills the same caches: those are locked while shared.
+ * Run under ThreadSanitizer (make test), which reports any race among them.
+ */
+static const char *testCloneReads(void)
+{
+    char **words = (char **)malloc(CLONE_WORDS * sizeof(char *));
+    char *storage = (char *)malloc(CLONE_WORDS * WORD_MAX);
+    const char *failure = "could not allocate the words";
+    if (words == NULL || storage == NULL)
+    {
+        free(words);
+        free(storage);
+        return failure;
+    }
+    makeWords(words, storage, CLONE_WORDS);
+    const int modes[] = {0, STRLIST_ARENA | STRLIST_HASH_INDEX, STRLIST_CHUNKED, STRLIST_PREFIX_INDEX | STRLIST_HASH_INDEX};
+    char path[] = "/tmp/StrListTestsXXXXXX";
+    int fd = mkstemp(path);
+    if (fd >= 0)
+    {
+        close(fd);
+        failure = NULL;
+    }
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]) && failure == NULL; m++)
+    {
+        StrList *list = StrList_allocWith(modes[m]);
+        StrList_appendArray(list, (const char *const *)words, CLONE_WORDS);
+        failure = readCloneOnTwoThreads(list, words, CLONE_WORDS);
+        // a list loaded from a snapshot has no Nodes until it is first read
+        StrList_save(list, path);
+        StrList_free(list);
+        list = StrList_load(path, modes[m]);
+        if (failure == NULL)
+        {
+            failure = (list == NULL) ? "could not load the snapshot" : readCloneOnTwoThreads(list, words, CLONE_WORDS);
+        }
+        StrList_free(list);
+    }
+    unlink(path);
+    free(words);
+    free(storage);
+    return failure;
+}
+
+/**
+ * A HELPER FUNCTION
+ * Returns a monotonic time in seconds.
+ */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/**
+ * The readers of testWriterNotStarved: they read list until stop is set or
+ * READER_MAX_TIME has passed.
+ */
+typedef struct Readers
+{
+    StrList *list;
+    atomic_int stop;
+    double start;
+} Readers;
+
+static void *readerRun(void *arg)
+{
+    Readers *readers = (Readers *)arg;
+    while (!atomic_load(&readers->stop) && now() - readers->start < READER_MAX_TIME)
+    {
+        StrList_count(readers->list, "w42");
+        StrList_printLen(readers->list);
+        StrListCursor cursor;
+        StrList_begin(readers->list, &cursor);
+        StrList_seek(&cursor, READER_WORDS / 2);
+    }
+    return NULL;
+}
+
+/**
+ * READER_THREADS threads read a STRLIST_CONCURRENT list without a pause, so that
+ * there is always a reader holding its lock, while a writer sorts the list and
+ * removes elements: the writer must get the lock within WRITER_MAX_TIME, not once
+ * the readers give up.
+ */
+static const char *testWriterNotStarved(void)
+{
+    char **words = (char **)malloc(READER_WORDS * sizeof(char *));
+    char *storage = (char *)malloc(READER_WORDS * WORD_MAX);
+    StrList *list = StrList_allocWith(STRLIST_CONCURRENT);
+    if (words == NULL || storage == NULL || list == NULL)
+    {
+        free(words);
+        free(storage);
+        StrList_free(list);
+        return "could not allocate the list";
+    }
+    makeWords(words, storage, READER_WORDS);
+    StrList_appendArray(list, (const char *const *)words, READER_WORDS);
+    Readers readers = {list, 0, now()};
+    pthread_t threads[READER_THREADS];
+    int started = 0;
+    while (started < READER_THREADS && pthread_create(&threads[started], NULL, readerRun, &readers) == 0)
+    {
+        started++;
+    }
+    struct timespec pause = {0, 50000000};
+    nanosleep(&pause, NULL); // let the readers pile up
+    double start = now();
+    StrList_sort(list);
+    for (int i = 0; i < 100; i++)
+    {
+        StrList_removeAt(list, i * 100);
+    }
+    double elapsed = now() - start;
+    atomic_store(&readers.stop, 1);
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    const char *failure = NULL;
+    if (started < READER_THREADS)
+    {
+        failure = "could not start the readers";
+    }
+    else if (elapsed > WRITER_MAX_TIME)
+    {
+        failure = "the writer waited for the readers to stop";
+    }
+    else if (StrList_size(list) != READER_WORDS - 100 || !StrList_isSorted(list))
+    {
+        failure = "the list is not what the writer made";
+    }
+    StrList_free(list);
+    free(words);
+    free(storage);
+    return failure;
+}
+
+/**
+ * A HELPER FUNCTION
+ * The mismatch of two strings, one byte at a time.
+ */
+static size_t referenceMismatch(const char *a, const char *b, size_t len)
+{
+    size_t i = 0;
+    while (i < len && a[i] == b[i])
+    {
+        i++;
+    }
+    return i;
+}
+
+/**
+ * A HELPER FUNCTION
+ * Checks every kernel function on a and b against referenceMismatch, for len chars
+ * of each and for the shorter bLen chars of b.
+ * @return NULL if they agree, or what went wrong.
+ */
+static const char *checkKernelsOn(const char *a, const char *b, size_t len, size_t bLen)
+{
+    size_t at = referenceMismatch(a, b, len);
+    if (StrKernels_mismatch(a, b, len) != at || StrKernels_equal(a, b, len) != (at == len))
+    {
+        return "mismatch or equal disagree with the byte by byte comparison";
+    }
+    int expected = (at < len) ? (unsigned char)a[at] - (unsigned char)b[at] : 0;
+    int order = StrKernels_compare(a, len, b, len);
+    if ((order < 0) != (expected < 0) || (order > 0) != (expected > 0))
+    {
+        return "compare disagrees with the byte by byte comparison";
+    }
+    size_t shortAt = referenceMismatch(a, b, bLen);
+    expected = (shortAt < bLen) ? (unsigned char)a[shortAt] - (unsigned char)b[shortAt] : (len > bLen);
+    order = StrKernels_compare(a, len, b, bLen);
+    if ((order < 0) != (expected < 0) || (order > 0) != (expected > 0))
+    {
+        return "compare of strings of different lengths is wrong";
+    }
+    return NULL;
+}
+
+/**
+ * Runs every kernel of StrKernels.h on strings of 0 to KERNEL_MAX_LEN chars that
+ * differ at each position, or not at all:
+ * - ending right before a page that can't be read, so a kernel reading past the
+ *   end of a string into the next page would crash;
+ * - in heap blocks of their exact size, where AddressSanitizer catches any read
+ *   past the end by the scalar kernel (make test runs it under AddressSanitizer,
+ *   which the other kernels are exempt from, see StrKernels.h).
+ */
+static const char *testKernels(void)
+{
+    const char *names[] = {"scalar", "portable", "sse2", "avx2"};
+    const char *initial = StrKernels_name();
+    long page = sysconf(_SC_PAGESIZE);
+    size_t span = ((KERNEL_MAX_LEN + (size_t)page - 1) / (size_t)page + 1) * (size_t)page;
+    int zero = open("/dev/zero", O_RDWR);
+    char *pages = (zero < 0) ? MAP_FAILED : (char *)mmap(NULL, 2 * span, PROT_READ | PROT_WRITE, MAP_PRIVATE, zero, 0);
+    if (zero >= 0)
+    {
+        close(zero);
+    }
+    if (pages == MAP_FAILED)
+    {
+        return "could not map the strings";
+    }
+    // each string ends where an unreadable page starts
+    char *aEnd = pages + span - (size_t)page;
+    char *bEnd = pages + 2 * span - (size_t)page;
+    mprotect(aEnd, (size_t)page, PROT_NONE);
+    mprotect(bEnd, (size_t)page, PROT_NONE);
+    const char *failure = NULL;
+    for (size_t k = 0; k < sizeof(names) / sizeof(names[0]) && failure == NULL; k++)
+    {
+        if (StrKernels_use(names[k]) != 0)
+        {
+            continue; // the processor lacks it
+        }
+        for (size_t len = 0; len <= KERNEL_MAX_LEN && failure == NULL; len++)
+        {
+            for (size_t diff = 0; diff <= len && failure == NULL; diff++)
+            {
+                char *atPage = aEnd - len;
+                char *btPage = bEnd - len;
+                char *heapA = (char *)malloc(len + 1);
+                char *heapB = (char *)malloc(len + 1);
+                if (heapA == NULL || heapB == NULL)
+                {
+                    failure = "could not allocate the strings";
+                }
+                for (size_t i = 0; i < len && failure == NULL; i++)
+                {
+                    atPage[i] = btPage[i] = heapA[i] = heapB[i] = (char)('a' + i % 26);
+                }
+                if (diff < len && failure == NULL)
+                {
+                    btPage[diff] = heapB[diff] = (char)(atPage[diff] + ((diff % 2) ? 1 : -1));
+                }
+                size_t bLen = len / 2;
+                if (failure == NULL)
+                {
+                    failure = checkKernelsOn(atPage, btPage, len, bLen);
+                }
+                if (failure == NULL)
+                {
+                    // the heap blocks hold no '\0': len bytes exactly
+                    char *exactA = (char *)realloc(heapA, len ? len : 1);
+                    char *exactB = (char *)realloc(heapB, len ? len : 1);
+                    heapA = exactA ? exactA : heapA;
+                    heapB = exactB ? exactB : heapB;
+                    failure = checkKernelsOn(heapA, heapB, len, bLen);
+                }
+                free(heapA);
+                free(heapB);
+            }
+        }
+        if (failure != NULL)
+        {
+            fprintf(stderr, "kernel %s: ", names[k]);
+        }
+    }
+    StrKernels_use(initial);
+    munmap(pages, 2 * span);
+    return failure;
+}
+
+/**
+ * Taking the lock of a STRLIST_CONCURRENT list links in its pending appends, which
+ * gives the list a copy of its Store if it shares it with a clone: a cursor placed
+ * before must still change its own list, not the clone.
+ */
+static const char *testCursorAfterAppend(void)
+{
+    const char *words[] = {"a", "b", "c", "d"};
+    StrList *list = StrList_allocWith(STRLIST_CONCURRENT);
+    StrList_appendArray(list, words, 4);
+    StrListCursor cursor;
+    StrList_begin(list, &cursor);
+    StrList_seek(&cursor, 2);
+    StrList *clone = StrList_clone(list);
+    StrList_insertLast(list, "e");
+    StrList_insertHere(&cursor, "h");
+    const char *failure = NULL;
+    if (!holds(list, "a b h c d e") || !holds(clone, "a b c d"))
+    {
+        failure = "insertHere changed the clone";
+    }
+    StrList_free(clone);
+    clone = StrList_clone(list);
+    StrList_insertLast(list, "f");
+    StrList_removeHere(&cursor);
+    if (failure == NULL && (!holds(list, "a b h d e f") || !holds(clone, "a b h c d e")))
+    {
+        failure = "removeHere changed the clone";
+    }
+    StrList_free(clone);
+    StrList_free(list);
+    return failure;
+}
+
+/**
+ * A change of a list made by testCloneDetach, and what the list holds after it
+ * when it held "d b a c b" before.
+ */
+typedef struct Change
+{
+    const char *name;
+    void (*run)(StrList *list);
+    const char *expected;
+} Change;
+
+static const char *const SOME_WORDS[] = {"e", "f"};
+static const char *const REMOVED_WORDS[] = {"b", "c"};
+
+/**
+ * A HELPER FUNCTION
+ * The predicate of changeRemoveIf: the strings before "c".
+ */
+static int beforeC(const char *line, void *ctx)
+{
+    (void)ctx;
+    return strcmp(line, "c") < 0;
+}
+
+static void changeInsertLast(StrList *list)
+{
+    StrList_insertLast(list, "e");
+}
+
+static void changeAppendArray(StrList *list)
+{
+    StrList_appendArray(list, SOME_WORDS, 2);
+}
+
+static void changeInsertMany(StrList *list)
+{
+    StrList_insertMany(list, SOME_WORDS, 2, 1);
+}
+
+static void changeInsertAt(StrList *list)
+{
+    StrList_insertAt(list, "e", 2);
+}
+
+static void changeRemove(StrList *list)
+{
+    StrList_remove(list, "b");
+}
+
+static void changeRemoveAt(StrList *list)
+{
+    StrList_removeAt(list, 0);
+}
+
+static void changeRemoveAll(StrList *list)
+{
+    StrList_removeAll(list, REMOVED_WORDS, 2);
+}
+
+static void changeRemoveIf(StrList *list)
+{
+    StrList_removeIf(list, beforeC, NULL);
+}
+
+static void changeRemovePrefix(StrList *list)
+{
+    StrList_removePrefix(list, "b");
+}
+
+static void changeReverse(StrList *list)
+{
+    StrList_reverse(list);
+}
+
+static void changeSort(StrList *list)
+{
+    StrList_sort(list);
+}
+
+static void changeSortParallel(StrList *list)
+{
+    StrList_sortParallel(list, 2);
+}
+
+static void changeClear(StrList *list)
+{
+    StrList_clear(list);
+}
+
+static void changeCompact(StrList *list)
+{
+    StrList_compact(list);
+}
+
+static void changeInsertHere(StrList *list)
+{
+    StrListCursor cursor;
+    StrList_begin(list, &cursor);
+    StrList_seek(&cursor, 1);
+    StrList_insertHere(&cursor, "e");
+}
+
+static void changeRemoveHere(StrList *list)
+{
+    StrListCursor cursor;
+    StrList_begin(list, &cursor);
+    StrList_seek(&cursor, 1);
+    StrList_removeHere(&cursor);
+}
+
+static const Change CHANGES[] = {
+    {"insertLast", changeInsertLast, "d b a c b e"},
+    {"appendArray", changeAppendArray, "d b a c b e f"},
+    {"insertMany", changeInsertMany, "d e f b a c b"},
+    {"insertAt", changeInsertAt, "d b e a c b"},
+    {"remove", changeRemove, "d a c"},
+    {"removeAt", changeRemoveAt, "b a c b"},
+    {"removeAll", changeRemoveAll, "d a"},
+    {"removeIf", changeRemoveIf, "d c"},
+    {"removePrefix", changeRemovePrefix, "d a c"},
+    {"reverse", changeReverse, "b c a b d"},
+    {"sort", changeSort, "a b b c d"},
+    {"sortParallel", changeSortParallel, "a b b c d"},
+    {"clear", changeClear, ""},
+    {"compact", changeCompact, "d b a c b"},
+    {"insertHere", changeInsertHere, "d e b a c b"},
+    {"removeHere", changeRemoveHere, "d a c b"},
+};
+
+/**
+ * A list and its clone share their Store until one of them changes: every function
+ * that changes a list must give it a copy of its own first. Each change is made to
+ * the clone and to the list, in every mode that keeps other structures in the Store,
+ * and must leave the other one as it was.
+ */
+static const char *testCloneDetach(void)
+{
+    const char *base[] = {"d", "b", "a", "c", "b"};
+    const int modes[] = {0, STRLIST_ARENA | STRLIST_HASH_INDEX, STRLIST_CHUNKED, STRLIST_INTERN,
+                         STRLIST_CONCURRENT, STRLIST_PREFIX_INDEX};
+    static char failure[128];
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++)
+    {
+        for (size_t c = 0; c < sizeof(CHANGES) / sizeof(CHANGES[0]); c++)
+        {
+            for (int changed = 0; changed < 2; changed++)
+            {
+                StrList *lists[2];
+                lists[0] = StrList_allocWith(modes[m]);
+                StrList_appendArray(lists[0], base, 5);
+                lists[1] = StrList_clone(lists[0]);
+                CHANGES[c].run(lists[changed]);
+                int ok = holds(lists[changed], CHANGES[c].expected) && holds(lists[!changed], "d b a c b")
+                         && StrList_count(lists[!changed], "b") == 2;
+                StrList_free(lists[0]);
+                StrList_free(lists[1]);
+                if (!ok)
+                {
+                    snprintf(failure, sizeof(failure), "%s of the %s in mode 0x%x", CHANGES[c].name,
+                             changed ? "clone" : "list", modes[m]);
+                    return failure;
+                }
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * A STRLIST_SORTED list puts every insert at its sorted position, whatever the
+ * index, finds strings by binary search for count and remove, and ignores reverse
+ * and sort. A snapshot of an unsorted list is sorted when loaded in that mode.
+ */
+static const char *testSorted(void)
+{
+    const char *words[] = {"e", "a"};
+    const char *more[] = {"bb", "b"};
+    const int modes[] = {STRLIST_SORTED, STRLIST_SORTED | STRLIST_HASH_INDEX, STRLIST_SORTED | STRLIST_ARENA};
+    char path[] = "/tmp/StrListTestsXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0)
+    {
+        return "could not create the snapshot file";
+    }
+    close(fd);
+    const char *failure = NULL;
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]) && failure == NULL; m++)
+    {
+        StrList *list = StrList_allocWith(modes[m]);
+        StrList_insertLast(list, "d");
+        StrList_insertLast(list, "b");
+        StrList_insertAt(list, "c", 0);
+        StrList_appendArray(list, words, 2);
+        StrList_insertMany(list, more, 2, 0);
+        StrList_reverse(list);
+        StrList_sort(list);
+        if (!holds(list, "a b b bb c d e") || !StrList_isSorted(list))
+        {
+            failure = "the inserts are out of order";
+        }
+        else if (StrList_count(list, "b") != 2 || StrList_count(list, "a") != 1 || StrList_count(list, "ba") != 0
+                 || StrList_count(list, "f") != 0 || StrList_count(list, "") != 0)
+        {
+            failure = "count is wrong";
+        }
+        StrList_remove(list, "b");
+        StrList_remove(list, "f");
+        StrList_removeAt(list, 0);
+        if (failure == NULL && (!holds(list, "bb c d e") || StrList_count(list, "b") != 0 || StrList_size(list) != 4))
+        {
+            failure = "remove left the wrong elements";
+        }
+        StrList_free(list);
+        // a snapshot of an unsorted list
+        list = StrList_alloc();
+        StrList_insertLast(list, "z");
+        StrList_insertLast(list, "y");
+        StrList_insertLast(list, "x");
+        StrList_save(list, path);
+        StrList_free(list);
+        list = StrList_load(path, modes[m]);
+        if (failure == NULL && (list == NULL || !holds(list, "x y z") || StrList_count(list, "y") != 1))
+        {
+            failure = "a loaded snapshot is not sorted";
+        }
+        StrList_free(list);
+    }
+    unlink(path);
+    return failure;
+}
+
+/**
+ * A HELPER FUNCTION
+ * Writes len bytes of data to path, replacing it.
+ * @return 0 on success, -1 on failure.
+ */
+static int writeFile(const char *path, const char *data, size_t len)
+{
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        return -1;
+    }
+    size_t written = fwrite(data, 1, len, file);
+    return (fclose(file) == 0 && written == len) ? 0 : -1;
+}
+
+/**
+ * StrList_load must refuse a file that is not a whole snapshot: truncated, with a
+ * wrong header, offsets that don't grow or end past the strings, or a string that
+ * lacks its '\0' or holds another one (its length would not be that of the C
+ * string). The snapshot of "ab" and "cd" ends with its offsets (0, 3, 6) and its
+ * strings ("ab\0cd\0"), which the corruptions change.
+ */
+static const char *testCorruptSnapshots(void)
+{
+    char path[] = "/tmp/StrListTestsXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0)
+    {
+        return "could not create the snapshot file";
+    }
+    close(fd);
+    StrList *list = StrList_alloc();
+    StrList_insertLast(list, "ab");
+    StrList_insertLast(list, "cd");
+    int saved = StrList_save(list, path);
+    StrList_free(list);
+    char good[256];
+    FILE *file = fopen(path, "rb");
+    size_t len = (file != NULL) ? fread(good, 1, sizeof(good), file) : 0;
+    if (file != NULL)
+    {
+        fclose(file);
+    }
+    const size_t blob = len - 6;
+    const size_t offsets = blob - 3 * sizeof(uint64_t);
+    if (saved != 0 || len < 6 + 3 * sizeof(uint64_t) || len == sizeof(good) || memcmp(good + blob, "ab\0cd\0", 6) != 0)
+    {
+        unlink(path);
+        return "the snapshot is not laid out as the test expects";
+    }
+    const int modes[] = {0, STRLIST_CHUNKED, STRLIST_SORTED};
+    const char *failure = NULL;
+    for (int corruption = 0; corruption < 8 && failure == NULL; corruption++)
+    {
+        char bytes[256];
+        memcpy(bytes, good, len);
+        size_t size = len;
+        uint64_t offset;
+        switch (corruption)
+        {
+        case 1: // truncated
+            size--;
+            break;
+        case 2: // wrong magic
+            bytes[0] ^= 1;
+            break;
+        case 3: // "ab" without its '\0'
+            bytes[blob + 2] = 'x';
+            break;
+        case 4: // a '\0' inside "ab"
+            bytes[blob + 1] = '\0';
+            break;
+        case 5: // offsets that don't grow
+            offset = 0;
+            memcpy(bytes + offsets + sizeof(uint64_t), &offset, sizeof(offset));
+            break;
+        case 6: // the last offset past the strings
+            offset = 7;
+            memcpy(bytes + offsets + 2 * sizeof(uint64_t), &offset, sizeof(offset));
+            break;
+        case 7: // the last string without its '\0'
+            bytes[len - 1] = 'x';
+            break;
+        }
+        if (writeFile(path, bytes, size) != 0)
+        {
+            failure = "could not write the snapshot";
+        }
+        for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]) && failure == NULL; m++)
+        {
+            list = StrList_load(path, modes[m]);
+            if (corruption == 0 && (list == NULL || !holds(list, "ab cd")))
+            {
+                failure = "the intact snapshot did not load";
+            }
+            else if (corruption > 0 && list != NULL)
+            {
+                static char message[64];
+                snprintf(message, sizeof(message), "corruption %d was loaded", corruption);
+                failure = message;
+            }
+            StrList_free(list);
+        }
+    }
+    unlink(path);
+    return failure;
+}
+
+/**
+ * A HELPER FUNCTION
+ * The predicate of testRemoveMany: the strings whose number (after their 'w') is odd.
+ */
+static int oddWord(const char *line, void *ctx)
+{
+    (void)ctx;
+    return strtol(line + 1, NULL, 10) % 2 == 1;
+}
+
+/**
+ * StrList_removeAll and StrList_removeIf remove in one pass what a StrList_remove
+ * per word would, in every mode with its own way of finding or indexing strings,
+ * and leave the indexes (count, countPrefix, isSorted) agreeing with the list.
+ */
+static const char *testRemoveMany(void)
+{
+    const char *words[] = {"w3", "w1", "w4", "w1", "w5", "w9", "w2", "w6", "w5", "w3"};
+    const char *removed[] = {"w1", NULL, "w5", "w7", "w1", ""};
+    const int modes[] = {0, STRLIST_HASH_INDEX, STRLIST_ARENA, STRLIST_CHUNKED, STRLIST_INTERN, STRLIST_SORTED,
+                         STRLIST_PREFIX_INDEX, STRLIST_CONCURRENT};
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++)
+    {
+        int sorted = (modes[m] & STRLIST_SORTED) != 0;
+        StrList *list = StrList_allocWith(modes[m]);
+        StrList_appendArray(list, words, 10);
+        StrList_removeAll(list, removed, 6);
+        if (!holds(list, sorted ? "w2 w3 w3 w4 w6 w9" : "w3 w4 w9 w2 w6 w3") || StrList_count(list, "w1") != 0
+            || StrList_count(list, "w3") != 2 || StrList_countPrefix(list, "w") != 6)
+        {
+            StrList_free(list);
+            return "removeAll left the wrong elements";
+        }
+        StrList_removeIf(list, oddWord, NULL);
+        if (!holds(list, sorted ? "w2 w4 w6" : "w4 w2 w6") || StrList_count(list, "w3") != 0
+            || StrList_countPrefix(list, "w") != 3 || StrList_isSorted(list) != sorted)
+        {
+            StrList_free(list);
+            return "removeIf left the wrong elements";
+        }
+        StrList_removeIf(list, oddWord, NULL);
+        StrList_removeAll(list, words, 0);
+        StrList_insertLast(list, "w8");
+        if (!holds(list, sorted ? "w2 w4 w6 w8" : "w4 w2 w6 w8") || StrList_count(list, "w8") != 1)
+        {
+            StrList_free(list);
+            return "the list is wrong after removing nothing";
+        }
+        StrList_free(list);
+    }
+    return NULL;
+}
+
+/**
+ * A reversed list is walked, searched by position and changed through cursors in
+ * its new order, and its order stays right when it is reversed back.
+ */
+static const char *testReversedCursors(void)
+{
+    const char *words[] = {"a", "b", "c", "d"};
+    const int modes[] = {0, STRLIST_CHUNKED, STRLIST_HASH_INDEX, STRLIST_CONCURRENT};
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++)
+    {
+        StrList *list = StrList_allocWith(modes[m]);
+        StrList_appendArray(list, words, 4);
+        StrList_reverse(list);
+        StrListCursor cursor;
+        const char *failure = NULL;
+        if (!holds(list, "d c b a") || strcmp(StrList_firstData(list), "d") != 0)
+        {
+            failure = "the reversed list reads in the wrong order";
+        }
+        StrList_begin(list, &cursor);
+        const char *line = StrList_seek(&cursor, 1);
+        if (failure == NULL && (line == NULL || strcmp(line, "c") != 0 || StrList_cursorIndex(&cursor) != 1))
+        {
+            failure = "seek found the wrong element";
+        }
+        StrList_insertHere(&cursor, "x");
+        if (failure == NULL && (!holds(list, "d x c b a") || strcmp(StrList_here(&cursor), "c") != 0
+                                || StrList_cursorIndex(&cursor) != 2))
+        {
+            failure = "insertHere put the element in the wrong place";
+        }
+        line = StrList_removeHere(&cursor);
+        if (failure == NULL && (line == NULL || strcmp(line, "b") != 0 || !holds(list, "d x b a")))
+        {
+            failure = "removeHere removed the wrong element";
+        }
+        line = StrList_prev(&cursor);
+        if (failure == NULL && (line == NULL || strcmp(line, "x") != 0))
+        {
+            failure = "prev went the wrong way";
+        }
+        StrList_seek(&cursor, 4);
+        StrList_insertHere(&cursor, "y");
+        StrList_reverse(list);
+        StrList_begin(list, &cursor);
+        line = StrList_next(&cursor);
+        if (failure == NULL && (!holds(list, "y a b x d") || line == NULL || strcmp(line, "a") != 0))
+        {
+            failure = "the list reversed back is in the wrong order";
+        }
+        StrList_free(list);
+        if (failure != NULL)
+        {
+            return failure;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Compacting a list after many removals keeps its elements, their order, its mode
+ * and its indexes, reports success, and leaves a list that can still be changed.
+ * A list sharing its Store and one loaded from a snapshot are compacted too.
+ */
+static const char *testCompact(void)
+{
+    char **words = (char **)malloc(COMPACT_WORDS * sizeof(char *));
+    char *storage = (char *)malloc(COMPACT_WORDS * WORD_MAX);
+    if (words == NULL || storage == NULL)
+    {
+        free(words);
+        free(storage);
+        return "could not allocate the words";
+    }
+    makeWords(words, storage, COMPACT_WORDS);
+    const int modes[] = {0, STRLIST_ARENA, STRLIST_ARENA | STRLIST_HASH_INDEX, STRLIST_INTERN, STRLIST_CHUNKED,
+                         STRLIST_CONCURRENT, STRLIST_PREFIX_INDEX};
+    const char *failure = NULL;
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]) && failure == NULL; m++)
+    {
+        StrList *list = StrList_allocWith(modes[m]);
+        StrList *expected = StrList_alloc();
+        StrList_appendArray(list, (const char *const *)words, COMPACT_WORDS);
+        for (size_t i = 0; i < COMPACT_WORDS; i += 2)
+        {
+            StrList_remove(list, words[i]);
+            StrList_insertLast(expected, words[i + 1]);
+        }
+        StrList *clone = StrList_clone(list);
+        StrListMemory before, after;
+        StrList_memoryUsage(list, &before);
+        if (StrList_compact(list) != 0 || StrList_compact(clone) != 0)
+        {
+            failure = "compact failed";
+        }
+        StrList_memoryUsage(list, &after);
+        if (failure == NULL && (!StrList_isEqual(list, expected) || !StrList_isEqual(clone, expected)))
+        {
+            failure = "compact changed the elements";
+        }
+        else if (failure == NULL && (StrList_count(list, words[1]) != 1 || StrList_count(list, words[0]) != 0
+                                     || StrList_countPrefix(list, "w1") != StrList_countPrefix(expected, "w1")))
+        {
+            failure = "the indexes are wrong after compact";
+        }
+        else if (failure == NULL && (modes[m] & STRLIST_ARENA) && after.wastedBytes >= before.wastedBytes)
+        {
+            failure = "compact left the arena as wasteful";
+        }
+        StrList_insertAt(list, "x", 1);
+        StrList_removeAt(list, 0);
+        StrList_insertAt(expected, "x", 1);
+        StrList_removeAt(expected, 0);
+        if (failure == NULL && !StrList_isEqual(list, expected))
+        {
+            failure = "the list is wrong when changed after compact";
+        }
+        StrList_free(clone);
+        StrList_free(list);
+        StrList_free(expected);
+    }
+    char path[] = "/tmp/StrListTestsXXXXXX";
+    int fd = mkstemp(path);
+    if (fd >= 0 && failure == NULL)
+    {
+        close(fd);
+        StrList *list = StrList_alloc();
+        StrList_appendArray(list, (const char *const *)words, 3);
+        StrList_save(list, path);
+        StrList_free(list);
+        list = StrList_load(path, 0);
+        if (list == NULL || StrList_compact(list) != 0 || !holds(list, "w0 w1 w2"))
+        {
+            failure = "compact of a loaded list failed";
+        }
+        StrList_free(list);
+        unlink(path);
+    }
+    else if (fd < 0 && failure == NULL)
+    {
+        failure = "could not create the snapshot file";
+    }
+    free(words);
+    free(storage);
+    return failure;
+}
+
+static const Test TESTS[] = {
+    {"cloneReads", testCloneReads},
+    {"writerNotStarved", testWriterNotStarved},
+    {"kernels", testKernels},
+    {"cursorAfterAppend", testCursorAfterAppend},
+    {"cloneDetach", testCloneDetach},
+    {"sorted", testSorted},
+    {"corruptSnapshots", testCorruptSnapshots},
+    {"removeMany", testRemoveMany},
+    {"reversedCursors", testReversedCursors},
+    {"compact", testCompact},
+};
+
+int main(int argc, char *argv[])
+{
+    int failed = 0;
+    for (size_t i = 0; i < sizeof(TESTS) / sizeof(TESTS[0]); i++)
+    {
+        int selected = (argc == 1);
+        for (int a = 1; a < argc; a++)
+        {
+            selected |= (strcmp(argv[a], TESTS[i].name) == 0);
+        }
+        if (!selected)
+        {
+            continue;
+        }
+        const char *failure = TESTS[i].run();
+        printf("%-20s %s\n", TESTS[i].name, (failure == NULL) ? "ok" : failure);
+        failed += (failure != NULL);
+    }
+    return failed;
+}
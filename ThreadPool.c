@@ -0,0 +1,149 @@
+#define _POSIX_C_SOURCE 200809L
+#include "ThreadPool.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/**
+ * ThreadPool structure.
+ * A loop is published by setting task/ctx/ntasks and bumping generation,
+ * the workers then grab iterations through next until all ntasks are taken.
+ * done counts the finished iterations so the caller knows when to return.
+ */
+struct _ThreadPool {
+    pthread_t* workers;
+    int nworkers;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wake;      // signalled when a loop is published or the pool stops
+    pthread_cond_t finished;  // signalled when the last iteration of a loop is done
+    pthread_mutex_t runLock;  // serializes the loops of concurrent callers
+
+    void (*task)(void* ctx, int i);
+    void* ctx;
+    int ntasks;
+    int next;
+    int done;
+    unsigned long generation;
+    int stop;
+};
+
+/** A HELPER FUNCTION
+ * Runs the iterations of the current loop until none is left.
+ * Called with the pool lock held, returns with it held.
+ */
+static void runIterations(ThreadPool* pool) {
+    while (pool->next < pool->ntasks) {
+        int i = pool->next++;
+        pthread_mutex_unlock(&pool->lock);
+        pool->task(pool->ctx, i);
+        pthread_mutex_lock(&pool->lock);
+        if (++pool->done == pool->ntasks) {
+            pthread_cond_broadcast(&pool->finished);
+        }
+    }
+}
+
+/** A HELPER FUNCTION
+ * The body of a worker thread: waits for a new loop and helps running it.
+ */
+static void* workerMain(void* arg) {
+    ThreadPool* pool = (ThreadPool*)arg;
+    unsigned long seen = 0;
+    pthread_mutex_lock(&pool->lock);
+    while (1) {
+        while (!pool->stop && pool->generation == seen) {
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        }
+        if (pool->stop) {
+            break;
+        }
+        seen = pool->generation;
+        runIterations(pool);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+ThreadPool* ThreadPool_alloc(int nthreads) {
+    if (nthreads < 1) {
+        nthreads = 1;
+    }
+    ThreadPool* pool = (ThreadPool*)malloc(sizeof(ThreadPool));
+    if (pool == NULL) {
+        return NULL;
+    }
+    pool->workers = (pthread_t*)malloc(sizeof(pthread_t) * nthreads);
+    if (pool->workers == NULL) {
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->finished, NULL);
+    pthread_mutex_init(&pool->runLock, NULL);
+    pool->task = NULL;
+    pool->ctx = NULL;
+    pool->ntasks = 0;
+    pool->next = 0;
+    pool->done = 0;
+    pool->generation = 0;
+    pool->stop = 0;
+    pool->nworkers = 0;
+    for (int i = 0; i < nthreads - 1; i++) {
+        if (pthread_create(&pool->workers[i], NULL, workerMain, pool) != 0) {
+            ThreadPool_free(pool);
+            return NULL;
+        }
+        pool->nworkers++;
+    }
+    return pool;
+}
+
+void ThreadPool_free(ThreadPool* pool) {
+    if (pool == NULL) return;
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->nworkers; i++) {
+        pthread_join(pool->workers[i], NULL);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+    pthread_cond_destroy(&pool->finished);
+    pthread_mutex_destroy(&pool->runLock);
+    free(pool->workers);
+    free(pool);
+}
+
+int ThreadPool_size(const ThreadPool* pool) {
+    return pool->nworkers + 1;
+}
+
+void ThreadPool_parallelFor(ThreadPool* pool, int ntasks,
+        void (*task)(void* ctx, int i), void* ctx) {
+    if (ntasks <= 0) {
+        return;
+    }
+    pthread_mutex_lock(&pool->runLock);
+    pthread_mutex_lock(&pool->lock);
+    pool->task = task;
+    pool->ctx = ctx;
+    pool->ntasks = ntasks;
+    pool->next = 0;
+    pool->done = 0;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->wake);
+    runIterations(pool);
+    while (pool->done < pool->ntasks) {
+        pthread_cond_wait(&pool->finished, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    pthread_mutex_unlock(&pool->runLock);
+}
+
+int ThreadPool_cpuCount() {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return (n < 1) ? 1 : (int)n;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+/********************************************************************************
+ *
+ * A ThreadPool library.
+ *
+ * A fixed set of pthread workers that run the iterations of a parallel for loop.
+ * The thread calling ThreadPool_parallelFor takes part in the work and returns
+ * once every iteration is done.
+ *
+ ********************************************************************************/
+
+struct _ThreadPool;
+typedef struct _ThreadPool ThreadPool;
+
+/*
+ * Allocates a pool running loops on nthreads threads (the caller and nthreads-1 workers).
+ * It's the user responsibility to free it with ThreadPool_free.
+ * Returns NULL if the pool or one of its threads could not be created.
+ */
+ThreadPool* ThreadPool_alloc(int nthreads);
+
+/*
+ * Stops the workers and frees the pool.
+ * If pool==NULL does nothing (same as free).
+ */
+void ThreadPool_free(ThreadPool* pool);
+
+/*
+ * Returns the number of threads running the loops of the pool.
+ */
+int ThreadPool_size(const ThreadPool* pool);
+
+/*
+ * Calls task(ctx, i) for every i in [0, ntasks) on the threads of the pool,
+ * and returns when all the calls have returned.
+ * Loops on the same pool are run one after the other.
+ */
+void ThreadPool_parallelFor(ThreadPool* pool, int ntasks,
+	void (*task)(void* ctx, int i), void* ctx);
+
+/*
+ * Returns the number of online processors (at least 1).
+ */
+int ThreadPool_cpuCount();